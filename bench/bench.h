@@ -0,0 +1,77 @@
+//
+// msgpack::rpc microbenchmarks - MessagePack-RPC for C++
+//
+// Copyright (C) 2009-2010 FURUHASHI Sadayuki
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+#ifndef MSGPACK_RPC_BENCH_H__
+#define MSGPACK_RPC_BENCH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// A self-contained harness in the spirit of Google Benchmark. Each case
+// runs its loop for state.iterations() rounds; the runner grows the
+// iteration count until a run lasts --min-time, and reports the time per
+// iteration. Cases registered with threads > 1 run the function on that
+// many threads at once, each for iterations() rounds.
+//
+//   static void bench_foo(bench_state& st)
+//   {
+//       for (uint64_t i = 0; i < st.iterations(); ++i) {
+//           bench_keep(foo());
+//       }
+//   }
+//   BENCH(bench_foo);
+//   BENCH_THREADS(bench_foo, 4);
+
+class bench_state
+{
+public:
+    bench_state(uint64_t iterations, size_t threads, size_t thread_index) :
+        m_iterations(iterations), m_threads(threads), m_thread_index(thread_index) { }
+
+    uint64_t iterations() const { return m_iterations; }
+    size_t threads() const { return m_threads; }
+    size_t thread_index() const { return m_thread_index; }
+
+private:
+    uint64_t m_iterations;
+    size_t m_threads;
+    size_t m_thread_index;
+};
+
+typedef void (*bench_func)(bench_state&);
+
+int bench_register(const char* name, bench_func func, size_t threads);
+
+#define BENCH(func) \
+    static int bench_reg_##func = bench_register(#func, &func, 1)
+
+#define BENCH_THREADS(func, n) \
+    static int bench_reg_##func##_##n = bench_register(#func "/threads:" #n, &func, n)
+
+// keeps the compiler from optimizing 'value' away
+template <typename T>
+inline void bench_keep(const T& value)
+{
+#if defined(__GNUC__)
+    __asm__ __volatile__("" : : "g"(&value) : "memory");
+#else
+    static const volatile T* sink;
+    sink = &value;
+#endif
+}
+
+#endif /* bench/bench.h */
@@ -0,0 +1,229 @@
+//
+// msgpack::rpc microbenchmarks - MessagePack-RPC for C++
+//
+// Copyright (C) 2009-2010 FURUHASHI Sadayuki
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+#include "bench.h"
+
+#include <msgpack.hpp>
+#include <msgpack/rpc/buffer.h>
+#include <msgpack/rpc/protocol.h>
+#include <msgpack/rpc/send_buffer.h>
+#include <msgpack/rpc/session_impl.h>
+#include <msgpack/rpc/session_pool.h>
+#include <msgpack/rpc/transport_impl.h>
+#include <msgpack/rpc/types.h>
+#include <msgpack/rpc/zone_pool.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+using namespace msgpack;
+using namespace msgpack::rpc;
+
+// Encode and decode of the messages on the wire, without any IO.
+
+static const size_t PAYLOAD_SIZE = 1024;
+
+static std::string payload()
+{
+    return std::string(PAYLOAD_SIZE, 'x');
+}
+
+static void pack_request_sbuffer(bench_state& st)
+{
+    std::string data = payload();
+    std::string method = "echo";
+    msgpack::sbuffer sbuf;
+    for (uint64_t i = 0; i < st.iterations(); ++i) {
+        sbuf.clear();
+        msg_request<std::string, type::tuple<const std::string&> > msgreq(
+                method, type::tuple<const std::string&>(data), (msgid_t)i);
+        msgpack::pack(sbuf, msgreq);
+        bench_keep(sbuf.size());
+    }
+}
+BENCH(pack_request_sbuffer);
+
+static void pack_request_vrefbuffer(bench_state& st)
+{
+    std::string data = payload();
+    std::string method = "echo";
+    for (uint64_t i = 0; i < st.iterations(); ++i) {
+        // the session keeps the vrefbuffer alive until the write completes,
+        // so each request pays for a fresh one
+        msgpack::vrefbuffer vbuf;
+        msg_request<std::string, type::tuple<const std::string&> > msgreq(
+                method, type::tuple<const std::string&>(data), (msgid_t)i);
+        msgpack::pack(vbuf, msgreq);
+        bench_keep(vbuf.vector_size());
+    }
+}
+BENCH(pack_request_vrefbuffer);
+
+static void pack_request_send_buffer(bench_state& st)
+{
+    std::string data = payload();
+    std::string method = "echo";
+    for (uint64_t i = 0; i < st.iterations(); ++i) {
+        send_buffer buf;
+        msg_request<std::string, type::tuple<const std::string&> > msgreq(
+                method, type::tuple<const std::string&>(data), (msgid_t)i);
+        msgpack::pack(buf, msgreq);
+        bench_keep(buf.vector_size());
+    }
+}
+BENCH(pack_request_send_buffer);
+
+// Answers every request as soon as it is sent, without IO, so that
+// session::call(const prepared_call&) runs its whole path but the network.
+class answering_transport : public client_transport
+{
+public:
+    answering_transport(session_impl* s) : m_session(s) { }
+
+    void send_data(sbuffer* sbuf) { }
+    void send_data(auto_vreflife vbuf) { }
+
+    void send_data(send_buffer* buf)
+    {
+        // [type, msgid, ...] with msgid as a 32 bit integer, as prepared
+        // calls write it
+        const unsigned char* p = (const unsigned char*)buf->vector()[0].iov_base;
+        uint32_t id = ((uint32_t)p[3] << 24) | ((uint32_t)p[4] << 16) |
+            ((uint32_t)p[5] << 8) | (uint32_t)p[6];
+        m_session->on_response((msgid_t)id, object(), object(), auto_zone());
+    }
+
+private:
+    session_impl* m_session;
+};
+
+class answering_builder : public builder::base<answering_builder>
+{
+public:
+    std::unique_ptr<client_transport> build(session_impl* s, const address& addr) const
+    {
+        return std::unique_ptr<client_transport>(new answering_transport(s));
+    }
+};
+
+static void session_call_prepared(bench_state& st)
+{
+    session_pool sp((answering_builder()));
+    session s = sp.get_session(address(
+            boost::asio::ip::address::from_string("127.0.0.1"), 18800));
+
+    std::string data = payload();
+    prepared_call pc = s.prepare("echo", type::tuple<const std::string&>(data));
+    for (uint64_t i = 0; i < st.iterations(); ++i) {
+        future f = s.call(pc);
+        bench_keep(f.get<type::nil>());
+    }
+}
+BENCH(session_call_prepared);
+
+static msgpack::sbuffer packed_request()
+{
+    std::string data = payload();
+    msgpack::sbuffer sbuf;
+    msg_request<std::string, type::tuple<const std::string&> > msgreq(
+            "echo", type::tuple<const std::string&>(data), 1);
+    msgpack::pack(sbuf, msgreq);
+    return sbuf;
+}
+
+static msgpack::sbuffer packed_response()
+{
+    std::string data = payload();
+    msgpack::sbuffer sbuf;
+    msg_response<const std::string&, type::nil> msgres(data, type::nil(), 1);
+    msgpack::pack(sbuf, msgres);
+    return sbuf;
+}
+
+// the same steps as stream_handler::on_read and on_message
+static void decode(const msgpack::sbuffer& sbuf, msgpack::unpacker& pac, zone_pool& zones)
+{
+    pac.reserve_buffer(sbuf.size());
+    memcpy(pac.buffer(), sbuf.data(), sbuf.size());
+    pac.buffer_consumed(sbuf.size());
+
+    object msg;
+    auto_zone z;
+    while (zones.next(&pac, &msg, &z)) {
+        msg_rpc rpc;
+        msg.convert(&rpc);
+        if (rpc.type == REQUEST) {
+            msg_request<object, object> req;
+            msg.convert(&req);
+            bench_keep(req.msgid);
+        } else {
+            msg_response<object, object> res;
+            msg.convert(&res);
+            bench_keep(res.msgid);
+        }
+    }
+}
+
+static void decode_request(bench_state& st)
+{
+    msgpack::sbuffer sbuf = packed_request();
+    msgpack::unpacker pac;
+    std::shared_ptr<zone_pool> zones(new zone_pool());
+    for (uint64_t i = 0; i < st.iterations(); ++i) {
+        decode(sbuf, pac, *zones);
+    }
+}
+BENCH(decode_request);
+
+static void decode_response(bench_state& st)
+{
+    msgpack::sbuffer sbuf = packed_response();
+    msgpack::unpacker pac;
+    std::shared_ptr<zone_pool> zones(new zone_pool());
+    for (uint64_t i = 0; i < st.iterations(); ++i) {
+        decode(sbuf, pac, *zones);
+    }
+}
+BENCH(decode_response);
+
+static void buffer_from_object(bench_state& st)
+{
+    std::vector<char> data(PAYLOAD_SIZE, 'x');
+    object o;
+    o.type = type::BIN;
+    o.via.bin.ptr = &data[0];
+    o.via.bin.size = (uint32_t)data.size();
+    for (uint64_t i = 0; i < st.iterations(); ++i) {
+        buffer b;
+        o >> b;
+        bench_keep(b.data());
+    }
+}
+BENCH(buffer_from_object);
+
+static void buffer_pack(bench_state& st)
+{
+    std::vector<char> data(PAYLOAD_SIZE, 'x');
+    buffer b(&data[0], (uint32_t)data.size());
+    msgpack::sbuffer sbuf;
+    for (uint64_t i = 0; i < st.iterations(); ++i) {
+        sbuf.clear();
+        msgpack::pack(sbuf, b);
+        bench_keep(sbuf.size());
+    }
+}
+BENCH(buffer_pack);
@@ -0,0 +1,109 @@
+//
+// msgpack::rpc microbenchmarks - MessagePack-RPC for C++
+//
+// Copyright (C) 2009-2010 FURUHASHI Sadayuki
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+#include "bench.h"
+
+#include <msgpack/rpc/future.h>
+#include <msgpack/rpc/future_impl.h>
+#include <msgpack/rpc/reqtable.h>
+#include <msgpack/rpc/session_pool.h>
+#include <memory>
+#include <vector>
+
+using namespace msgpack;
+using namespace msgpack::rpc;
+
+// The per-request bookkeeping on the client side: the pending request
+// table, the future, and the session lookup.
+
+static reqtable& shared_reqtable()
+{
+    static reqtable table;
+    return table;
+}
+
+// Each thread cycles through its own window of msgids, so insert and take
+// contend on the table's lock but never on the same entry.
+static void reqtable_insert_take(bench_state& st)
+{
+    static const msgid_t WINDOW = 64;
+    reqtable& table = shared_reqtable();
+    loop lo;
+
+    std::vector<shared_future> futures;
+    for (msgid_t i = 0; i < WINDOW; ++i) {
+        futures.push_back(std::make_shared<future_impl>(lo));
+    }
+
+    msgid_t base = (msgid_t)st.thread_index() * WINDOW;
+    for (uint64_t i = 0; i < st.iterations(); ++i) {
+        msgid_t msgid = base + (msgid_t)(i % WINDOW);
+        table.insert(msgid, futures[i % WINDOW]);
+        shared_future f = table.take(msgid);
+        bench_keep(f);
+    }
+}
+BENCH(reqtable_insert_take);
+BENCH_THREADS(reqtable_insert_take, 4);
+
+static void future_set_get(bench_state& st)
+{
+    loop lo;
+    object nil;
+    for (uint64_t i = 0; i < st.iterations(); ++i) {
+        shared_future impl = std::make_shared<future_impl>(lo);
+        impl->set_result(nil, nil, auto_zone());
+        future f(impl);
+        f.get<type::nil>();
+    }
+}
+BENCH(future_set_get);
+
+static session_pool& shared_pool()
+{
+    static session_pool sp;
+    return sp;
+}
+
+static void session_pool_get_session(bench_state& st)
+{
+    session_pool& sp = shared_pool();
+    address addr(boost::asio::ip::address::from_string("127.0.0.1"), 18800);
+    for (uint64_t i = 0; i < st.iterations(); ++i) {
+        session s = sp.get_session(addr);
+        bench_keep(s);
+    }
+}
+BENCH(session_pool_get_session);
+BENCH_THREADS(session_pool_get_session, 4);
+
+// lookups spread over many addresses, as when a server calls its peers
+static void session_pool_get_session_spread(bench_state& st)
+{
+    session_pool& sp = shared_pool();
+    std::vector<address> addrs;
+    for (unsigned short port = 0; port < 64; ++port) {
+        addrs.push_back(address(
+                boost::asio::ip::address::from_string("127.0.0.1"), 18900 + port));
+    }
+    for (uint64_t i = 0; i < st.iterations(); ++i) {
+        session s = sp.get_session(addrs[i % addrs.size()]);
+        bench_keep(s);
+    }
+}
+BENCH(session_pool_get_session_spread);
+BENCH_THREADS(session_pool_get_session_spread, 4);
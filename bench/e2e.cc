@@ -0,0 +1,519 @@
+//
+// msgpack::rpc microbenchmarks - MessagePack-RPC for C++
+//
+// Copyright (C) 2009-2010 FURUHASHI Sadayuki
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+#include "bench.h"
+#include "echo_server.h"
+
+#include <algorithm>
+#include <boost/log/core.hpp>
+#include <boost/log/expressions.hpp>
+#include <boost/log/trivial.hpp>
+#include <boost/thread.hpp>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <msgpack/rpc/future.h>
+#include <msgpack/rpc/session_pool.h>
+#include <msgpack/rpc/stats.h>
+#include <msgpack/rpc/transport/tcp.h>
+#include <msgpack/rpc/transport/udp.h>
+#include <signal.h>
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+
+// End-to-end benchmark matrix. Starts the myecho server in this process
+// and, for every combination of transport, loop workers, client threads,
+// pipeline depth and payload size, runs echo_huge calls for a fixed time.
+//
+// usage: mprpc_e2e [--transport=tcp,udp] [--workers=1,4] [--threads=1,8]
+//                  [--depth=1,16] [--size=16,1024,65536,1048576]
+//                  [--seconds=1] [--port=18820] [--out=FILE]
+//                  [--compare=BASELINE] [--threshold=0.10]
+//
+// Results are written as JSON, to --out or stdout. With --compare, every
+// cell is matched against the same cell of a saved result file, and the
+// run exits with 1 if throughput fell or p99 or CPU per call rose by more
+// than --threshold.
+//
+// CPU time covers the whole process, server included. Peak RSS is the
+// high-water mark of the cell: on Linux it is reset before every cell
+// through /proc/self/clear_refs, elsewhere it is that of the process so
+// far and never goes down across cells.
+
+using msgpack::type::raw_ref;
+
+// UDP sends a message in one datagram
+static const size_t UDP_MAX_SIZE = 30000;
+
+struct e2e_cell {
+    std::string transport;
+    size_t workers;
+    size_t threads;
+    size_t depth;
+    size_t size;
+
+    std::string key() const
+    {
+        std::ostringstream os;
+        os << transport << "/workers:" << workers << "/threads:" << threads
+            << "/depth:" << depth << "/size:" << size;
+        return os.str();
+    }
+};
+
+struct e2e_result {
+    e2e_cell cell;
+    uint64_t calls;
+    uint64_t errors;
+    double seconds;
+    double calls_per_sec;
+    double mbytes_per_sec;
+    uint64_t p50;
+    uint64_t p90;
+    uint64_t p99;
+    uint64_t p999;
+    uint64_t max;
+    double cpu_usec_per_call;
+    long peak_rss_kb;
+};
+
+static double cpu_seconds()
+{
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec
+        + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+// resets the high-water mark read by peak_rss_kb() to the current RSS
+static void reset_peak_rss()
+{
+    std::ofstream clear_refs("/proc/self/clear_refs");
+    if(clear_refs) {
+        clear_refs << "5";
+    }
+}
+
+static long peak_rss_kb()
+{
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while(std::getline(status, line)) {
+        if(line.compare(0, 6, "VmHWM:") == 0) {
+            return strtol(line.c_str() + 6, NULL, 10);
+        }
+    }
+
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss;
+}
+
+typedef std::chrono::steady_clock clock_type;
+
+struct client_state {
+    rpc::session_pool* sp;
+    rpc::address addr;
+    raw_ref payload;
+    size_t depth;
+    clock_type::time_point deadline;
+    rpc::latency_recorder* latency;
+
+    boost::mutex mutex;
+    uint64_t calls;
+    uint64_t errors;
+};
+
+static void record_latency(rpc::latency_recorder* latency,
+        clock_type::time_point sent, rpc::future f)
+{
+    latency->record("echo_huge", std::chrono::duration_cast<std::chrono::microseconds>(
+                clock_type::now() - sent).count());
+}
+
+static void client_main(client_state* st)
+{
+    rpc::session s = st->sp->get_session(st->addr);
+    s.set_timeout(30);
+
+    std::vector<rpc::future> pipeline(st->depth);
+    uint64_t calls = 0;
+    uint64_t errors = 0;
+
+    while(clock_type::now() < st->deadline) {
+        for(size_t i=0; i < st->depth; ++i) {
+            clock_type::time_point sent = clock_type::now();
+            pipeline[i] = s.call("echo_huge", st->payload);
+            pipeline[i].attach_callback(std::bind(&record_latency,
+                        st->latency, sent, std::placeholders::_1));
+        }
+        rpc::when_all(pipeline.begin(), pipeline.end()).wait(false);
+
+        for(size_t i=0; i < st->depth; ++i) {
+            try {
+                raw_ref result = pipeline[i].get<raw_ref>();
+                if(result.size != st->payload.size) {
+                    ++errors;
+                }
+            } catch (std::exception& e) {
+                ++errors;
+            }
+        }
+        calls += st->depth;
+    }
+
+    boost::mutex::scoped_lock lk(st->mutex);
+    st->calls += calls;
+    st->errors += errors;
+}
+
+static e2e_result run_cell(const e2e_cell& cell, unsigned short port, double seconds)
+{
+    reset_peak_rss();
+
+    std::unique_ptr<rpc::builder> builder;
+    std::unique_ptr<rpc::listener> listener;
+    if(cell.transport == "udp") {
+        builder.reset(new rpc::udp_builder());
+        listener.reset(new rpc::udp_listener(rpc::address("0.0.0.0", port)));
+    } else {
+        builder.reset(new rpc::tcp_builder());
+        listener.reset(new rpc::tcp_listener(rpc::address("0.0.0.0", port)));
+    }
+
+    rpc::server svr(*builder);
+    svr.serve(std::shared_ptr<rpc::dispatcher>(new myecho()));
+    svr.listen(*listener);
+    svr.start(cell.workers);
+
+    rpc::session_pool sp(*builder);
+    sp.start(cell.workers);
+
+    std::vector<char> data(cell.size, 'x');
+    rpc::latency_recorder latency;
+
+    client_state st;
+    st.sp = &sp;
+    st.addr = rpc::address("127.0.0.1", port);
+    st.payload = raw_ref(data.empty() ? NULL : &data[0], (uint32_t)data.size());
+    st.depth = cell.depth;
+    st.latency = &latency;
+    st.calls = 0;
+    st.errors = 0;
+
+    double cpu_start = cpu_seconds();
+    clock_type::time_point start = clock_type::now();
+    st.deadline = start + std::chrono::duration_cast<clock_type::duration>(
+            std::chrono::duration<double>(seconds));
+
+    boost::thread_group clients;
+    for(size_t i=0; i < cell.threads; ++i) {
+        clients.create_thread(std::bind(&client_main, &st));
+    }
+    clients.join_all();
+
+    double elapsed = std::chrono::duration<double>(clock_type::now() - start).count();
+    double cpu = cpu_seconds() - cpu_start;
+
+    sp.end();
+    sp.join();
+    svr.end();
+    svr.join();
+
+    rpc::latency_histogram h;
+    rpc::latency_stats stats = latency.snapshot();
+    for(rpc::latency_stats::const_iterator it = stats.begin(); it != stats.end(); ++it) {
+        h.merge(it->second);
+    }
+
+    e2e_result r;
+    r.cell = cell;
+    r.calls = st.calls;
+    r.errors = st.errors;
+    r.seconds = elapsed;
+    r.calls_per_sec = st.calls / elapsed;
+    r.mbytes_per_sec = r.calls_per_sec * cell.size / (1024 * 1024);
+    r.p50 = h.percentile(50);
+    r.p90 = h.percentile(90);
+    r.p99 = h.percentile(99);
+    r.p999 = h.percentile(99.9);
+    r.max = h.max();
+    r.cpu_usec_per_call = st.calls ? cpu * 1e6 / st.calls : 0;
+    r.peak_rss_kb = peak_rss_kb();
+    return r;
+}
+
+static void write_json(std::ostream& os, const std::vector<e2e_result>& results)
+{
+    char date[64];
+    std::time_t now = std::time(NULL);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+    os << "{\n"
+        << "  \"context\": {\n"
+        << "    \"date\": \"" << date << "\",\n"
+        << "    \"num_cpus\": " << boost::thread::hardware_concurrency() << "\n"
+        << "  },\n"
+        << "  \"results\": [\n";
+    for(size_t i=0; i < results.size(); ++i) {
+        const e2e_result& r = results[i];
+        os << "    {"
+            << "\"name\": \"" << r.cell.key() << "\", "
+            << "\"transport\": \"" << r.cell.transport << "\", "
+            << "\"workers\": " << r.cell.workers << ", "
+            << "\"threads\": " << r.cell.threads << ", "
+            << "\"depth\": " << r.cell.depth << ", "
+            << "\"size\": " << r.cell.size << ", "
+            << "\"calls\": " << r.calls << ", "
+            << "\"errors\": " << r.errors << ", "
+            << "\"seconds\": " << r.seconds << ", "
+            << "\"calls_per_sec\": " << r.calls_per_sec << ", "
+            << "\"mbytes_per_sec\": " << r.mbytes_per_sec << ", "
+            << "\"p50_usec\": " << r.p50 << ", "
+            << "\"p90_usec\": " << r.p90 << ", "
+            << "\"p99_usec\": " << r.p99 << ", "
+            << "\"p999_usec\": " << r.p999 << ", "
+            << "\"max_usec\": " << r.max << ", "
+            << "\"cpu_usec_per_call\": " << r.cpu_usec_per_call << ", "
+            << "\"peak_rss_kb\": " << r.peak_rss_kb
+            << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    os << "  ]\n}" << std::endl;
+}
+
+// Reads back what write_json() wrote: each result is one line holding a
+// flat object, keyed by its "name".
+typedef std::map<std::string, double> json_fields;
+
+static std::map<std::string, json_fields> read_baseline(const std::string& path)
+{
+    std::map<std::string, json_fields> cells;
+    std::ifstream in(path.c_str());
+    if(!in) {
+        throw std::runtime_error("can't open baseline: " + path);
+    }
+
+    std::string line;
+    while(std::getline(in, line)) {
+        size_t pos = line.find("{\"name\": \"");
+        if(pos == std::string::npos) {
+            continue;
+        }
+        pos += 10;
+        size_t end = line.find('"', pos);
+        std::string name = line.substr(pos, end - pos);
+
+        json_fields& fields = cells[name];
+        for(pos = line.find(", \"", end); pos != std::string::npos;
+                pos = line.find(", \"", pos + 1)) {
+            size_t kbegin = pos + 3;
+            size_t kend = line.find('"', kbegin);
+            if(kend == std::string::npos || line.compare(kend, 3, "\": ") != 0) {
+                continue;
+            }
+            const char* value = line.c_str() + kend + 3;
+            if(*value == '"') {
+                continue;  // strings are part of the name already
+            }
+            fields[line.substr(kbegin, kend - kbegin)] = atof(value);
+        }
+    }
+    return cells;
+}
+
+// returns the number of regressions
+static size_t compare(const std::vector<e2e_result>& results,
+        const std::map<std::string, json_fields>& baseline, double threshold)
+{
+    size_t regressions = 0;
+    std::cerr << "compare against baseline, threshold " << threshold * 100 << "%" << std::endl;
+
+    for(size_t i=0; i < results.size(); ++i) {
+        const e2e_result& r = results[i];
+        std::map<std::string, json_fields>::const_iterator it = baseline.find(r.cell.key());
+        if(it == baseline.end()) {
+            std::cerr << "  " << r.cell.key() << " : not in baseline" << std::endl;
+            continue;
+        }
+        json_fields base = it->second;
+
+        struct {
+            const char* field;
+            double now;
+            bool higher_is_better;
+        } checks[] = {
+            { "calls_per_sec",     r.calls_per_sec,     true },
+            { "p99_usec",          (double)r.p99,       false },
+            { "cpu_usec_per_call", r.cpu_usec_per_call, false },
+        };
+
+        for(size_t c=0; c < sizeof(checks) / sizeof(checks[0]); ++c) {
+            double was = base[checks[c].field];
+            if(was <= 0) {
+                continue;
+            }
+            double change = (checks[c].now - was) / was;
+            bool worse = checks[c].higher_is_better ? change < -threshold : change > threshold;
+            if(worse) {
+                ++regressions;
+            }
+            std::cerr << (worse ? "! " : "  ") << r.cell.key() << " " << checks[c].field
+                << " : " << was << " -> " << checks[c].now
+                << " (" << (change >= 0 ? "+" : "") << change * 100 << "%)"
+                << std::endl;
+        }
+    }
+    return regressions;
+}
+
+static std::vector<size_t> parse_list(const std::string& value)
+{
+    std::vector<size_t> list;
+    std::istringstream is(value);
+    std::string item;
+    while(std::getline(is, item, ',')) {
+        list.push_back(strtoul(item.c_str(), NULL, 10));
+    }
+    return list;
+}
+
+static std::vector<std::string> parse_names(const std::string& value)
+{
+    std::vector<std::string> list;
+    std::istringstream is(value);
+    std::string item;
+    while(std::getline(is, item, ',')) {
+        list.push_back(item);
+    }
+    return list;
+}
+
+static bool parse_option(const char* arg, const char* name, std::string* value)
+{
+    size_t len = strlen(name);
+    if(strncmp(arg, name, len) != 0 || arg[len] != '=') {
+        return false;
+    }
+    *value = arg + len + 1;
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    boost::log::core::get()->set_filter(boost::log::trivial::severity >= boost::log::trivial::error);
+    signal(SIGPIPE, SIG_IGN);
+
+    std::vector<std::string> transports = parse_names("tcp,udp");
+    std::vector<size_t> workers = parse_list("1,4");
+    std::vector<size_t> threads = parse_list("1,8");
+    std::vector<size_t> depths = parse_list("1,16");
+    std::vector<size_t> sizes = parse_list("16,1024,65536,1048576");
+    double seconds = 1.0;
+    unsigned short port = 18820;
+    std::string out;
+    std::string baseline;
+    double threshold = 0.10;
+
+    for(int i=1; i < argc; ++i) {
+        std::string value;
+        if(parse_option(argv[i], "--transport", &value)) {
+            transports = parse_names(value);
+        } else if(parse_option(argv[i], "--workers", &value)) {
+            workers = parse_list(value);
+        } else if(parse_option(argv[i], "--threads", &value)) {
+            threads = parse_list(value);
+        } else if(parse_option(argv[i], "--depth", &value)) {
+            depths = parse_list(value);
+        } else if(parse_option(argv[i], "--size", &value)) {
+            sizes = parse_list(value);
+        } else if(parse_option(argv[i], "--seconds", &value)) {
+            seconds = atof(value.c_str());
+        } else if(parse_option(argv[i], "--port", &value)) {
+            port = (unsigned short)atoi(value.c_str());
+        } else if(parse_option(argv[i], "--out", &value)) {
+            out = value;
+        } else if(parse_option(argv[i], "--compare", &value)) {
+            baseline = value;
+        } else if(parse_option(argv[i], "--threshold", &value)) {
+            threshold = atof(value.c_str());
+        } else {
+            std::cerr << "usage: " << argv[0]
+                << " [--transport=tcp,udp] [--workers=N,...] [--threads=N,...]"
+                << " [--depth=N,...] [--size=BYTES,...] [--seconds=S] [--port=P]"
+                << " [--out=FILE] [--compare=BASELINE] [--threshold=0.10]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<e2e_cell> matrix;
+    for(size_t t=0; t < transports.size(); ++t) {
+        for(size_t w=0; w < workers.size(); ++w) {
+            for(size_t c=0; c < threads.size(); ++c) {
+                for(size_t d=0; d < depths.size(); ++d) {
+                    for(size_t s=0; s < sizes.size(); ++s) {
+                        e2e_cell cell;
+                        cell.transport = transports[t];
+                        cell.workers = workers[w];
+                        cell.threads = threads[c];
+                        cell.depth = depths[d];
+                        cell.size = sizes[s];
+                        matrix.push_back(cell);
+                    }
+                }
+            }
+        }
+    }
+
+    std::vector<e2e_result> results;
+    for(size_t i=0; i < matrix.size(); ++i) {
+        const e2e_cell& cell = matrix[i];
+        if(cell.transport == "udp" && cell.size > UDP_MAX_SIZE) {
+            std::cerr << cell.key() << " : skipped, too large for a datagram" << std::endl;
+            continue;
+        }
+
+        // a fresh port for every cell, so no cell waits on the last one's sockets
+        e2e_result r = run_cell(cell, port++, seconds);
+        std::cerr << cell.key() << " : " << (uint64_t)r.calls_per_sec << " calls/s"
+            << " p50 " << r.p50 << " p99 " << r.p99 << " usec"
+            << " cpu " << r.cpu_usec_per_call << " usec/call" << std::endl;
+        results.push_back(r);
+    }
+
+    if(out.empty()) {
+        write_json(std::cout, results);
+    } else {
+        std::ofstream os(out.c_str());
+        write_json(os, results);
+    }
+
+    if(!baseline.empty()) {
+        size_t regressions = compare(results, read_baseline(baseline), threshold);
+        if(regressions) {
+            std::cerr << regressions << " regressions" << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,252 @@
+//
+// msgpack::rpc microbenchmarks - MessagePack-RPC for C++
+//
+// Copyright (C) 2009-2010 FURUHASHI Sadayuki
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+#include "bench.h"
+
+#include <algorithm>
+#include <boost/log/core.hpp>
+#include <boost/log/expressions.hpp>
+#include <boost/log/trivial.hpp>
+#include <boost/thread.hpp>
+#include <chrono>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// usage: mprpc_bench [--format=console|json|csv] [--filter=SUBSTRING]
+//                    [--min-time=SECONDS]
+//
+// --format=json writes the same layout as Google Benchmark, so its
+// tools/compare.py can diff two runs.
+
+struct bench_case {
+    std::string name;
+    bench_func func;
+    size_t threads;
+};
+
+struct bench_result {
+    std::string name;
+    size_t threads;
+    uint64_t iterations;
+    double real_ns;  // per iteration
+    double cpu_ns;   // per iteration, all threads
+};
+
+static std::vector<bench_case>& registry()
+{
+    static std::vector<bench_case> cases;
+    return cases;
+}
+
+int bench_register(const char* name, bench_func func, size_t threads)
+{
+    bench_case c;
+    c.name = name;
+    c.func = func;
+    c.threads = threads;
+    registry().push_back(c);
+    return 0;
+}
+
+typedef std::chrono::steady_clock clock_type;
+
+static void thread_main(bench_func func, uint64_t iterations,
+        size_t threads, size_t index, boost::barrier* start)
+{
+    bench_state st(iterations, threads, index);
+    start->wait();
+    func(st);
+}
+
+// returns the wall time of one run in seconds
+static double run_once(const bench_case& c, uint64_t iterations, double* cpu_sec)
+{
+    std::clock_t cpu_start;
+    clock_type::time_point start;
+
+    if (c.threads <= 1) {
+        bench_state st(iterations, 1, 0);
+        cpu_start = std::clock();
+        start = clock_type::now();
+        c.func(st);
+    } else {
+        boost::barrier barrier(c.threads + 1);
+        boost::thread_group group;
+        for (size_t i = 0; i < c.threads; ++i) {
+            group.create_thread(std::bind(&thread_main,
+                        c.func, iterations, c.threads, i, &barrier));
+        }
+        cpu_start = std::clock();
+        start = clock_type::now();
+        barrier.wait();
+        group.join_all();
+    }
+
+    *cpu_sec = (double)(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+    return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+static bench_result run(const bench_case& c, double min_time)
+{
+    uint64_t iterations = 1;
+    double elapsed = 0;
+    double cpu = 0;
+
+    while (true) {
+        elapsed = run_once(c, iterations, &cpu);
+        if (elapsed >= min_time || iterations >= 1000000000ULL) {
+            break;
+        }
+        // aim a bit past min_time, growing at most 10x per step
+        double mult = min_time * 1.4 / std::max(elapsed, 1e-9);
+        uint64_t next = (uint64_t)(iterations * std::min(mult, 10.0));
+        iterations = std::max(next, iterations + 1);
+    }
+
+    bench_result r;
+    r.name = c.name;
+    r.threads = c.threads;
+    r.iterations = iterations;
+    r.real_ns = elapsed * 1e9 / iterations;
+    r.cpu_ns = cpu * 1e9 / iterations;
+    return r;
+}
+
+static void print_console_header()
+{
+    std::cout << std::left << std::setw(44) << "benchmark"
+        << std::right << std::setw(14) << "time/op"
+        << std::setw(14) << "cpu/op"
+        << std::setw(14) << "iterations" << "\n"
+        << std::string(86, '-') << std::endl;
+}
+
+static void print_console(const bench_result& r)
+{
+    std::cout << std::left << std::setw(44) << r.name
+        << std::right << std::fixed << std::setprecision(1)
+        << std::setw(11) << r.real_ns << " ns"
+        << std::setw(11) << r.cpu_ns << " ns"
+        << std::setw(14) << r.iterations << std::endl;
+}
+
+static void print_csv(const std::vector<bench_result>& results)
+{
+    std::cout << "name,iterations,real_time,cpu_time,time_unit,threads\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const bench_result& r = results[i];
+        std::cout << '"' << r.name << "\"," << r.iterations << ","
+            << r.real_ns << "," << r.cpu_ns << ",ns," << r.threads << "\n";
+    }
+}
+
+static void print_json(const std::vector<bench_result>& results)
+{
+    char date[64];
+    std::time_t now = std::time(NULL);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+
+    std::cout << "{\n"
+        << "  \"context\": {\n"
+        << "    \"date\": \"" << date << "\",\n"
+        << "    \"executable\": \"mprpc_bench\",\n"
+        << "    \"num_cpus\": " << boost::thread::hardware_concurrency() << "\n"
+        << "  },\n"
+        << "  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const bench_result& r = results[i];
+        std::cout << "    {\n"
+            << "      \"name\": \"" << r.name << "\",\n"
+            << "      \"run_name\": \"" << r.name << "\",\n"
+            << "      \"run_type\": \"iteration\",\n"
+            << "      \"iterations\": " << r.iterations << ",\n"
+            << "      \"real_time\": " << r.real_ns << ",\n"
+            << "      \"cpu_time\": " << r.cpu_ns << ",\n"
+            << "      \"time_unit\": \"ns\",\n"
+            << "      \"threads\": " << r.threads << "\n"
+            << "    }" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    std::cout << "  ]\n}" << std::endl;
+}
+
+static bool parse_option(const char* arg, const char* name, std::string* value)
+{
+    size_t len = strlen(name);
+    if (strncmp(arg, name, len) != 0 || arg[len] != '=') {
+        return false;
+    }
+    *value = arg + len + 1;
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    boost::log::core::get()->set_filter(boost::log::trivial::severity >= boost::log::trivial::error);
+
+    std::string format = "console";
+    std::string filter;
+    double min_time = 0.5;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string value;
+        if (parse_option(argv[i], "--format", &value)) {
+            format = value;
+        } else if (parse_option(argv[i], "--filter", &value)) {
+            filter = value;
+        } else if (parse_option(argv[i], "--min-time", &value)) {
+            min_time = atof(value.c_str());
+        } else {
+            std::cerr << "usage: " << argv[0]
+                << " [--format=console|json|csv] [--filter=SUBSTRING]"
+                << " [--min-time=SECONDS]" << std::endl;
+            return 1;
+        }
+    }
+    if (format != "console" && format != "json" && format != "csv") {
+        std::cerr << "unknown format: " << format << std::endl;
+        return 1;
+    }
+
+    if (format == "console") {
+        print_console_header();
+    }
+
+    std::vector<bench_result> results;
+    const std::vector<bench_case>& cases = registry();
+    for (size_t i = 0; i < cases.size(); ++i) {
+        if (!filter.empty() && cases[i].name.find(filter) == std::string::npos) {
+            continue;
+        }
+        results.push_back(run(cases[i], min_time));
+        if (format == "console") {
+            print_console(results.back());
+        }
+    }
+
+    if (format == "json") {
+        print_json(results);
+    } else if (format == "csv") {
+        print_csv(results);
+    }
+    return 0;
+}
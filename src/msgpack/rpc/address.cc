@@ -17,6 +17,7 @@
 //
 #include <boost/asio.hpp>
 #include <boost/asio/ip/address.hpp>
+#include <boost/functional/hash.hpp>
 #include <boost/lexical_cast.hpp>
 #include "address.h"
 
@@ -103,6 +104,19 @@ bool operator<(const address& a1, const address& a2)
     return a1.m_address < a2.m_address;
 }
 
+std::size_t hash_value(const address& a)
+{
+    std::size_t seed = 0;
+    if (a.m_address.is_v4()) {
+        boost::hash_combine(seed, a.m_address.to_v4().to_ulong());
+    } else {
+        boost::asio::ip::address_v6::bytes_type b = a.m_address.to_v6().to_bytes();
+        boost::hash_range(seed, b.begin(), b.end());
+    }
+    boost::hash_combine(seed, a.m_port);
+    return seed;
+}
+
 std::ostream& operator<< (std::ostream& s, const address& a)
 {
     if (a.is_v4()) {
@@ -40,6 +40,8 @@ public:
 
 	friend bool operator==(const address& a1, const address& a2);
 	friend bool operator<(const address& a1, const address& a2);
+    // for boost::hash
+    friend std::size_t hash_value(const address& a);
 
 private:
     boost::asio::ip::address m_address;
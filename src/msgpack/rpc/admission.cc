@@ -0,0 +1,82 @@
+//
+// msgpack::rpc::admission - MessagePack-RPC for C++
+//
+// Copyright (C) 2009-2010 FURUHASHI Sadayuki
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+#include "admission.h"
+
+namespace msgpack {
+namespace rpc {
+
+
+admission_controller::admission_controller() :
+    m_target(clock::duration::zero()),
+    m_interval(clock::duration::zero()),
+    m_first_above(),
+    m_dropping(false),
+    m_shed(0)
+{
+}
+
+void admission_controller::set_target(unsigned int target_ms, unsigned int interval_ms)
+{
+    boost::mutex::scoped_lock lk(m_mutex);
+    m_target = std::chrono::milliseconds(target_ms);
+    m_interval = std::chrono::milliseconds(interval_ms);
+    m_first_above = clock::time_point();
+    m_dropping = false;
+}
+
+bool admission_controller::admit(clock::time_point received)
+{
+    clock::time_point now = clock::now();
+    clock::duration delay = now - received;
+
+    boost::mutex::scoped_lock lk(m_mutex);
+    if (m_target == clock::duration::zero()) {
+        return true;
+    }
+
+    if (delay < m_target) {
+        // the queue drained; leave the dropping state
+        m_first_above = clock::time_point();
+        m_dropping = false;
+        return true;
+    }
+
+    if (!m_dropping) {
+        if (m_first_above == clock::time_point()) {
+            m_first_above = now + m_interval;
+            return true;
+        }
+        if (now < m_first_above) {
+            return true;
+        }
+        m_dropping = true;
+    }
+
+    ++m_shed;
+    return false;
+}
+
+uint64_t admission_controller::shed_count() const
+{
+    boost::mutex::scoped_lock lk(m_mutex);
+    return m_shed;
+}
+
+
+}  // namespace rpc
+}  // namespace msgpack
@@ -0,0 +1,68 @@
+//
+// msgpack::rpc::admission - MessagePack-RPC for C++
+//
+// Copyright (C) 2009-2010 FURUHASHI Sadayuki
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+#ifndef MSGPACK_RPC_ADMISSION_H__
+#define MSGPACK_RPC_ADMISSION_H__
+
+#include <boost/thread.hpp>
+#include <chrono>
+#include <stdint.h>
+
+namespace msgpack {
+namespace rpc {
+
+
+// Decides whether a request is dispatched or shed, based on how long it
+// waited between being read off the wire and reaching dispatch.
+//
+// Follows CoDel: a queueing delay above the target is tolerated for one
+// interval. If it stays above the target that long, requests are shed until
+// one arrives with a delay below the target again.
+class admission_controller
+{
+public:
+    typedef std::chrono::steady_clock clock;
+
+    admission_controller();
+    ~admission_controller() { }
+
+public:
+    // a target of 0 disables shedding
+    void set_target(unsigned int target_ms, unsigned int interval_ms);
+
+    bool admit(clock::time_point received);
+
+    uint64_t shed_count() const;
+
+private:
+    clock::duration m_target;
+    clock::duration m_interval;
+    clock::time_point m_first_above;
+    bool m_dropping;
+    uint64_t m_shed;
+
+    mutable boost::mutex m_mutex;
+
+private:
+    admission_controller(const admission_controller&);
+};
+
+
+}  // namespace rpc
+}  // namespace msgpack
+
+#endif /* msgpack/rpc/admission.h */
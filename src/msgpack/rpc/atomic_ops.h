@@ -6,6 +6,8 @@
 ///   atomic_int_type i = 42;
 ///   atomic_int_type j = atomic_increment(&i);
 ///   assert(i==43 && j==42);
+///   j = atomic_decrement(&i);
+///   assert(i==42 && j==43);
 
 #if defined(__GNUC__) && ((__GNUC__*10 + __GNUC_MINOR__) < 41)
 #  include <bits/atomicity.h>
@@ -33,6 +35,12 @@ atomic_int_type atomic_increment(volatile atomic_int_type* p)
   return __sync_fetch_and_add(p, 1);
 }
 
+static inline
+atomic_int_type atomic_decrement(volatile atomic_int_type* p)
+{
+  return __sync_fetch_and_sub(p, 1);
+}
+
 #elif defined(_WIN32) // use 'InterlockedIncrement' function
 typedef LONG atomic_int_type;
 
@@ -42,6 +50,12 @@ atomic_int_type atomic_increment(volatile atomic_int_type* p)
   return InterlockedIncrement(p) - 1;
 }
 
+static inline
+atomic_int_type atomic_decrement(volatile atomic_int_type* p)
+{
+  return InterlockedDecrement(p) + 1;
+}
+
 #else
 
 typedef boost::uint32_t atomic_int_type;
@@ -52,6 +66,12 @@ atomic_int_type atomic_increment(volatile atomic_int_type* p)
   return boost::interprocess::detail::atomic_inc32(p);
 }
 
+static inline
+atomic_int_type atomic_decrement(volatile atomic_int_type* p)
+{
+  return boost::interprocess::detail::atomic_dec32(p);
+}
+
 #endif
 
 } // namespace rpc {
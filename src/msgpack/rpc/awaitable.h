@@ -0,0 +1,114 @@
+//
+// msgpack::rpc::awaitable - MessagePack-RPC for C++
+//
+// Copyright (C) 2010 FURUHASHI Sadayuki
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+#ifndef MSGPACK_RPC_AWAITABLE_H__
+#define MSGPACK_RPC_AWAITABLE_H__
+
+#if !defined(__cpp_impl_coroutine)
+#error "msgpack/rpc/awaitable.h requires C++20 coroutine support"
+#endif
+
+#include "future.h"
+#include "log.h"
+#include "loop.h"
+
+#include <coroutine>
+#include <exception>
+
+namespace msgpack {
+namespace rpc {
+
+
+/**
+ * Lets a coroutine wait for a future without blocking a thread.
+ *
+ * <pre><code>
+ * rpc::detached add(rpc::session s) {
+ *     rpc::future f = co_await s.call("add", 1, 2);
+ *     int result = f.get<int>();  // ready, does not block
+ * }
+ * </code></pre>
+ *
+ * The coroutine is suspended through attach_callback() and resumed by a
+ * task submitted to a loop: the session's own loop for 'co_await f', or
+ * any loop with 'co_await resume_on(f, lo)'.
+ */
+class future_awaiter {
+public:
+    future_awaiter(future f, loop lo) : m_future(f), m_loop(lo) { }
+
+    bool await_ready() const
+    {
+        return m_future.is_ready();
+    }
+
+    void await_suspend(std::coroutine_handle<> h)
+    {
+        loop lo = m_loop;
+        m_future.attach_callback([h, lo](future) {
+            lo->submit([h]() { h.resume(); });
+        });
+    }
+
+    future await_resume()
+    {
+        return m_future;
+    }
+
+private:
+    future m_future;
+    loop m_loop;
+};
+
+inline future_awaiter resume_on(future f, loop lo)
+{
+    return future_awaiter(f, lo);
+}
+
+inline future_awaiter operator co_await(future f)
+{
+    return future_awaiter(f, f.get_loop());
+}
+
+
+/// Return type for fire-and-forget coroutines. The coroutine starts
+/// running immediately and frees itself when it finishes.
+struct detached {
+    struct promise_type {
+        detached get_return_object() noexcept { return detached(); }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept { }
+
+        void unhandled_exception() noexcept
+        {
+            try {
+                throw;
+            } catch (std::exception& e) {
+                MSGPACK_RPC_LOG(warning) << "coroutine error: " << e.what();
+            } catch (...) {
+                MSGPACK_RPC_LOG(warning) << "coroutine error: unknown error";
+            }
+        }
+    };
+};
+
+
+}  // namespace rpc
+}  // namespace msgpack
+
+#endif /* msgpack/rpc/awaitable.h */
@@ -50,7 +50,7 @@ public:
 			const A1& a1)
 	{
 		std::tuple<const A1&> params(a1);
-		shared_zone  slife(msglife.release());
+		shared_zone  slife(std::move(msglife));
 		return static_cast<IMPL*>(this)->send_request(
 				name, params, slife);
 	}
@@ -60,7 +60,7 @@ public:
 			const A1& a1, const A2& a2)
 	{
 		std::tuple<const A1&, const A2&> params(a1, a2);
-		shared_zone  slife(msglife.release());
+		shared_zone  slife(std::move(msglife));
 		return static_cast<IMPL*>(this)->send_request(
 				name, params, slife);
 	}
@@ -70,7 +70,7 @@ public:
 			const A1& a1, const A2& a2, const A3& a3)
 	{
 		std::tuple<const A1&, const A2&, const A3&> params(a1, a2, a3);
-		shared_zone  slife(msglife.release());
+		shared_zone  slife(std::move(msglife));
 		return static_cast<IMPL*>(this)->send_request(
 				name, params, slife);
 	}
@@ -80,7 +80,7 @@ public:
 			const A1& a1, const A2& a2, const A3& a3, const A4& a4)
 	{
 		std::tuple<const A1&, const A2&, const A3&, const A4&> params(a1, a2, a3, a4);
-		shared_zone  slife(msglife.release());
+		shared_zone  slife(std::move(msglife));
 		return static_cast<IMPL*>(this)->send_request(
 				name, params, slife);
 	}
@@ -90,7 +90,7 @@ public:
 			const A1& a1, const A2& a2, const A3& a3, const A4& a4, const A5& a5)
 	{
 		std::tuple<const A1&, const A2&, const A3&, const A4&, const A5&> params(a1, a2, a3, a4, a5);
-		shared_zone  slife(msglife.release());
+		shared_zone  slife(std::move(msglife));
 		return static_cast<IMPL*>(this)->send_request(
 				name, params, slife);
 	}
@@ -100,7 +100,7 @@ public:
 			const A1& a1, const A2& a2, const A3& a3, const A4& a4, const A5& a5, const A6& a6)
 	{
 		std::tuple<const A1&, const A2&, const A3&, const A4&, const A5&, const A6&> params(a1, a2, a3, a4, a5, a6);
-		shared_zone  slife(msglife.release());
+		shared_zone  slife(std::move(msglife));
 		return static_cast<IMPL*>(this)->send_request(
 				name, params, slife);
 	}
@@ -110,7 +110,7 @@ public:
 			const A1& a1, const A2& a2, const A3& a3, const A4& a4, const A5& a5, const A6& a6, const A7& a7)
 	{
 		std::tuple<const A1&, const A2&, const A3&, const A4&, const A5&, const A6&, const A7&> params(a1, a2, a3, a4, a5, a6, a7);
-		shared_zone  slife(msglife.release());
+		shared_zone  slife(std::move(msglife));
 		return static_cast<IMPL*>(this)->send_request(
 				name, params, slife);
 	}
@@ -120,7 +120,7 @@ public:
 			const A1& a1, const A2& a2, const A3& a3, const A4& a4, const A5& a5, const A6& a6, const A7& a7, const A8& a8)
 	{
 		std::tuple<const A1&, const A2&, const A3&, const A4&, const A5&, const A6&, const A7&, const A8&> params(a1, a2, a3, a4, a5, a6, a7, a8);
-		shared_zone  slife(msglife.release());
+		shared_zone  slife(std::move(msglife));
 		return static_cast<IMPL*>(this)->send_request(
 				name, params, slife);
 	}
@@ -130,7 +130,7 @@ public:
 			const A1& a1, const A2& a2, const A3& a3, const A4& a4, const A5& a5, const A6& a6, const A7& a7, const A8& a8, const A9& a9)
 	{
 		std::tuple<const A1&, const A2&, const A3&, const A4&, const A5&, const A6&, const A7&, const A8&, const A9&> params(a1, a2, a3, a4, a5, a6, a7, a8, a9);
-		shared_zone  slife(msglife.release());
+		shared_zone  slife(std::move(msglife));
 		return static_cast<IMPL*>(this)->send_request(
 				name, params, slife);
 	}
@@ -140,7 +140,7 @@ public:
 			const A1& a1, const A2& a2, const A3& a3, const A4& a4, const A5& a5, const A6& a6, const A7& a7, const A8& a8, const A9& a9, const A10& a10)
 	{
 		std::tuple<const A1&, const A2&, const A3&, const A4&, const A5&, const A6&, const A7&, const A8&, const A9&, const A10&> params(a1, a2, a3, a4, a5, a6, a7, a8, a9, a10);
-		shared_zone  slife(msglife.release());
+		shared_zone  slife(std::move(msglife));
 		return static_cast<IMPL*>(this)->send_request(
 				name, params, slife);
 	}
@@ -150,7 +150,7 @@ public:
 			const A1& a1, const A2& a2, const A3& a3, const A4& a4, const A5& a5, const A6& a6, const A7& a7, const A8& a8, const A9& a9, const A10& a10, const A11& a11)
 	{
 		std::tuple<const A1&, const A2&, const A3&, const A4&, const A5&, const A6&, const A7&, const A8&, const A9&, const A10&, const A11&> params(a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11);
-		shared_zone  slife(msglife.release());
+		shared_zone  slife(std::move(msglife));
 		return static_cast<IMPL*>(this)->send_request(
 				name, params, slife);
 	}
@@ -160,7 +160,7 @@ public:
 			const A1& a1, const A2& a2, const A3& a3, const A4& a4, const A5& a5, const A6& a6, const A7& a7, const A8& a8, const A9& a9, const A10& a10, const A11& a11, const A12& a12)
 	{
 		std::tuple<const A1&, const A2&, const A3&, const A4&, const A5&, const A6&, const A7&, const A8&, const A9&, const A10&, const A11&, const A12&> params(a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12);
-		shared_zone  slife(msglife.release());
+		shared_zone  slife(std::move(msglife));
 		return static_cast<IMPL*>(this)->send_request(
 				name, params, slife);
 	}
@@ -170,7 +170,7 @@ public:
 			const A1& a1, const A2& a2, const A3& a3, const A4& a4, const A5& a5, const A6& a6, const A7& a7, const A8& a8, const A9& a9, const A10& a10, const A11& a11, const A12& a12, const A13& a13)
 	{
 		std::tuple<const A1&, const A2&, const A3&, const A4&, const A5&, const A6&, const A7&, const A8&, const A9&, const A10&, const A11&, const A12&, const A13&> params(a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13);
-		shared_zone  slife(msglife.release());
+		shared_zone  slife(std::move(msglife));
 		return static_cast<IMPL*>(this)->send_request(
 				name, params, slife);
 	}
@@ -180,7 +180,7 @@ public:
 			const A1& a1, const A2& a2, const A3& a3, const A4& a4, const A5& a5, const A6& a6, const A7& a7, const A8& a8, const A9& a9, const A10& a10, const A11& a11, const A12& a12, const A13& a13, const A14& a14)
 	{
 		std::tuple<const A1&, const A2&, const A3&, const A4&, const A5&, const A6&, const A7&, const A8&, const A9&, const A10&, const A11&, const A12&, const A13&, const A14&> params(a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14);
-		shared_zone  slife(msglife.release());
+		shared_zone  slife(std::move(msglife));
 		return static_cast<IMPL*>(this)->send_request(
 				name, params, slife);
 	}
@@ -190,7 +190,7 @@ public:
 			const A1& a1, const A2& a2, const A3& a3, const A4& a4, const A5& a5, const A6& a6, const A7& a7, const A8& a8, const A9& a9, const A10& a10, const A11& a11, const A12& a12, const A13& a13, const A14& a14, const A15& a15)
 	{
 		std::tuple<const A1&, const A2&, const A3&, const A4&, const A5&, const A6&, const A7&, const A8&, const A9&, const A10&, const A11&, const A12&, const A13&, const A14&, const A15&> params(a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14, a15);
-		shared_zone  slife(msglife.release());
+		shared_zone  slife(std::move(msglife));
 		return static_cast<IMPL*>(this)->send_request(
 				name, params, slife);
 	}
@@ -200,7 +200,7 @@ public:
 			const A1& a1, const A2& a2, const A3& a3, const A4& a4, const A5& a5, const A6& a6, const A7& a7, const A8& a8, const A9& a9, const A10& a10, const A11& a11, const A12& a12, const A13& a13, const A14& a14, const A15& a15, const A16& a16)
 	{
 		std::tuple<const A1&, const A2&, const A3&, const A4&, const A5&, const A6&, const A7&, const A8&, const A9&, const A10&, const A11&, const A12&, const A13&, const A14&, const A15&, const A16&> params(a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14, a15, a16);
-		shared_zone  slife(msglife.release());
+		shared_zone  slife(std::move(msglife));
 		return static_cast<IMPL*>(this)->send_request(
 				name, params, slife);
 	}
@@ -513,7 +513,7 @@ public:
 			auto_zone msglife,
 			const ArgArray& params)
 	{
-		shared_zone  slife(msglife.release());
+		shared_zone  slife(std::move(msglife));
 		return static_cast<IMPL*>(this)->send_request(
 				name, params, slife);
 	}
@@ -547,7 +547,7 @@ public:
 			const A1& a1)
 	{
 		std::tuple<const A1&> params(a1);
-		shared_zone  slife(msglife.release());
+		shared_zone  slife(std::move(msglife));
 		return static_cast<IMPL*>(this)->send_notify(
 				name, params, slife);
 	}
@@ -557,7 +557,7 @@ public:
 			const A1& a1, const A2& a2)
 	{
 		std::tuple<const A1&, const A2&> params(a1, a2);
-		shared_zone  slife(msglife.release());
+		shared_zone  slife(std::move(msglife));
 		return static_cast<IMPL*>(this)->send_notify(
 				name, params, slife);
 	}
@@ -567,7 +567,7 @@ public:
 			const A1& a1, const A2& a2, const A3& a3)
 	{
 		std::tuple<const A1&, const A2&, const A3&> params(a1, a2, a3);
-		shared_zone  slife(msglife.release());
+		shared_zone  slife(std::move(msglife));
 		return static_cast<IMPL*>(this)->send_notify(
 				name, params, slife);
 	}
@@ -577,7 +577,7 @@ public:
 			const A1& a1, const A2& a2, const A3& a3, const A4& a4)
 	{
 		std::tuple<const A1&, const A2&, const A3&, const A4&> params(a1, a2, a3, a4);
-		shared_zone  slife(msglife.release());
+		shared_zone  slife(std::move(msglife));
 		return static_cast<IMPL*>(this)->send_notify(
 				name, params, slife);
 	}
@@ -587,7 +587,7 @@ public:
 			const A1& a1, const A2& a2, const A3& a3, const A4& a4, const A5& a5)
 	{
 		std::tuple<const A1&, const A2&, const A3&, const A4&, const A5&> params(a1, a2, a3, a4, a5);
-		shared_zone  slife(msglife.release());
+		shared_zone  slife(std::move(msglife));
 		return static_cast<IMPL*>(this)->send_notify(
 				name, params, slife);
 	}
@@ -597,7 +597,7 @@ public:
 			const A1& a1, const A2& a2, const A3& a3, const A4& a4, const A5& a5, const A6& a6)
 	{
 		std::tuple<const A1&, const A2&, const A3&, const A4&, const A5&, const A6&> params(a1, a2, a3, a4, a5, a6);
-		shared_zone  slife(msglife.release());
+		shared_zone  slife(std::move(msglife));
 		return static_cast<IMPL*>(this)->send_notify(
 				name, params, slife);
 	}
@@ -607,7 +607,7 @@ public:
 			const A1& a1, const A2& a2, const A3& a3, const A4& a4, const A5& a5, const A6& a6, const A7& a7)
 	{
 		std::tuple<const A1&, const A2&, const A3&, const A4&, const A5&, const A6&, const A7&> params(a1, a2, a3, a4, a5, a6, a7);
-		shared_zone  slife(msglife.release());
+		shared_zone  slife(std::move(msglife));
 		return static_cast<IMPL*>(this)->send_notify(
 				name, params, slife);
 	}
@@ -617,7 +617,7 @@ public:
 			const A1& a1, const A2& a2, const A3& a3, const A4& a4, const A5& a5, const A6& a6, const A7& a7, const A8& a8)
 	{
 		std::tuple<const A1&, const A2&, const A3&, const A4&, const A5&, const A6&, const A7&, const A8&> params(a1, a2, a3, a4, a5, a6, a7, a8);
-		shared_zone  slife(msglife.release());
+		shared_zone  slife(std::move(msglife));
 		return static_cast<IMPL*>(this)->send_notify(
 				name, params, slife);
 	}
@@ -627,7 +627,7 @@ public:
 			const A1& a1, const A2& a2, const A3& a3, const A4& a4, const A5& a5, const A6& a6, const A7& a7, const A8& a8, const A9& a9)
 	{
 		std::tuple<const A1&, const A2&, const A3&, const A4&, const A5&, const A6&, const A7&, const A8&, const A9&> params(a1, a2, a3, a4, a5, a6, a7, a8, a9);
-		shared_zone  slife(msglife.release());
+		shared_zone  slife(std::move(msglife));
 		return static_cast<IMPL*>(this)->send_notify(
 				name, params, slife);
 	}
@@ -637,7 +637,7 @@ public:
 			const A1& a1, const A2& a2, const A3& a3, const A4& a4, const A5& a5, const A6& a6, const A7& a7, const A8& a8, const A9& a9, const A10& a10)
 	{
 		std::tuple<const A1&, const A2&, const A3&, const A4&, const A5&, const A6&, const A7&, const A8&, const A9&, const A10&> params(a1, a2, a3, a4, a5, a6, a7, a8, a9, a10);
-		shared_zone  slife(msglife.release());
+		shared_zone  slife(std::move(msglife));
 		return static_cast<IMPL*>(this)->send_notify(
 				name, params, slife);
 	}
@@ -647,7 +647,7 @@ public:
 			const A1& a1, const A2& a2, const A3& a3, const A4& a4, const A5& a5, const A6& a6, const A7& a7, const A8& a8, const A9& a9, const A10& a10, const A11& a11)
 	{
 		std::tuple<const A1&, const A2&, const A3&, const A4&, const A5&, const A6&, const A7&, const A8&, const A9&, const A10&, const A11&> params(a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11);
-		shared_zone  slife(msglife.release());
+		shared_zone  slife(std::move(msglife));
 		return static_cast<IMPL*>(this)->send_notify(
 				name, params, slife);
 	}
@@ -657,7 +657,7 @@ public:
 			const A1& a1, const A2& a2, const A3& a3, const A4& a4, const A5& a5, const A6& a6, const A7& a7, const A8& a8, const A9& a9, const A10& a10, const A11& a11, const A12& a12)
 	{
 		std::tuple<const A1&, const A2&, const A3&, const A4&, const A5&, const A6&, const A7&, const A8&, const A9&, const A10&, const A11&, const A12&> params(a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12);
-		shared_zone  slife(msglife.release());
+		shared_zone  slife(std::move(msglife));
 		return static_cast<IMPL*>(this)->send_notify(
 				name, params, slife);
 	}
@@ -667,7 +667,7 @@ public:
 			const A1& a1, const A2& a2, const A3& a3, const A4& a4, const A5& a5, const A6& a6, const A7& a7, const A8& a8, const A9& a9, const A10& a10, const A11& a11, const A12& a12, const A13& a13)
 	{
 		std::tuple<const A1&, const A2&, const A3&, const A4&, const A5&, const A6&, const A7&, const A8&, const A9&, const A10&, const A11&, const A12&, const A13&> params(a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13);
-		shared_zone  slife(msglife.release());
+		shared_zone  slife(std::move(msglife));
 		return static_cast<IMPL*>(this)->send_notify(
 				name, params, slife);
 	}
@@ -677,7 +677,7 @@ public:
 			const A1& a1, const A2& a2, const A3& a3, const A4& a4, const A5& a5, const A6& a6, const A7& a7, const A8& a8, const A9& a9, const A10& a10, const A11& a11, const A12& a12, const A13& a13, const A14& a14)
 	{
 		std::tuple<const A1&, const A2&, const A3&, const A4&, const A5&, const A6&, const A7&, const A8&, const A9&, const A10&, const A11&, const A12&, const A13&, const A14&> params(a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14);
-		shared_zone  slife(msglife.release());
+		shared_zone  slife(std::move(msglife));
 		return static_cast<IMPL*>(this)->send_notify(
 				name, params, slife);
 	}
@@ -687,7 +687,7 @@ public:
 			const A1& a1, const A2& a2, const A3& a3, const A4& a4, const A5& a5, const A6& a6, const A7& a7, const A8& a8, const A9& a9, const A10& a10, const A11& a11, const A12& a12, const A13& a13, const A14& a14, const A15& a15)
 	{
 		std::tuple<const A1&, const A2&, const A3&, const A4&, const A5&, const A6&, const A7&, const A8&, const A9&, const A10&, const A11&, const A12&, const A13&, const A14&, const A15&> params(a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14, a15);
-		shared_zone  slife(msglife.release());
+		shared_zone  slife(std::move(msglife));
 		return static_cast<IMPL*>(this)->send_notify(
 				name, params, slife);
 	}
@@ -697,7 +697,7 @@ public:
 			const A1& a1, const A2& a2, const A3& a3, const A4& a4, const A5& a5, const A6& a6, const A7& a7, const A8& a8, const A9& a9, const A10& a10, const A11& a11, const A12& a12, const A13& a13, const A14& a14, const A15& a15, const A16& a16)
 	{
 		std::tuple<const A1&, const A2&, const A3&, const A4&, const A5&, const A6&, const A7&, const A8&, const A9&, const A10&, const A11&, const A12&, const A13&, const A14&, const A15&, const A16&> params(a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14, a15, a16);
-		shared_zone  slife(msglife.release());
+		shared_zone  slife(std::move(msglife));
 		return static_cast<IMPL*>(this)->send_notify(
 				name, params, slife);
 	}
@@ -1010,7 +1010,7 @@ public:
 			auto_zone msglife,
 			const ArgArray& params)
 	{
-		shared_zone  slife(msglife.release());
+		shared_zone  slife(std::move(msglife));
 		return static_cast<IMPL*>(this)->send_notify(
 				name, params, slife);
 	}
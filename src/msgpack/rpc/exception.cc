@@ -55,6 +55,10 @@ void throw_exception(future* f)
             err.via.u64 == ARGUMENT_ERROR) {
         throw argument_error();
 
+    } else if(err.type == msgpack::type::POSITIVE_INTEGER &&
+            err.via.u64 == OVERLOADED_ERROR) {
+        throw overloaded_error();
+
     } else {
         std::ostringstream os;
         os << "remote error: ";
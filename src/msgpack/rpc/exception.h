@@ -70,6 +70,14 @@ struct argument_error : call_error {
         call_error(msg) {}
 };
 
+struct overloaded_error : call_error {
+    overloaded_error() :
+        call_error("server overloaded") {}
+
+    overloaded_error(const std::string& msg) :
+        call_error(msg) {}
+};
+
 
 struct remote_error : rpc_error {
     remote_error(object err, future f) :
@@ -0,0 +1,104 @@
+//
+// msgpack::rpc::futex - MessagePack-RPC for C++
+//
+// Copyright (C) 2009-2010 FURUHASHI Sadayuki
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+#include "futex.h"
+
+#if defined(__linux__)
+#  include <errno.h>
+#  include <limits.h>
+#  include <linux/futex.h>
+#  include <sys/syscall.h>
+#  include <time.h>
+#  include <unistd.h>
+#else
+#  include <boost/thread.hpp>
+#  include <boost/thread/condition_variable.hpp>
+#endif
+
+namespace msgpack {
+namespace rpc {
+
+
+#if defined(__linux__)
+
+static_assert(sizeof(futex_word) == sizeof(uint32_t),
+              "futex_word must be a plain 32bit word");
+
+bool futex_wait(futex_word* word, uint32_t expected, unsigned int ms)
+{
+    struct timespec ts;
+    struct timespec* timeout = NULL;
+    if (ms > 0) {
+        ts.tv_sec = ms / 1000;
+        ts.tv_nsec = (ms % 1000) * 1000000L;
+        timeout = &ts;
+    }
+
+    long ret = syscall(SYS_futex, reinterpret_cast<uint32_t*>(word),
+                       FUTEX_WAIT_PRIVATE, expected, timeout, NULL, 0);
+    return ret == 0 || errno != ETIMEDOUT;
+}
+
+void futex_wake_all(futex_word* word)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word),
+            FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+#else
+
+struct parking_bucket {
+    boost::mutex mutex;
+    boost::condition_variable cond;
+};
+
+static const size_t PARKING_BUCKETS = 64;
+static parking_bucket s_buckets[PARKING_BUCKETS];
+
+static parking_bucket& bucket_of(futex_word* word)
+{
+    return s_buckets[(reinterpret_cast<size_t>(word) >> 4) % PARKING_BUCKETS];
+}
+
+bool futex_wait(futex_word* word, uint32_t expected, unsigned int ms)
+{
+    parking_bucket& b = bucket_of(word);
+    boost::mutex::scoped_lock lk(b.mutex);
+    // the waker changes the word before taking the bucket lock, so
+    // checking under the lock cannot miss a wakeup
+    if (word->load(std::memory_order_acquire) != expected) {
+        return true;
+    }
+    if (ms == 0) {
+        b.cond.wait(lk);
+        return true;
+    }
+    return b.cond.timed_wait(lk, boost::posix_time::milliseconds(ms));
+}
+
+void futex_wake_all(futex_word* word)
+{
+    parking_bucket& b = bucket_of(word);
+    boost::mutex::scoped_lock lk(b.mutex);
+    b.cond.notify_all();
+}
+
+#endif
+
+
+}  // namespace rpc
+}  // namespace msgpack
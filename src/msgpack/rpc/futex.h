@@ -0,0 +1,58 @@
+//
+// msgpack::rpc::futex - MessagePack-RPC for C++
+//
+// Copyright (C) 2009-2010 FURUHASHI Sadayuki
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+#ifndef MSGPACK_RPC_FUTEX_H__
+#define MSGPACK_RPC_FUTEX_H__
+
+#include <atomic>
+#include <stdint.h>
+
+namespace msgpack {
+namespace rpc {
+
+
+typedef std::atomic<uint32_t> futex_word;
+
+// Blocks while '*word == expected', for at most 'ms' milliseconds (0 waits
+// without a limit). Returns false on timeout. May return early without the
+// word changing, so callers re-check it in a loop.
+//
+// Uses the futex syscall on Linux. Elsewhere it parks on one of a fixed set
+// of condition variables chosen by the word's address, so nothing is
+// allocated per word.
+bool futex_wait(futex_word* word, uint32_t expected, unsigned int ms);
+
+// Tells the CPU this is a spin-wait loop: saves power and lets the other
+// hyper-thread run.
+static inline void cpu_relax()
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+// Wakes every thread blocked in futex_wait() on 'word'. Change the word
+// before calling this.
+void futex_wake_all(futex_word* word);
+
+
+}  // namespace rpc
+}  // namespace msgpack
+
+#endif /* msgpack/rpc/futex.h */
@@ -17,63 +17,253 @@
 //
 #include "exception_impl.h"
 #include "future_impl.h"
+#include "log.h"
+#include "trace.h"
 
-#include <boost/log/trivial.hpp>
+#include <boost/thread.hpp>
+#include <chrono>
+#include <stdexcept>
+#include <string.h>
 
 namespace msgpack {
 namespace rpc {
 
 
-future_impl::future_impl(msgid_t msgid, shared_session s, loop lo) :
+future_impl::future_impl(msgid_t msgid, const std::string& method,
+                         shared_session s, loop lo, uint64_t trace_id) :
     m_msgid(msgid),
+    m_method(method),
+    m_sent(std::chrono::steady_clock::now()),
+    m_trace_id(trace_id),
     m_session(s),
     m_loop(lo),
-    m_timeout(s->get_timeout())
+    m_serviced(true),
+    m_timeout(s->get_timeout()),
+    m_timed(true),
+    m_spin_usec(s->get_spin_usec()),
+    m_yield_usec(s->get_yield_usec()),
+    m_state(0),
+    m_callbacks(NULL),
+    m_chunk_reader(false),
+    m_chunk_seen(false),
+    m_active(m_sent.time_since_epoch().count()),
+    m_stream_timeout(m_timeout)
+{
+    if (s->is_inline_io()) {
+        m_inline_session = s;
+    }
+}
+
+future_impl::future_impl(loop lo, bool serviced) :
+    m_msgid(0),
+    m_trace_id(0),
+    m_session(),
+    m_loop(lo),
+    m_serviced(serviced),
+    m_timeout(0),
+    m_timed(false),
+    m_spin_usec(0),
+    m_yield_usec(0),
+    m_state(0),
+    m_callbacks(NULL),
+    m_chunk_reader(false),
+    m_chunk_seen(false),
+    m_active(0),
+    m_stream_timeout(0)
 {
 }
 
 future_impl::~future_impl()
 {
+    size_t nbytes = 0;
+    for (std::deque<chunk_entry>::iterator it = m_chunks.begin();
+            it != m_chunks.end(); ++it) {
+        nbytes += it->nbytes;
+    }
+    if (nbytes && m_chunk_consumed) {
+        m_chunk_consumed(nbytes);
+    }
+
+    callback_node* node = m_callbacks.load(std::memory_order_acquire);
+    while (node && node != closed()) {
+        callback_node* next = node->next;
+        delete node;
+        node = next;
+    }
+}
+
+future_impl::callback_node* future_impl::closed()
+{
+    static callback_node sentinel((callback_t()), executor_t());
+    return &sentinel;
 }
 
 bool future_impl::is_ready() const
 {
-    return !m_session;
+    return m_state.load(std::memory_order_acquire) & STATE_READY;
 }
 
 void future_impl::wait()
 {
-    boost::mutex::scoped_lock lk(m_mutex);
-    while (m_session) {
-        m_cond.wait(lk);
+    uint32_t s = m_state.load(std::memory_order_acquire);
+    while (!(s & STATE_READY)) {
+        if (!(s & STATE_WAITERS)) {
+            if (!m_state.compare_exchange_weak(s, s | STATE_WAITERS,
+                    std::memory_order_acquire)) {
+                continue;
+            }
+            s |= STATE_WAITERS;
+        }
+        futex_wait(&m_state, s, 0);
+        s = m_state.load(std::memory_order_acquire);
     }
 }
 
-bool future_impl::timed_wait(unsigned ms)
+// milliseconds left until 'deadline', rounded up so that a sub-millisecond
+// remainder does not spin; 0 once it has passed
+static unsigned int ms_until(std::chrono::steady_clock::time_point deadline)
 {
-    boost::mutex::scoped_lock lk(m_mutex);
-    while (m_session) {
-        if (!m_cond.timed_wait(lk, boost::posix_time::milliseconds(ms))) {
-            lk.unlock();
-            set_result(object(), TIMEOUT_ERROR, auto_zone());
+    std::chrono::steady_clock::duration left =
+        deadline - std::chrono::steady_clock::now();
+    if (left <= std::chrono::steady_clock::duration::zero()) {
+        return 0;
+    }
+    return std::chrono::duration_cast<std::chrono::milliseconds>(left).count() + 1;
+}
+
+bool future_impl::wait_until(std::chrono::steady_clock::time_point deadline)
+{
+    uint32_t s = m_state.load(std::memory_order_acquire);
+    while (!(s & STATE_READY)) {
+        unsigned int left_ms = ms_until(deadline);
+        if (left_ms == 0) {
             return false;
         }
+        if (!(s & STATE_WAITERS)) {
+            if (!m_state.compare_exchange_weak(s, s | STATE_WAITERS,
+                    std::memory_order_acquire)) {
+                continue;
+            }
+            s |= STATE_WAITERS;
+        }
+        futex_wait(&m_state, s, left_ms);
+        s = m_state.load(std::memory_order_acquire);
     }
     return true;
 }
 
+std::chrono::steady_clock::time_point future_impl::deadline() const
+{
+    typedef std::chrono::steady_clock clock;
+    return clock::time_point(clock::duration(m_active.load(std::memory_order_relaxed)))
+        + std::chrono::seconds(m_stream_timeout);
+}
+
+bool future_impl::timed_wait(unsigned ms)
+{
+    // on an inline session the reply may wait in the socket for a reader
+    if (!is_ready() && read_inline(std::bind(&future_impl::is_ready, this), ms)) {
+        return is_ready() || !set_timeout();
+    }
+
+    std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::now() + std::chrono::milliseconds(ms);
+    return wait_until(deadline) || !set_timeout();
+}
+
 void future_impl::recv()
 {
-    while (m_session) {
+    while (!is_ready()) {
         m_loop->run_once();
     }
 }
 
+bool future_impl::spin_wait()
+{
+    if (m_spin_usec == 0 && m_yield_usec == 0) {
+        return is_ready();
+    }
+
+    typedef std::chrono::steady_clock clock;
+    clock::time_point now = clock::now();
+    clock::time_point spin_until = now + std::chrono::microseconds(m_spin_usec);
+    clock::time_point yield_until = spin_until + std::chrono::microseconds(m_yield_usec);
+
+    for (unsigned int n = 1; !is_ready(); ++n) {
+        // reading the clock costs more than a pause, so only do it now
+        // and then while spinning
+        if (now >= spin_until || (n % 64) == 0) {
+            now = clock::now();
+            if (now >= yield_until) {
+                return false;
+            }
+        }
+        if (now < spin_until) {
+            cpu_relax();
+        } else {
+            boost::this_thread::yield();
+        }
+    }
+    return true;
+}
+
+// false if the session does not read inline or another thread reads
+bool future_impl::read_inline(std::function<bool ()> done, unsigned int timeout_ms)
+{
+    shared_session s = m_inline_session.lock();
+    return s && s->read_inline(done, timeout_ms);
+}
+
+// Fails the future with TIMEOUT_ERROR. Returns false if another thread
+// claimed it first, once the result that thread is writing is complete.
+bool future_impl::set_timeout()
+{
+    if (set_result(object(), TIMEOUT_ERROR, auto_zone())) {
+        return true;
+    }
+    wait();
+    return false;
+}
+
 void future_impl::join()
 {
-    if (m_loop->is_running()) {
-        // wait();
-        timed_wait(m_timeout * 1000);
+    if (is_ready()) {
+        return;
+    }
+
+    // Chunks of a streamed response move the deadline on, so it is read
+    // again whenever the wait for it ends. On an inline session the reply
+    // is read here, until another thread takes over reading.
+    while (read_inline(std::bind(&future_impl::is_ready, this),
+                ms_until(deadline()))) {
+        if (is_ready()) {
+            return;
+        }
+        if (ms_until(deadline()) == 0) {
+            set_timeout();
+            return;
+        }
+    }
+
+    if (!m_serviced) {
+        // completed by futures of other loops, if at all
+        wait();
+    } else if (m_loop->is_running()) {
+        if (spin_wait()) {
+            return;
+        }
+        if (m_timed) {
+            while (!wait_until(deadline())) {
+                if (ms_until(deadline()) == 0) {
+                    set_timeout();
+                    return;
+                }
+            }
+        } else {
+            // combined futures finish when their inputs do, and the
+            // inputs time out on their own
+            wait();
+        }
     } else {
         recv();
     }
@@ -84,44 +274,254 @@ static void callback_real(callback_t callback, future f)
     try {
         callback(f);
     } catch (std::exception& e) {
-        BOOST_LOG_TRIVIAL(warning) << "response callback error: " <<  e.what();
+        MSGPACK_RPC_LOG(warning) << "response callback error: " <<  e.what();
     } catch (...) {
-        BOOST_LOG_TRIVIAL(warning) << "response callback error: unknown error";
+        MSGPACK_RPC_LOG(warning) << "response callback error: unknown error";
     }
 }
 
-void future_impl::attach_callback(callback_t func)
+static void run_callback(callback_t func, executor_t ex, future f)
 {
-    boost::mutex::scoped_lock lk(m_mutex);
+    if (ex) {
+        ex(std::bind(&callback_real, func, f));
+    } else {
+        callback_real(func, f);
+    }
+}
 
+void future_impl::attach_callback(callback_t func, executor_t ex)
+{
     assert(func);
-    if (!m_session) {
-        // callback_real(func, future(shared_from_this()));
+
+    callback_node* node = new callback_node(func, ex);
+    callback_node* head = m_callbacks.load(std::memory_order_acquire);
+    while (head != closed()) {
+        node->next = head;
+        if (m_callbacks.compare_exchange_weak(head, node,
+                std::memory_order_release, std::memory_order_acquire)) {
+            // nobody may wait for an inline reply, let the loop read it
+            shared_session s = m_inline_session.lock();
+            if (s) {
+                s->request_async_read();
+            }
+            return;
+        }
+    }
+    delete node;
+
+    // already ready: never run the callback on the attaching thread,
+    // the caller may hold locks the callback needs, unless there is no
+    // loop that would run it
+    if (ex || !m_serviced) {
+        run_callback(func, ex, future(shared_from_this()));
+    } else {
         m_loop->submit(std::bind(&callback_real, func,
                        future(shared_from_this())));
-    } else {
-        m_callback = func;
     }
 }
 
-void future_impl::set_result(object result, object error, auto_zone z)
+bool future_impl::set_result(object result, object error, auto_zone z)
 {
-    boost::mutex::scoped_lock lk(m_mutex);
+    if (m_state.fetch_or(STATE_SETTING, std::memory_order_acquire)
+            & STATE_SETTING) {
+        // already completed, e.g. a response that arrives after the
+        // caller gave up waiting
+        return false;
+    }
+
+    trace_point(m_trace_id, m_msgid, TRACE_SET_RESULT);
+
     m_result = result;
     m_error = error;
     m_zone = std::move(z);
-    m_session.reset();
+    if (m_session) {
+        m_session->record_latency(m_method,
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - m_sent).count());
+        m_session.reset();
+    }
+
+    uint32_t s = m_state.fetch_or(STATE_READY, std::memory_order_acq_rel);
+    if (s & STATE_WAITERS) {
+        futex_wake_all(&m_state);
+    }
+    if (m_chunk_reader.load()) {
+        // a reader that saw neither a chunk nor the result is waiting or
+        // about to, under the lock
+        boost::mutex::scoped_lock lk(m_chunk_mutex);
+        m_chunk_cond.notify_all();
+    }
+
+    // the stack holds callbacks newest first; run them in attach order
+    callback_node* node = m_callbacks.exchange(closed(),
+            std::memory_order_acq_rel);
+    callback_node* ordered = NULL;
+    while (node) {
+        callback_node* next = node->next;
+        node->next = ordered;
+        ordered = node;
+        node = next;
+    }
+
+    future self(shared_from_this());
+    while (ordered) {
+        callback_node* next = ordered->next;
+        run_callback(ordered->func, ordered->ex, self);
+        delete ordered;
+        ordered = next;
+    }
+    return true;
+}
+
+static object make_index(size_t index)
+{
+    object obj;
+    obj.type = msgpack::type::POSITIVE_INTEGER;
+    obj.via.u64 = index;
+    return obj;
+}
 
-    m_cond.notify_all();
+static void set_exception(shared_future f, const char* what)
+{
+    auto_zone z(new msgpack::zone());
+    size_t len = strlen(what);
+    char* ptr = (char*)z->allocate_align(len);
+    memcpy(ptr, what, len);
+
+    object err;
+    err.type = msgpack::type::STR;
+    err.via.str.ptr = ptr;
+    err.via.str.size = len;
+    f->set_result(object(), err, std::move(z));
+}
+
+static void forward_result(shared_future to, future from)
+{
+    to->set_result(from.result(), from.error(), std::move(from.zone()));
+}
 
-    if (m_callback) {
-        callback_real(m_callback, future(shared_from_this()));
-        m_callback = nullptr;
+static void then_real(shared_future next,
+                      std::function<future (future)> func, future f)
+{
+    future chained;
+    try {
+        chained = func(f);
+    } catch (std::exception& e) {
+        set_exception(next, e.what());
+        return;
+    } catch (...) {
+        set_exception(next, "unknown error");
+        return;
+    }
+
+    if (chained.is_nil()) {
+        next->set_result(object(), object(), auto_zone());
+    } else {
+        chained.attach_callback(std::bind(&forward_result,
+                next, std::placeholders::_1));
+    }
+}
+
+static void when_all_real(shared_future all,
+                          std::shared_ptr<atomic_int_type> remaining, future f)
+{
+    if (atomic_decrement(remaining.get()) == 1) {
+        all->set_result(object(), object(), auto_zone());
+    }
+}
+
+static void when_any_real(shared_future any,
+                          std::shared_ptr<atomic_int_type> fired,
+                          size_t index, future f)
+{
+    if (atomic_increment(fired.get()) == 0) {
+        any->set_result(make_index(index), object(), auto_zone());
+    }
+}
+
+void future_impl::push_chunk(object chunk, auto_zone z,
+                             size_t nbytes, const account_t& consumed)
+{
+    if (is_ready()) {
+        if (nbytes && consumed) {
+            consumed(nbytes);
+        }
+        return;
+    }
+
+    chunk_entry e;
+    e.obj = chunk;
+    e.z = std::move(z);
+    e.nbytes = nbytes;
+    {
+        boost::mutex::scoped_lock lk(m_chunk_mutex);
+        if (!m_chunk_consumed) {
+            m_chunk_consumed = consumed;
+        }
+        m_chunks.push_back(std::move(e));
+        m_chunk_cond.notify_one();
+    }
+    keep_alive();
+}
+
+bool future_impl::has_chunk_or_result()
+{
+    boost::mutex::scoped_lock lk(m_chunk_mutex);
+    return !m_chunks.empty() || is_ready();
+}
+
+bool future_impl::next_chunk(object* chunk, auto_zone* z)
+{
+    if (!has_chunk_or_result()) {
+        while (read_inline(std::bind(&future_impl::has_chunk_or_result, this),
+                    ms_until(deadline()))) {
+            if (has_chunk_or_result()) {
+                break;
+            }
+            if (ms_until(deadline()) == 0) {
+                set_timeout();
+                break;
+            }
+        }
+        if (!has_chunk_or_result() && !m_loop->is_running()) {
+            while (!has_chunk_or_result()) {
+                m_loop->run_once();
+            }
+        }
+    }
+
+    boost::mutex::scoped_lock lk(m_chunk_mutex);
+    m_chunk_reader.store(true);
+    while (true) {
+        // chunks are pushed before the result is set, so all of them are
+        // in the queue once the future is ready
+        if (!m_chunks.empty()) {
+            chunk_entry& e = m_chunks.front();
+            *chunk = e.obj;
+            *z = std::move(e.z);
+            size_t nbytes = e.nbytes;
+            m_chunks.pop_front();
+            lk.unlock();
+
+            if (nbytes && m_chunk_consumed) {
+                m_chunk_consumed(nbytes);
+            }
+            return true;
+        }
+        if (is_ready()) {
+            return false;
+        }
+        m_chunk_cond.wait(lk);
     }
 }
 
 bool future_impl::step_timeout()
 {
+    if (m_chunk_seen.exchange(false, std::memory_order_relaxed)) {
+        // the stream is still flowing
+        m_timeout = m_stream_timeout;
+        return false;
+    }
     if (m_timeout > 0) {
         --m_timeout;
         return false;
@@ -160,6 +560,11 @@ const std::string& future::method() const
     return m_method;
 }
 
+loop future::get_loop() const
+{
+    return m_pimpl->get_loop();
+}
+
 object future::get_impl()
 {
     if (!m_pimpl) {
@@ -209,12 +614,83 @@ object future::error() const
     return m_pimpl->error();
 }
 
+bool future::next_chunk(object* chunk, auto_zone* z)
+{
+    if (!m_pimpl) {
+        throw std::runtime_error("null future reference");
+    }
+    return m_pimpl->next_chunk(chunk, z);
+}
+
+static void submit_to_loop(loop lo, std::function<void ()> task)
+{
+    lo->submit(task);
+}
+
 future& future::attach_callback(std::function<void (future)> func)
 {
-    m_pimpl->attach_callback(func);
+    m_pimpl->attach_callback(func, executor_t());
+    return *this;
+}
+
+future& future::attach_callback(std::function<void (future)> func, loop lo)
+{
+    m_pimpl->attach_callback(func, std::bind(&submit_to_loop,
+            lo, std::placeholders::_1));
+    return *this;
+}
+
+future& future::attach_callback(std::function<void (future)> func, executor_t ex)
+{
+    m_pimpl->attach_callback(func, ex);
     return *this;
 }
 
+future future::then(std::function<future (future)> func)
+{
+    shared_future next(new future_impl(get_loop(), m_pimpl->is_loop_serviced()));
+    m_pimpl->attach_callback(std::bind(&then_real,
+            next, func, std::placeholders::_1), executor_t());
+    return future(m_method, next);
+}
+
+future when_all(const std::vector<future>& futures)
+{
+    if (futures.empty()) {
+        // ready at once, with no loop of any input to run its callbacks
+        shared_future all(new future_impl(loop(), false));
+        all->set_result(object(), object(), auto_zone());
+        return future(all);
+    }
+
+    shared_future all(new future_impl(futures.front().get_loop()));
+    std::shared_ptr<atomic_int_type> remaining(
+            new atomic_int_type(futures.size()));
+    for (std::vector<future>::const_iterator it = futures.begin();
+            it != futures.end(); ++it) {
+        future f = *it;
+        f.attach_callback(std::bind(&when_all_real,
+                all, remaining, std::placeholders::_1));
+    }
+    return future(all);
+}
+
+future when_any(const std::vector<future>& futures)
+{
+    if (futures.empty()) {
+        throw std::invalid_argument("when_any of no futures");
+    }
+
+    shared_future any(new future_impl(futures.front().get_loop()));
+    std::shared_ptr<atomic_int_type> fired(new atomic_int_type(0));
+    for (size_t i = 0; i < futures.size(); ++i) {
+        future f = futures[i];
+        f.attach_callback(std::bind(&when_any_real,
+                any, fired, i, std::placeholders::_1));
+    }
+    return future(any);
+}
+
 auto_zone& future::zone()
 {
     return m_pimpl->zone();
@@ -19,17 +19,22 @@
 #define MSGPACK_RPC_FUTURE_H__
 
 #include "impl_fwd.h"
+#include "loop.h"
 #include "protocol.h"
 #include "types.h"
 
 #include <functional>
 #include <utility> // for std::move()
+#include <vector>
 
 namespace msgpack {
 namespace rpc {
 
 class future_impl;
 
+/// Runs a task somewhere, e.g. by posting it to a thread pool
+typedef std::function<void (std::function<void ()>)> executor_t;
+
 class future {
 public:
     future();
@@ -40,6 +45,9 @@ public:
     msgid_t msgid() const;
     const std::string& method() const;
 
+    /// The loop of the session that sent the request
+    loop get_loop() const;
+
     template<typename T> T get();
     template<typename T> T get(auto_zone* z);
     template<typename T> T result_as() const;
@@ -61,7 +69,34 @@ public:
     auto_zone& zone();
     const auto_zone& zone() const;
 
+    /// Streamed results (see request::stream_write()). Waits for the next
+    /// chunk and returns true, or returns false once the stream has ended;
+    /// get() then returns the final result or throws its error. Each chunk
+    /// is handed over once, so only one thread should read them. Chunks
+    /// not taken yet count against MSGPACK_RPC_STREAM_QUEUE_SIZE bytes on
+    /// the connection, which is not read while they exceed it: read them,
+    /// or drop the future. Each chunk also restarts the call's timeout.
+    bool next_chunk(object* chunk, auto_zone* z);
+    template<typename T> bool next_chunk(T* chunk);
+
+    /// Several callbacks may be attached; they run in attach order.
+    /// Callbacks never run with the future locked.
+    ///
+    /// The first form runs 'func' inline on the thread that completes the
+    /// future, usually the io thread that parsed the response, so it must
+    /// not block. The second posts it to 'lo', and the third hands it to
+    /// 'ex'. A callback attached to a future that is already ready is
+    /// posted to the future's loop (first form) or run through the given
+    /// loop or executor.
     future& attach_callback(std::function<void (future)> func);
+    future& attach_callback(std::function<void (future)> func, loop lo);
+    future& attach_callback(std::function<void (future)> func, executor_t ex);
+
+    /// Returns a future that completes with the result of the future
+    /// returned by 'func', which runs once this future is ready. If 'func'
+    /// returns a nil future, the returned future completes with nil; if it
+    /// throws, with the exception message as error.
+    future then(std::function<future (future)> func);
 
     // for std::map and std::list
     bool operator< (const future& f) const;
@@ -114,6 +149,31 @@ public:
 typedef std::function<void (future)> callback_t;
 
 
+/// Returns a future that completes with nil once every future in the range
+/// is ready. The inputs are not consumed; read their results from them.
+/// Only the last input to finish touches the returned future, so a thread
+/// waiting on it wakes up once.
+/// With no inputs it is ready at once, and callbacks attached to it, or to
+/// futures made from it with then(), run on the attaching thread.
+future when_all(const std::vector<future>& futures);
+
+template <typename Iterator>
+future when_all(Iterator first, Iterator last)
+{
+    return when_all(std::vector<future>(first, last));
+}
+
+/// Returns a future that completes as soon as any future in the range is
+/// ready. Its result is the index of that future.
+future when_any(const std::vector<future>& futures);
+
+template <typename Iterator>
+future when_any(Iterator first, Iterator last)
+{
+    return when_any(std::vector<future>(first, last));
+}
+
+
 template <typename T>
 T future::get()
 {
@@ -142,6 +202,18 @@ void future::get<void>(auto_zone* z)
     obj.as<msgpack::type::nil>();
 }
 
+template <typename T>
+bool future::next_chunk(T* chunk)
+{
+    object obj;
+    auto_zone z;
+    if (!next_chunk(&obj, &z)) {
+        return false;
+    }
+    obj.convert(chunk);
+    return true;
+}
+
 template <typename T>
 T future::result_as() const
 {
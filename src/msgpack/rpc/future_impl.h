@@ -19,10 +19,14 @@
 #define MSGPACK_RPC_FUTURE_IMPL_H__
 
 #include "future.h"
+#include "futex.h"
 #include "session_impl.h"
 
+#include <atomic>
 #include <boost/thread.hpp>
-#include <boost/thread/condition_variable.hpp>
+#include <chrono>
+#include <deque>
+#include <functional>
 #include <memory>
 
 namespace msgpack {
@@ -31,7 +35,13 @@ namespace rpc {
 
 class future_impl : public std::enable_shared_from_this<future_impl> {
 public:
-    future_impl(msgid_t msgid, shared_session s, loop lo);
+    future_impl(msgid_t msgid, const std::string& method,
+                shared_session s, loop lo, uint64_t trace_id = 0);
+    // A future that is not bound to a request, completed by combinators.
+    // 'serviced' is false for a loop that nobody runs: the future is then
+    // waited for without it, and callbacks attached once it is ready run
+    // on the attaching thread.
+    future_impl(loop lo, bool serviced = true);
     ~future_impl();
 
     bool is_ready() const;
@@ -45,6 +55,21 @@ public:
         return m_msgid;
     }
 
+    uint64_t trace_id() const
+    {
+        return m_trace_id;
+    }
+
+    loop get_loop() const
+    {
+        return m_loop;
+    }
+
+    bool is_loop_serviced() const
+    {
+        return m_serviced;
+    }
+
     const object& result() const
     {
         return m_result;
@@ -57,26 +82,102 @@ public:
 
     auto_zone& zone() { return m_zone; }
 
-    void attach_callback(callback_t func);
+    void attach_callback(callback_t func, executor_t ex);
 
-    void set_result(object result, object error, auto_zone z);
+    // false if the future was completed already
+    bool set_result(object result, object error, auto_zone z);
+
+    // Parts of a streamed response, in the order they arrived. 'consumed'
+    // is called with 'nbytes' once the chunk is taken or dropped, so that
+    // the connection can stop reading while too many of them wait.
+    typedef std::function<void (size_t nbytes)> account_t;
+    void push_chunk(object chunk, auto_zone z,
+                    size_t nbytes, const account_t& consumed);
+    bool next_chunk(object* chunk, auto_zone* z);
 
     bool step_timeout();
+    // restarts the timeout, as the request is active
+    void keep_alive()
+    {
+        m_active.store(std::chrono::steady_clock::now().time_since_epoch().count(),
+                std::memory_order_relaxed);
+        m_chunk_seen.store(true, std::memory_order_relaxed);
+    }
 
 private:
     msgid_t m_msgid;
+    std::string m_method;
+    // when the request was sent, for the session's latency stats
+    std::chrono::steady_clock::time_point m_sent;
+    uint64_t m_trace_id;  // 0 unless traced
     shared_session m_session;
     loop m_loop;
+    bool m_serviced;
 
     unsigned int m_timeout;
-    callback_t m_callback;
+    bool m_timed;  // false for combined futures
+
+    // spin-then-yield budget before join() blocks, from the session
+    unsigned int m_spin_usec;
+    unsigned int m_yield_usec;
+
+    bool spin_wait();
+
+    // set when the session reads replies inline (tcp_builder::inline_io)
+    weak_session m_inline_session;
+
+    bool read_inline(std::function<bool ()> done, unsigned int timeout_ms);
+    bool set_timeout();
+    bool has_chunk_or_result();
+
+    // false once 'deadline' passes before the future is ready
+    bool wait_until(std::chrono::steady_clock::time_point deadline);
+    // when join() gives up: m_stream_timeout after the request was sent,
+    // or after the last chunk or keep-alive
+    std::chrono::steady_clock::time_point deadline() const;
+
+    // Bits of m_state. A future is completed once: the first set_result()
+    // claims it with STATE_SETTING and later ones are dropped. STATE_READY
+    // publishes the result. STATE_WAITERS is set by a thread that is about
+    // to block, so set_result() only makes the wake syscall when needed.
+    static const uint32_t STATE_SETTING = 1;
+    static const uint32_t STATE_READY   = 2;
+    static const uint32_t STATE_WAITERS = 4;
+    futex_word m_state;
+
+    // Callbacks attached before completion, pushed on a lock-free stack.
+    // set_result() swaps in the closed() sentinel, after which callbacks
+    // are run as soon as they are attached.
+    struct callback_node {
+        callback_t func;
+        executor_t ex;  // empty to run inline
+        callback_node* next;
+        callback_node(callback_t f, executor_t e) : func(f), ex(e), next(NULL) { }
+    };
+    std::atomic<callback_node*> m_callbacks;
+
+    static callback_node* closed();
 
     object m_result;
     object m_error;
     auto_zone m_zone;
 
-    boost::mutex m_mutex;
-    boost::condition_variable m_cond;
+    // Chunks not read yet. set_result() only takes m_chunk_mutex once a
+    // reader has waited for a chunk. A chunk, like keep_alive(), restarts
+    // the timeout.
+    struct chunk_entry {
+        object obj;
+        auto_zone z;
+        size_t nbytes;
+    };
+    std::deque<chunk_entry> m_chunks;
+    account_t m_chunk_consumed;  // from the first chunk, for all of them
+    boost::mutex m_chunk_mutex;
+    boost::condition_variable m_chunk_cond;
+    std::atomic<bool> m_chunk_reader;
+    std::atomic<bool> m_chunk_seen;
+    std::atomic<std::chrono::steady_clock::rep> m_active;  // last sign of life
+    unsigned int m_stream_timeout;
 
 private:
     future_impl();
@@ -0,0 +1,68 @@
+//
+// msgpack::rpc::log - MessagePack-RPC for C++
+//
+// Copyright (C) 2009-2010 FURUHASHI Sadayuki
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+#include "log.h"
+
+#include <chrono>
+
+namespace msgpack {
+namespace rpc {
+
+
+static std::atomic<unsigned int> g_sample_rate(0);
+
+void set_log_sample_rate(unsigned int per_sec)
+{
+    g_sample_rate.store(per_sec, std::memory_order_relaxed);
+}
+
+unsigned int get_log_sample_rate()
+{
+    return g_sample_rate.load(std::memory_order_relaxed);
+}
+
+log_limiter::log_limiter() :
+    m_second(0), m_count(0), m_dropped(0)
+{
+}
+
+uint64_t log_limiter::allow()
+{
+    unsigned int rate = get_log_sample_rate();
+    if (rate == 0) {
+        return 1;
+    }
+
+    uint64_t now = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    uint64_t second = m_second.load(std::memory_order_relaxed);
+    if (now != second &&
+            m_second.compare_exchange_strong(second, now, std::memory_order_relaxed)) {
+        // a new second; a record racing with the reset may slip through
+        m_count.store(0, std::memory_order_relaxed);
+    }
+
+    if (m_count.fetch_add(1, std::memory_order_relaxed) < rate) {
+        return m_dropped.exchange(0, std::memory_order_relaxed) + 1;
+    }
+    m_dropped.fetch_add(1, std::memory_order_relaxed);
+    return 0;
+}
+
+
+}  // namespace rpc
+}  // namespace msgpack
@@ -0,0 +1,110 @@
+//
+// msgpack::rpc::log - MessagePack-RPC for C++
+//
+// Copyright (C) 2009-2010 FURUHASHI Sadayuki
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+#ifndef MSGPACK_RPC_LOG_H__
+#define MSGPACK_RPC_LOG_H__
+
+#include <atomic>
+#include <boost/log/trivial.hpp>
+#include <stdint.h>
+
+// Severities, lowest first, for MSGPACK_RPC_LOG_LEVEL
+#define MSGPACK_RPC_LOG_LEVEL_trace   0
+#define MSGPACK_RPC_LOG_LEVEL_debug   1
+#define MSGPACK_RPC_LOG_LEVEL_info    2
+#define MSGPACK_RPC_LOG_LEVEL_warning 3
+#define MSGPACK_RPC_LOG_LEVEL_error   4
+#define MSGPACK_RPC_LOG_LEVEL_fatal   5
+
+// Records below MSGPACK_RPC_LOG_LEVEL are not compiled in at all: neither
+// the Boost.Log filter check nor the formatting of the streamed values is
+// left in the code. Release builds keep info and up by default, so the
+// per-message debug records vanish from the hot path.
+#ifndef MSGPACK_RPC_LOG_LEVEL
+#ifdef NDEBUG
+#define MSGPACK_RPC_LOG_LEVEL MSGPACK_RPC_LOG_LEVEL_info
+#else
+#define MSGPACK_RPC_LOG_LEVEL MSGPACK_RPC_LOG_LEVEL_trace
+#endif
+#endif
+
+#define MSGPACK_RPC_LOG_ENABLED(sev) \
+    (MSGPACK_RPC_LOG_LEVEL_##sev >= MSGPACK_RPC_LOG_LEVEL)
+
+// MSGPACK_RPC_LOG(debug) << "sending... msgid=" << msgid;
+#define MSGPACK_RPC_LOG(sev) \
+    if (!MSGPACK_RPC_LOG_ENABLED(sev)) { } else BOOST_LOG_TRIVIAL(sev)
+
+// Like MSGPACK_RPC_LOG, for records written once per message. Each call
+// site writes at most set_log_sample_rate() records a second and drops the
+// rest; the next record written says how many were dropped. The rate is
+// unlimited by default.
+#define MSGPACK_RPC_LOG_SAMPLED(sev) \
+    if (!MSGPACK_RPC_LOG_ENABLED(sev)) { } else \
+    for (uint64_t msgpack_rpc_log_n_ = []() -> ::msgpack::rpc::log_limiter& { \
+                static ::msgpack::rpc::log_limiter limiter; \
+                return limiter; \
+            }().allow(); \
+            msgpack_rpc_log_n_; msgpack_rpc_log_n_ = 0) \
+        BOOST_LOG_TRIVIAL(sev) << ::msgpack::rpc::log_dropped(msgpack_rpc_log_n_ - 1)
+
+namespace msgpack {
+namespace rpc {
+
+
+// Limits sampled records per second, per call site. 0 (the default)
+// writes every record.
+void set_log_sample_rate(unsigned int per_sec);
+unsigned int get_log_sample_rate();
+
+class log_limiter
+{
+public:
+    log_limiter();
+
+    // 0 if the record is to be dropped, else 1 + the number of records
+    // dropped since the last one written
+    uint64_t allow();
+
+private:
+    std::atomic<uint64_t> m_second;
+    std::atomic<uint32_t> m_count;
+    std::atomic<uint64_t> m_dropped;
+
+private:
+    log_limiter(const log_limiter&);
+};
+
+struct log_dropped {
+    explicit log_dropped(uint64_t n) : count(n) { }
+    uint64_t count;
+};
+
+template <typename Stream>
+inline Stream& operator<< (Stream& os, const log_dropped& d)
+{
+    if (d.count) {
+        os << "(" << d.count << " dropped) ";
+    }
+    return os;
+}
+
+
+}  // namespace rpc
+}  // namespace msgpack
+
+#endif /* msgpack/rpc/log.h */
@@ -7,7 +7,11 @@ namespace rpc {
 
 loop_impl::loop_impl() :
     m_io_service(),
-    m_workers()
+    m_work(m_io_service),
+    m_workers(),
+    m_step_timer(m_io_service),
+    m_step_num(0),
+    m_step_armed(false)
 {
 }
 
@@ -87,6 +91,60 @@ void loop_impl::submit(std::function<void ()> callback)
     m_io_service.post(callback);
 }
 
+void loop_impl::add_step(std::function<bool ()> step)
+{
+    boost::mutex::scoped_lock lk(m_step_mutex);
+    m_steps.push_back(step);
+    ++m_step_num;
+    if (!m_step_armed) {
+        m_step_armed = true;
+        arm_step_timer();
+    }
+}
+
+void loop_impl::arm_step_timer()
+{
+    m_step_timer.expires_from_now(boost::posix_time::seconds(1));
+    m_step_timer.async_wait(std::bind(
+            &loop_impl::step_timer_handler, this, std::placeholders::_1));
+}
+
+void loop_impl::step_timer_handler(const boost::system::error_code& err)
+{
+    if (err == boost::asio::error::operation_aborted) {
+        return;
+    }
+
+    // steps run without the lock, so that they may add steps
+    std::vector<std::function<bool ()> > steps;
+    {
+        boost::mutex::scoped_lock lk(m_step_mutex);
+        steps.swap(m_steps);
+    }
+
+    std::vector<std::function<bool ()> > kept;
+    for (size_t i = 0; i < steps.size(); ++i) {
+        if (steps[i]()) {
+            kept.push_back(std::move(steps[i]));
+        }
+    }
+
+    boost::mutex::scoped_lock lk(m_step_mutex);
+    m_steps.insert(m_steps.end(), kept.begin(), kept.end());
+    m_step_num -= steps.size() - kept.size();
+    if (m_steps.empty()) {
+        m_step_armed = false;
+    } else {
+        arm_step_timer();
+    }
+}
+
+size_t loop_impl::get_step_num()
+{
+    boost::mutex::scoped_lock lk(m_step_mutex);
+    return m_step_num;
+}
+
 loop::loop() : std::shared_ptr<loop_impl>(new loop_impl())
 {
 }
@@ -36,6 +36,9 @@ public:
     boost::asio::io_service& io_service();
 
     void start(size_t num);
+    /// Starts 'num' workers and runs the loop on the calling thread too.
+    /// It never returns on its own, even with nothing to do, because
+    /// m_work keeps the io_service busy; it returns once end() is called.
     void run(size_t num);
     bool is_running();
 
@@ -45,12 +48,31 @@ public:
     void end();
     void submit(std::function<void ()> callback);
 
+    /// Runs 'step' on a loop thread about once a second until it returns
+    /// false. All steps of a loop share one timer, which is only armed
+    /// while some step is registered, so sessions without requests in
+    /// flight cost no timer work.
+    void add_step(std::function<bool ()> step);
+
+    /// Steps registered now; the step timer is armed while it is not 0.
+    size_t get_step_num();
+
 private:
     void add_worker(size_t num);
+    void arm_step_timer();
+    void step_timer_handler(const boost::system::error_code& err);
 
 private:
     boost::asio::io_service m_io_service;
+    // keeps run() going while nothing is armed or being read
+    boost::asio::io_service::work m_work;
     std::vector< std::shared_ptr<boost::thread> > m_workers;
+
+    boost::asio::deadline_timer m_step_timer;
+    std::vector<std::function<bool ()> > m_steps;
+    size_t m_step_num;  // m_steps and those running
+    bool m_step_armed;
+    boost::mutex m_step_mutex;
 };
 
 
@@ -18,6 +18,7 @@
 #ifndef MSGPACK_RPC_MESSAGE_SENDABLE_H__
 #define MSGPACK_RPC_MESSAGE_SENDABLE_H__
 
+#include "send_buffer.h"
 #include "types.h"
 
 #include <memory>
@@ -37,7 +38,14 @@ public:
     virtual ~message_sendable() { }
 
     virtual void send_data(sbuffer* sbuf) = 0;
+    virtual void send_data(send_buffer* buf) = 0;
     virtual void send_data(auto_vreflife vbuf) = 0;
+
+    // a part of a streamed response; senders that hold responses back to
+    // write them together write chunks right away instead
+    virtual void send_chunk(send_buffer* buf) {
+        send_data(buf);
+    }
 };
 
 typedef std::shared_ptr<message_sendable> shared_message_sendable;
@@ -0,0 +1,153 @@
+//
+// msgpack::rpc::priority - MessagePack-RPC for C++
+//
+// Copyright (C) 2009-2010 FURUHASHI Sadayuki
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+#include "priority.h"
+
+namespace msgpack {
+namespace rpc {
+
+
+void priority_map::set(const std::string& method, priority_t prio)
+{
+    boost::mutex::scoped_lock lk(m_mutex);
+    m_map[method] = prio;
+}
+
+priority_t priority_map::get(const std::string& method) const
+{
+    boost::mutex::scoped_lock lk(m_mutex);
+    std::map<std::string, priority_t>::const_iterator found = m_map.find(method);
+    if (found == m_map.end()) {
+        return PRIORITY_NORMAL;
+    }
+    return found->second;
+}
+
+priority_t priority_map::get(const object& method) const
+{
+    if (method.type == msgpack::type::STR) {
+        return get(std::string(method.via.str.ptr, method.via.str.size));
+    } else if (method.type == msgpack::type::BIN) {
+        return get(std::string(method.via.bin.ptr, method.via.bin.size));
+    }
+    return PRIORITY_NORMAL;
+}
+
+bool priority_map::empty() const
+{
+    boost::mutex::scoped_lock lk(m_mutex);
+    return m_map.empty();
+}
+
+
+lane_scheduler::lane_scheduler()
+{
+    for (size_t i = 0; i < PRIORITY_LANES; ++i) {
+        m_skipped[i] = 0;
+    }
+}
+
+size_t lane_scheduler::next(const size_t* waiting)
+{
+    size_t chosen = PRIORITY_LANES;
+    for (size_t i = 0; i < PRIORITY_LANES; ++i) {
+        if (waiting[i] > 0 && m_skipped[i] >= PRIORITY_AGING_LIMIT) {
+            chosen = i;
+            break;
+        }
+    }
+    if (chosen == PRIORITY_LANES) {
+        for (size_t i = 0; i < PRIORITY_LANES; ++i) {
+            if (waiting[i] > 0) {
+                chosen = i;
+                break;
+            }
+        }
+    }
+    assert(chosen < PRIORITY_LANES);
+
+    for (size_t i = 0; i < PRIORITY_LANES; ++i) {
+        if (waiting[i] > 0 && i != chosen) {
+            ++m_skipped[i];
+        }
+    }
+    m_skipped[chosen] = 0;
+    return chosen;
+}
+
+
+priority_gate::priority_gate() :
+    m_locked(false),
+    m_granted(false),
+    m_grant_lane(0),
+    m_grant_ticket(0)
+{
+    for (size_t i = 0; i < PRIORITY_LANES; ++i) {
+        m_waiting[i] = 0;
+        m_next_ticket[i] = 0;
+        m_next_grant[i] = 0;
+    }
+}
+
+bool priority_gate::has_waiters() const
+{
+    for (size_t i = 0; i < PRIORITY_LANES; ++i) {
+        if (m_waiting[i] > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void priority_gate::lock(priority_t prio)
+{
+    size_t lane = prio < PRIORITY_LANES ? prio : PRIORITY_LANES - 1;
+
+    boost::mutex::scoped_lock lk(m_mutex);
+    if (!m_locked && !m_granted && !has_waiters()) {
+        m_locked = true;
+        return;
+    }
+
+    uint64_t ticket = m_next_ticket[lane]++;
+    ++m_waiting[lane];
+    while (!(m_granted && m_grant_lane == lane && m_grant_ticket == ticket)) {
+        m_cond.wait(lk);
+    }
+    m_granted = false;
+    --m_waiting[lane];
+    m_locked = true;
+}
+
+void priority_gate::unlock()
+{
+    boost::mutex::scoped_lock lk(m_mutex);
+    m_locked = false;
+    if (!has_waiters()) {
+        return;
+    }
+
+    size_t lane = m_sched.next(m_waiting);
+    m_granted = true;
+    m_grant_lane = lane;
+    m_grant_ticket = m_next_grant[lane]++;
+    m_cond.notify_all();
+}
+
+
+}  // namespace rpc
+}  // namespace msgpack
@@ -0,0 +1,173 @@
+//
+// msgpack::rpc::priority - MessagePack-RPC for C++
+//
+// Copyright (C) 2009-2010 FURUHASHI Sadayuki
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+#ifndef MSGPACK_RPC_PRIORITY_H__
+#define MSGPACK_RPC_PRIORITY_H__
+
+#include "types.h"
+
+#include <boost/thread.hpp>
+#include <deque>
+#include <map>
+#include <string>
+
+namespace msgpack {
+namespace rpc {
+
+
+typedef unsigned int priority_t;
+
+static const priority_t PRIORITY_HIGH   = 0;
+static const priority_t PRIORITY_NORMAL = 1;
+static const priority_t PRIORITY_LOW    = 2;
+
+static const size_t PRIORITY_LANES = 3;
+
+// a lane with waiting work that was passed over this many times is
+// served next, so that low priority work cannot starve
+static const unsigned int PRIORITY_AGING_LIMIT = 8;
+
+
+// Maps method names to priority lanes. Unknown methods are PRIORITY_NORMAL.
+class priority_map
+{
+public:
+    priority_map() { }
+    ~priority_map() { }
+
+public:
+    void set(const std::string& method, priority_t prio);
+    priority_t get(const std::string& method) const;
+    priority_t get(const object& method) const;
+    bool empty() const;
+
+private:
+    std::map<std::string, priority_t> m_map;
+    mutable boost::mutex m_mutex;
+
+private:
+    priority_map(const priority_map&);
+};
+
+
+// Picks the lane to serve next: the highest lane with waiting work, unless
+// a lower lane has been passed over PRIORITY_AGING_LIMIT times.
+class lane_scheduler
+{
+public:
+    lane_scheduler();
+
+    // 'waiting' holds PRIORITY_LANES counts, at least one of them non-zero
+    size_t next(const size_t* waiting);
+
+private:
+    unsigned int m_skipped[PRIORITY_LANES];
+};
+
+
+// FIFO per lane, served by a lane_scheduler. Not thread safe.
+template <typename T>
+class lane_queue
+{
+public:
+    lane_queue() : m_waiting() { }
+
+    void push(priority_t prio, T v)
+    {
+        size_t lane = prio < PRIORITY_LANES ? prio : PRIORITY_LANES - 1;
+        m_lanes[lane].push_back(std::move(v));
+        ++m_waiting[lane];
+    }
+
+    bool pop(T* v)
+    {
+        if (empty()) {
+            return false;
+        }
+        size_t lane = m_sched.next(m_waiting);
+        *v = std::move(m_lanes[lane].front());
+        m_lanes[lane].pop_front();
+        --m_waiting[lane];
+        return true;
+    }
+
+    bool empty() const
+    {
+        for (size_t i = 0; i < PRIORITY_LANES; ++i) {
+            if (m_waiting[i] > 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    std::deque<T> m_lanes[PRIORITY_LANES];
+    size_t m_waiting[PRIORITY_LANES];
+    lane_scheduler m_sched;
+};
+
+
+// A mutex that hands itself over to waiters by lane instead of by arrival.
+// Waiters within a lane are served in arrival order.
+class priority_gate
+{
+public:
+    priority_gate();
+
+    void lock(priority_t prio);
+    void unlock();
+
+    class scoped_lock {
+    public:
+        scoped_lock(priority_gate& gate, priority_t prio) : m_gate(gate)
+            { m_gate.lock(prio); }
+        ~scoped_lock()
+            { m_gate.unlock(); }
+    private:
+        priority_gate& m_gate;
+    private:
+        scoped_lock(const scoped_lock&);
+    };
+
+private:
+    bool has_waiters() const;
+
+private:
+    boost::mutex m_mutex;
+    boost::condition_variable m_cond;
+    bool m_locked;
+
+    size_t m_waiting[PRIORITY_LANES];
+    uint64_t m_next_ticket[PRIORITY_LANES];
+    uint64_t m_next_grant[PRIORITY_LANES];
+    lane_scheduler m_sched;
+
+    // the waiter unlock() handed the gate to
+    bool m_granted;
+    size_t m_grant_lane;
+    uint64_t m_grant_ticket;
+
+private:
+    priority_gate(const priority_gate&);
+};
+
+
+}  // namespace rpc
+}  // namespace msgpack
+
+#endif /* msgpack/rpc/priority.h */
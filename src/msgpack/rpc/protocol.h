@@ -34,10 +34,18 @@ typedef uint8_t error_type_t;
 static const message_type_t REQUEST  = 0;
 static const message_type_t RESPONSE = 1;
 static const message_type_t NOTIFY   = 2;
+// one part of a streamed response, followed by more parts and at last by
+// the RESPONSE that ends the stream
+static const message_type_t RESPONSE_CHUNK = 3;
+// a request whose arguments go on in REQUEST_CHUNK messages with its
+// msgid, the last of them holding nil
+static const message_type_t STREAM_REQUEST = 4;
+static const message_type_t REQUEST_CHUNK  = 5;
 static const message_type_t UNKNOWN  = 0xff;
 
 static const error_type_t NO_METHOD_ERROR = 0x01;
 static const error_type_t ARGUMENT_ERROR  = 0x02;
+static const error_type_t OVERLOADED_ERROR = 0x03;
 
 template <typename T>
 struct tuple_type {
@@ -69,6 +77,9 @@ struct msg_rpc {
     bool is_notify()   const {
         return type == NOTIFY;
     }
+    bool is_response_chunk() const {
+        return type == RESPONSE_CHUNK;
+    }
     bool is_unknown()  const {
         return type == UNKNOWN;
     }
@@ -98,6 +109,65 @@ struct msg_request {
     MSGPACK_DEFINE(type, msgid, method, param);
 };
 
+// ext type of trace_context
+static const int8_t TRACE_EXT_TYPE = 0x54;
+
+// Trace id of a request, packed as an 8 byte big endian ext (see trace.h)
+struct trace_context {
+    trace_context() :
+        id(0) { }
+
+    trace_context(uint64_t id) :
+        id(id) { }
+
+    uint64_t id;
+
+    template <typename Packer>
+    void msgpack_pack(Packer& pk) const {
+        char buf[8];
+        for (int i = 0; i < 8; ++i) {
+            buf[i] = (char)(id >> (56 - 8 * i));
+        }
+        pk.pack_ext(sizeof(buf), TRACE_EXT_TYPE);
+        pk.pack_ext_body(buf, sizeof(buf));
+    }
+
+    void msgpack_unpack(msgpack::object o) {
+        id = 0;
+        if (o.type != msgpack::type::EXT || o.via.ext.type() != TRACE_EXT_TYPE ||
+                o.via.ext.size != 8) {
+            return;
+        }
+        const unsigned char* p = (const unsigned char*)o.via.ext.data();
+        for (int i = 0; i < 8; ++i) {
+            id = (id << 8) | p[i];
+        }
+    }
+};
+
+// msg_request with the caller's trace context as a fifth element
+template <typename Method, typename Parameter>
+struct msg_traced_request {
+    msg_traced_request(
+        Method method,
+        typename tuple_type<Parameter>::transparent_reference param,
+        msgid_t msgid,
+        uint64_t trace_id) :
+        type(REQUEST),
+        msgid(msgid),
+        method(method),
+        param(param),
+        trace(trace_id) { }
+
+    message_type_t type;
+    msgid_t msgid;
+    Method method;
+    Parameter param;
+    trace_context trace;
+
+    MSGPACK_DEFINE(type, msgid, method, param, trace);
+};
+
 template <typename Result, typename Error>
 struct msg_response {
     msg_response() :
@@ -121,6 +191,70 @@ struct msg_response {
     MSGPACK_DEFINE(type, msgid, error, result);
 };
 
+// msg_request of a call with streamed arguments
+template <typename Method, typename Parameter>
+struct msg_stream_request {
+    msg_stream_request() :
+        type(STREAM_REQUEST),
+        msgid(0) { }
+
+    msg_stream_request(
+        Method method,
+        typename tuple_type<Parameter>::transparent_reference param,
+        msgid_t msgid) :
+        type(STREAM_REQUEST),
+        msgid(msgid),
+        method(method),
+        param(param) { }
+
+    message_type_t type;
+    msgid_t msgid;
+    Method method;
+    Parameter param;
+
+    MSGPACK_DEFINE(type, msgid, method, param);
+};
+
+template <typename Chunk>
+struct msg_request_chunk {
+    msg_request_chunk() :
+        type(REQUEST_CHUNK),
+        msgid(0) { }
+
+    msg_request_chunk(
+        typename tuple_type<Chunk>::transparent_reference chunk,
+        msgid_t msgid) :
+        type(REQUEST_CHUNK),
+        msgid(msgid),
+        chunk(chunk) { }
+
+    message_type_t type;
+    msgid_t msgid;
+    Chunk chunk;
+
+    MSGPACK_DEFINE(type, msgid, chunk);
+};
+
+template <typename Chunk>
+struct msg_response_chunk {
+    msg_response_chunk() :
+        type(RESPONSE_CHUNK),
+        msgid(0) { }
+
+    msg_response_chunk(
+        typename tuple_type<Chunk>::transparent_reference chunk,
+        msgid_t msgid) :
+        type(RESPONSE_CHUNK),
+        msgid(msgid),
+        chunk(chunk) { }
+
+    message_type_t type;
+    msgid_t msgid;
+    Chunk chunk;
+
+    MSGPACK_DEFINE(type, msgid, chunk);
+};
+
 template <typename Method, typename Parameter>
 struct msg_notify {
     msg_notify() :
@@ -47,6 +47,16 @@ shared_future reqtable::take(msgid_t msgid)
     }
 }
 
+shared_future reqtable::find(msgid_t msgid) const
+{
+    req_mutex_t::scoped_lock lk(m_mutex);
+    req_map_t::const_iterator found = m_map.find(msgid);
+    if (found == m_map.end()) {
+        return shared_future();
+    }
+    return found->second;
+}
+
 void reqtable::take_all(std::vector<shared_future>* all)
 {
     req_mutex_t::scoped_lock lk(m_mutex);
@@ -75,6 +85,7 @@ void reqtable::step_timeout(std::vector<shared_future>* timedout)
 
 size_t reqtable::size() const
 {
+    req_mutex_t::scoped_lock lk(m_mutex);
     return m_map.size();
 }
 
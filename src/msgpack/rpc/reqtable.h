@@ -38,6 +38,7 @@ public:
     void insert(msgid_t msgid, shared_future f);
     void erase(msgid_t msgid);
     shared_future take(msgid_t msgid);
+    shared_future find(msgid_t msgid) const;
     void take_all(std::vector<shared_future>* all);
     void step_timeout(std::vector<shared_future>* timedout);
     size_t size() const;
@@ -46,7 +47,7 @@ private:
     typedef boost::unordered_map<msgid_t, shared_future> req_map_t;
     typedef boost::mutex req_mutex_t;
 
-    req_mutex_t m_mutex;
+    mutable req_mutex_t m_mutex;
     req_map_t m_map;
 };
 
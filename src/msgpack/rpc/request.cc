@@ -41,9 +41,9 @@ uint32_t request::get_msgid() const
     return m_pimpl->get_msgid();
 }
 
-void request::send_data(sbuffer* sbuf)
+void request::send_data(send_buffer* buf)
 {
-    m_pimpl->send_data(sbuf);
+    m_pimpl->send_data(buf);
 }
 
 void request::send_data(std::unique_ptr<with_shared_zone<vrefbuffer> > vbuf)
@@ -51,6 +51,35 @@ void request::send_data(std::unique_ptr<with_shared_zone<vrefbuffer> > vbuf)
     m_pimpl->send_data(std::move(vbuf));
 }
 
+void request::send_chunk(send_buffer* buf)
+{
+    m_pimpl->send_chunk(buf);
+}
+
+bool request::is_upload() const
+{
+    return m_pimpl->upload().get() != NULL;
+}
+
+bool request::next_chunk(object* chunk, auto_zone* z)
+{
+    shared_upload_reader upload = m_pimpl->upload();
+    if (!upload) {
+        return false;
+    }
+    return upload->next(chunk, z);
+}
+
+void request::on_chunk(std::function<void (object chunk, auto_zone z)> func)
+{
+    shared_upload_reader upload = m_pimpl->upload();
+    if (!upload) {
+        func(object(), auto_zone());
+        return;
+    }
+    upload->on_chunk(func);
+}
+
 auto_zone& request::zone()
 {
     return m_pimpl->zone();
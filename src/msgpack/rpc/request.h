@@ -19,9 +19,12 @@
 #define MSGPACK_RPC_REQUEST_H__
 
 #include "protocol.h"
+#include "send_buffer.h"
 #include "impl_fwd.h"
 #include "types.h"
 
+#include <functional>
+
 namespace msgpack {
 namespace rpc {
 
@@ -47,6 +50,28 @@ public:
 
     void result_nil();
 
+    // Streamed results: every stream_write() sends 'chunk' to the client
+    // right away, and finish() ends the stream. error() may end it too.
+    // The client reads the chunks with future::next_chunk().
+    template <typename Chunk>
+    void stream_write(const Chunk& chunk);
+
+    void finish();
+
+    // Streamed arguments, sent with session::call_upload(). next_chunk()
+    // waits for the next part and returns false at the end. It waits for
+    // the connection to read more, so call it from a thread other than the
+    // one that dispatched the request; there it throws std::logic_error
+    // rather than wait forever. on_chunk() instead passes every
+    // part to 'func' as it arrives, and a nil object at the end. Parts not
+    // taken yet hold back reading once they reach
+    // MSGPACK_RPC_UPLOAD_QUEUE_SIZE bytes on the connection.
+    bool is_upload() const;
+    bool next_chunk(object* chunk, auto_zone* z);
+    template <typename T>
+    bool next_chunk(T* chunk);
+    void on_chunk(std::function<void (object chunk, auto_zone z)> func);
+
     template <typename Error>
     void error(Error err);
 
@@ -79,8 +104,9 @@ private:
     bool is_sent() const;
 
     uint32_t get_msgid() const;
-    void send_data(sbuffer* sbuf);
+    void send_data(send_buffer* buf);
     void send_data(std::unique_ptr<with_shared_zone<vrefbuffer> > vbuf);
+    void send_chunk(send_buffer* buf);
 
 private:
     shared_request m_pimpl;
@@ -127,11 +153,11 @@ inline void request::call(Result& res, Error& err)
         return;
     }
 
-    msgpack::sbuffer sbuf;
+    send_buffer buf;
     msg_response<Result&, Error> msgres(res, err, get_msgid());
-    msgpack::pack(sbuf, msgres);
+    msgpack::pack(buf, msgres);
 
-    send_data(&sbuf);
+    send_data(&buf);
 }
 
 template <typename Result, typename Error>
@@ -160,7 +186,7 @@ template <typename Result>
 void request::result(Result res, auto_zone z)
 {
     msgpack::type::nil err;
-    shared_zone sz(z.release());
+    shared_zone sz(std::move(z));
     call(res, err, sz);
 }
 
@@ -178,6 +204,37 @@ inline void request::result_nil()
     call(res, err);
 }
 
+template <typename T>
+bool request::next_chunk(T* chunk)
+{
+    object obj;
+    auto_zone z;
+    if (!next_chunk(&obj, &z)) {
+        return false;
+    }
+    obj.convert(chunk);
+    return true;
+}
+
+template <typename Chunk>
+void request::stream_write(const Chunk& chunk)
+{
+    if (is_sent()) {
+        return;
+    }
+
+    send_buffer buf;
+    msg_response_chunk<const Chunk&> msgchunk(chunk, get_msgid());
+    msgpack::pack(buf, msgchunk);
+
+    send_chunk(&buf);
+}
+
+inline void request::finish()
+{
+    result_nil();
+}
+
 template <typename Error>
 void request::error(Error err)
 {
@@ -189,7 +246,7 @@ template <typename Error>
 void request::error(Error err, auto_zone z)
 {
     msgpack::type::nil res;
-    shared_zone sz(z.release());
+    shared_zone sz(std::move(z));
     call(res, err, sz);
 }
 
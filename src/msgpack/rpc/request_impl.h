@@ -18,8 +18,14 @@
 #ifndef MSGPACK_RPC_REQUEST_IMPL_H__
 #define MSGPACK_RPC_REQUEST_IMPL_H__
 
+#include "admission.h"
 #include "message_sendable.h"
 #include "request.h"
+#include "stats.h"
+#include "trace.h"
+#include "upload_reader.h"
+
+#include <chrono>
 
 namespace msgpack {
 namespace rpc {
@@ -31,9 +37,14 @@ public:
     request_impl(shared_message_sendable ms, msgid_t msgid,
                  object method, object params, auto_zone z) :
         m_ms(ms), m_msgid(msgid),
-        m_method(method), m_params(params), m_zone(std::move(z)) { }
+        m_method(method), m_params(params), m_zone(std::move(z)),
+        m_trace_id(0) { }
 
-    ~request_impl() { }
+    ~request_impl() {
+        if (m_upload) {
+            m_upload->discard();
+        }
+    }
 
     object method() {
         return m_method;
@@ -48,6 +59,35 @@ public:
         return m_msgid;
     }
 
+    uint64_t trace_id() const {
+        return m_trace_id;
+    }
+    void set_trace_id(uint64_t trace_id) {
+        m_trace_id = trace_id;
+    }
+
+    const shared_upload_reader& upload() const {
+        return m_upload;
+    }
+    void set_upload(shared_upload_reader upload) {
+        m_upload = upload;
+    }
+
+    // when the bytes holding the request were read, for admission
+    // control; unset for notifications
+    admission_controller::clock::time_point received() const {
+        return m_received;
+    }
+    void set_received(admission_controller::clock::time_point received) {
+        m_received = received;
+    }
+
+    // the response, whenever it is sent, is recorded in 'stats'
+    void start_timer(std::shared_ptr<latency_recorder> stats) {
+        m_stats = stats;
+        m_dispatched = std::chrono::steady_clock::now();
+    }
+
 public:
     bool is_sent() {
         return !m_ms;
@@ -58,17 +98,41 @@ public:
         if (!ms) {
             return;
         }
+        trace_point(m_trace_id, m_msgid, TRACE_CALL);
         ms->send_data(std::move(vbuf));
+        trace_point(m_trace_id, m_msgid, TRACE_RESPONSE_WRITE);
         m_ms.reset();
+        record_latency();
     }
 
-    void send_data(sbuffer* sbuf) {
+    void send_data(send_buffer* buf) {
         shared_message_sendable ms = m_ms;
         if (!ms) {
             return;
         }
-        ms->send_data(sbuf);
+        trace_point(m_trace_id, m_msgid, TRACE_CALL);
+        ms->send_data(buf);
+        trace_point(m_trace_id, m_msgid, TRACE_RESPONSE_WRITE);
         m_ms.reset();
+        record_latency();
+    }
+
+    // a part of a streamed response; the request stays open
+    void send_chunk(send_buffer* buf) {
+        shared_message_sendable ms = m_ms;
+        if (!ms) {
+            return;
+        }
+        ms->send_chunk(buf);
+    }
+
+private:
+    void record_latency() {
+        if (m_stats) {
+            m_stats->record(m_method,
+                std::chrono::duration_cast<std::chrono::microseconds>(
+                    std::chrono::steady_clock::now() - m_dispatched).count());
+        }
     }
 
 private:
@@ -79,6 +143,12 @@ private:
     object m_params;
     auto_zone m_zone;
 
+    std::shared_ptr<latency_recorder> m_stats;
+    std::chrono::steady_clock::time_point m_dispatched;
+    admission_controller::clock::time_point m_received;
+    uint64_t m_trace_id;
+    shared_upload_reader m_upload;  // streamed arguments, if any
+
 private:
     request_impl();
     request_impl(const request_impl&);
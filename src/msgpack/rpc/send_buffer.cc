@@ -0,0 +1,181 @@
+//
+// msgpack::rpc::send_buffer - MessagePack-RPC for C++
+//
+// Copyright (C) 2009-2010 FURUHASHI Sadayuki
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+#include "send_buffer.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+namespace msgpack {
+namespace rpc {
+
+
+#ifndef MSGPACK_RPC_SEND_CHUNK_CACHE
+#define MSGPACK_RPC_SEND_CHUNK_CACHE 64
+#endif
+
+struct send_chunk {
+    send_chunk* next;
+
+    char* data() { return (char*)(this + 1); }
+};
+
+// free chunks of one thread
+class send_chunk_cache {
+public:
+    send_chunk_cache() : m_head(NULL), m_count(0) { }
+
+    ~send_chunk_cache()
+    {
+        while (m_head) {
+            send_chunk* c = m_head;
+            m_head = c->next;
+            ::free(c);
+        }
+    }
+
+    send_chunk* get()
+    {
+        send_chunk* c = m_head;
+        if (c) {
+            m_head = c->next;
+            --m_count;
+            return c;
+        }
+        c = (send_chunk*)::malloc(sizeof(send_chunk) + MSGPACK_RPC_SEND_CHUNK_SIZE);
+        if (!c) {
+            throw std::bad_alloc();
+        }
+        return c;
+    }
+
+    void put(send_chunk* c)
+    {
+        if (m_count >= MSGPACK_RPC_SEND_CHUNK_CACHE) {
+            ::free(c);
+            return;
+        }
+        c->next = m_head;
+        m_head = c;
+        ++m_count;
+    }
+
+private:
+    send_chunk* m_head;
+    size_t m_count;
+};
+
+static send_chunk_cache& local_cache()
+{
+    static thread_local send_chunk_cache cache;
+    return cache;
+}
+
+
+send_buffer::send_buffer() :
+    m_chunks(NULL),
+    m_ptr(NULL),
+    m_free(0),
+    m_size(0),
+    m_vec(m_inline),
+    m_count(0)
+{
+}
+
+send_buffer::~send_buffer()
+{
+    clear();
+}
+
+void send_buffer::clear()
+{
+    if (m_chunks) {
+        send_chunk_cache& cache = local_cache();
+        while (m_chunks) {
+            send_chunk* c = m_chunks;
+            m_chunks = c->next;
+            cache.put(c);
+        }
+    }
+    m_ptr = NULL;
+    m_free = 0;
+    m_size = 0;
+    m_more.clear();
+    m_vec = m_inline;
+    m_count = 0;
+}
+
+void send_buffer::write(const char* buf, size_t len)
+{
+    if (len == 0) {
+        return;
+    }
+    if (len >= MSGPACK_RPC_SEND_REF_SIZE) {
+        push(buf, len);
+        return;
+    }
+
+    if (len > m_free) {
+        next_chunk();
+    }
+    memcpy(m_ptr, buf, len);
+    push(m_ptr, len);
+    m_ptr += len;
+    m_free -= len;
+}
+
+void send_buffer::next_chunk()
+{
+    send_chunk* c = local_cache().get();
+    c->next = m_chunks;
+    m_chunks = c;
+    m_ptr = c->data();
+    m_free = MSGPACK_RPC_SEND_CHUNK_SIZE;
+}
+
+void send_buffer::push(const char* buf, size_t len)
+{
+    m_size += len;
+
+    if (m_count > 0) {
+        struct iovec& last = m_vec[m_count - 1];
+        if ((const char*)last.iov_base + last.iov_len == buf) {
+            last.iov_len += len;
+            return;
+        }
+    }
+
+    struct iovec v;
+    v.iov_base = (void*)buf;
+    v.iov_len = len;
+
+    if (m_vec == m_inline) {
+        if (m_count < INLINE_VECTOR) {
+            m_inline[m_count++] = v;
+            return;
+        }
+        m_more.assign(m_inline, m_inline + m_count);
+    }
+    m_more.push_back(v);
+    m_vec = &m_more[0];
+    m_count = m_more.size();
+}
+
+
+}  // namespace rpc
+}  // namespace msgpack
@@ -0,0 +1,97 @@
+//
+// msgpack::rpc::send_buffer - MessagePack-RPC for C++
+//
+// Copyright (C) 2009-2010 FURUHASHI Sadayuki
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+#ifndef MSGPACK_RPC_SEND_BUFFER_H__
+#define MSGPACK_RPC_SEND_BUFFER_H__
+
+#include <stddef.h>
+#include <sys/uio.h>
+#include <vector>
+
+#ifndef MSGPACK_RPC_SEND_CHUNK_SIZE
+#define MSGPACK_RPC_SEND_CHUNK_SIZE (8*1024)
+#endif
+
+// blocks at least this large are referenced instead of copied
+#ifndef MSGPACK_RPC_SEND_REF_SIZE
+#define MSGPACK_RPC_SEND_REF_SIZE 1024
+#endif
+
+namespace msgpack {
+namespace rpc {
+
+
+struct send_chunk;
+
+// A msgpack stream for outgoing messages. Small writes are copied into
+// fixed size chunks taken from a pool kept by the calling thread, so the
+// buffer never grows by realloc and, once the pool is warm, allocates
+// nothing. Large blocks, such as string and binary bodies, are referenced
+// where they are.
+//
+// Sends are synchronous, so a send_buffer lives on the sender's stack and
+// only while the data it was packed from does; its chunks go back to the
+// pool when it is destroyed.
+class send_buffer
+{
+public:
+    send_buffer();
+    ~send_buffer();
+
+    void write(const char* buf, size_t len);
+
+    size_t size() const { return m_size; }
+
+    const struct iovec* vector() const { return m_vec; }
+    size_t vector_size() const { return m_count; }
+
+    // the vector as buffers of type B, e.g. boost::asio::const_buffer
+    template <typename B>
+    void to_buffers(std::vector<B>* out) const
+    {
+        out->clear();
+        for (size_t i = 0; i < m_count; ++i) {
+            out->push_back(B(m_vec[i].iov_base, m_vec[i].iov_len));
+        }
+    }
+
+    void clear();
+
+private:
+    void push(const char* buf, size_t len);
+    void next_chunk();
+
+    send_chunk* m_chunks;  // chunks in use, newest first
+    char* m_ptr;           // free space in the newest chunk
+    size_t m_free;
+    size_t m_size;
+
+    static const size_t INLINE_VECTOR = 16;
+    struct iovec m_inline[INLINE_VECTOR];
+    std::vector<struct iovec> m_more;  // once m_inline is full
+    struct iovec* m_vec;
+    size_t m_count;
+
+private:
+    send_buffer(const send_buffer&);
+};
+
+
+}  // namespace rpc
+}  // namespace msgpack
+
+#endif /* msgpack/rpc/send_buffer.h */
@@ -17,17 +17,21 @@
 //
 #include "server.h"
 #include "server_impl.h"
+#include "log.h"
 #include "request_impl.h"
+#include "trace.h"
 #include "transport.h"
 #include "transport/tcp.h"
 
+
 namespace msgpack {
 namespace rpc {
 
 
 server_impl::server_impl(const builder& b, loop lo) :
     session_pool_impl(b, lo),
-    m_dp()
+    m_dp(),
+    m_stats(new latency_recorder())
 { }
 
 server_impl::~server_impl()
@@ -71,18 +75,113 @@ int server_impl::get_connection_num() const
     return 0;
 }
 
+size_t server_impl::get_connection_memory() const
+{
+    if (m_stran.get())
+    {
+        return m_stran->get_connection_memory();
+    }
+
+    return 0;
+}
+
 int server_impl::get_request_num() const
 {
     return 0;  // works sync
 }
 
+void server_impl::set_admission_control(unsigned int target_ms, unsigned int interval_ms)
+{
+    m_admission.set_target(target_ms, interval_ms);
+}
+
+uint64_t server_impl::get_shed_request_num() const
+{
+    return m_admission.shed_count();
+}
+
+void server_impl::set_method_priority(const std::string& method, priority_t prio)
+{
+    m_priorities.set(method, prio);
+}
+
+latency_stats server_impl::get_stats() const
+{
+    return m_stats->snapshot();
+}
+
+void server_impl::dispatch(shared_request sr)
+{
+    if (m_priorities.empty()) {
+        // requests wait in the connection's read buffer, not here
+        dispatch_now(sr);
+        return;
+    }
+
+    {
+        boost::mutex::scoped_lock lk(m_dispatch_mutex);
+        m_dispatch_queue.push(m_priorities.get(sr->method()), sr);
+    }
+    // one task per queued request; each task takes whichever request is
+    // most urgent when it runs, not necessarily the one that posted it
+    get_loop()->submit(std::bind(&server_impl::dispatch_next, shared_from_this()));
+}
+
+void server_impl::dispatch_next()
+{
+    shared_request sr;
+    {
+        boost::mutex::scoped_lock lk(m_dispatch_mutex);
+        if (!m_dispatch_queue.pop(&sr)) {
+            return;
+        }
+    }
+    dispatch_now(sr);
+}
+
+void server_impl::dispatch_now(shared_request sr)
+{
+    // the delay admission control sees runs up to here, so that it covers
+    // the time spent in the priority lanes
+    if (sr->received() != admission_controller::clock::time_point() &&
+            !m_admission.admit(sr->received())) {
+        // answer without dispatching so that the client can fail fast
+        request(sr).error(OVERLOADED_ERROR);
+        return;
+    }
+
+    // a dispatcher that throws fails its request, whichever thread runs it
+    try {
+        sr->start_timer(m_stats);
+        trace_point(sr->trace_id(), sr->get_msgid(), TRACE_DISPATCH);
+        m_dp->dispatch(request(sr));
+    } catch (std::exception& e) {
+        MSGPACK_RPC_LOG(error) << "dispatch error: " << e.what();
+        request(sr).error(std::string(e.what()));
+    } catch (...) {
+        MSGPACK_RPC_LOG(error) << "dispatch error: unknown error";
+        request(sr).error(std::string("unknown error"));
+    }
+}
+
 void server_impl::on_request(
         shared_message_sendable ms, msgid_t msgid,
-        object method, object params, auto_zone z)
+        object method, object params, auto_zone z,
+        admission_controller::clock::time_point received,
+        uint64_t trace_id, shared_upload_reader upload)
 {
     shared_request sr(new request_impl(
             ms, msgid, method, params, std::move(z)));
-    m_dp->dispatch(request(sr));
+    sr->set_received(received);
+    if (upload) {
+        sr->set_upload(upload);
+    }
+    if (trace_id) {
+        trace_point(trace_id, msgid, TRACE_REQUEST_READ, received);
+        trace_point(trace_id, msgid, TRACE_REQUEST_MESSAGE);
+        sr->set_trace_id(trace_id);
+    }
+    dispatch(sr);
 }
 
 void server_impl::on_notify(
@@ -91,7 +190,7 @@ void server_impl::on_notify(
     shared_request sr(new request_impl(
             shared_message_sendable(), 0,
             method, params, std::move(z)));
-    m_dp->dispatch(request(sr));
+    dispatch(sr);
 }
 
 // SERVER
@@ -148,10 +247,35 @@ int server::get_connection_num() const
     return static_cast<server_impl*>(m_pimpl.get())->get_connection_num();
 }
 
+size_t server::get_connection_memory() const
+{
+    return static_cast<server_impl*>(m_pimpl.get())->get_connection_memory();
+}
+
 int server::get_request_num() const
 {
     return static_cast<server_impl*>(m_pimpl.get())->get_request_num();
 }
 
+void server::set_admission_control(unsigned int target_ms, unsigned int interval_ms)
+{
+    static_cast<server_impl*>(m_pimpl.get())->set_admission_control(target_ms, interval_ms);
+}
+
+uint64_t server::get_shed_request_num() const
+{
+    return static_cast<server_impl*>(m_pimpl.get())->get_shed_request_num();
+}
+
+void server::set_method_priority(const std::string& method, priority_t prio)
+{
+    static_cast<server_impl*>(m_pimpl.get())->set_method_priority(method, prio);
+}
+
+latency_stats server::get_stats() const
+{
+    return static_cast<server_impl*>(m_pimpl.get())->get_stats();
+}
+
 }  // namespace rpc
 }  // namespace msgpack
@@ -50,6 +50,28 @@ public:
     int get_connection_num() const;
     int get_request_num() const;
 
+    /// Bytes held by the accepted connections: their read buffers and the
+    /// responses and streamed arguments they have queued.
+    size_t get_connection_memory() const;
+
+    /// Shed requests with OVERLOADED_ERROR once the time they wait between
+    /// being read and being dispatched stays above 'target_ms' for longer
+    /// than 'interval_ms'. A target of 0, the default, disables shedding.
+    void set_admission_control(unsigned int target_ms, unsigned int interval_ms = 100);
+
+    /// Number of requests rejected by admission control
+    uint64_t get_shed_request_num() const;
+
+    /// Once any method has a priority, requests are no longer dispatched
+    /// inline by the connection that read them. They are queued by lane and
+    /// dispatched by the loop's workers, higher priority lanes first.
+    void set_method_priority(const std::string& method, priority_t prio);
+
+    /// Server-side latency of each method, from dispatch to the response
+    /// being written. Hides session_pool::get_stats(), which covers the
+    /// calls this server makes as a client.
+    latency_stats get_stats() const;
+
     class base;
 
 private:
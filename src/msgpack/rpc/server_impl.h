@@ -20,7 +20,9 @@
 
 #include "server.h"
 #include "address.h"
+#include "admission.h"
 #include "session_pool_impl.h"
+#include "upload_reader.h"
 
 #include <memory>
 
@@ -41,17 +43,40 @@ public:
 
     const address& get_local_endpoint() const;
     int get_connection_num() const;
+    size_t get_connection_memory() const;
     int get_request_num() const;
 
+    void set_admission_control(unsigned int target_ms, unsigned int interval_ms);
+    uint64_t get_shed_request_num() const;
+
+    void set_method_priority(const std::string& method, priority_t prio);
+
+    latency_stats get_stats() const;
+
 public:
     void on_request(shared_message_sendable ms, msgid_t msgid,
-            object method, object params, auto_zone z);
+            object method, object params, auto_zone z,
+            admission_controller::clock::time_point received,
+            uint64_t trace_id = 0,
+            shared_upload_reader upload = shared_upload_reader());
 
     void on_notify(object method, object params, auto_zone z);
 
+private:
+    void dispatch(shared_request sr);
+    void dispatch_next();
+    void dispatch_now(shared_request sr);
+
 private:
     std::shared_ptr<dispatcher> m_dp;
     std::unique_ptr<server_transport> m_stran;
+    admission_controller m_admission;
+    // shared with requests, which may outlive the server
+    std::shared_ptr<latency_recorder> m_stats;
+
+    priority_map m_priorities;
+    lane_queue<shared_request> m_dispatch_queue;
+    boost::mutex m_dispatch_mutex;
 
 private:
     server_impl(const server_impl&);
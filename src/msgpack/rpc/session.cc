@@ -20,76 +20,103 @@
 #include "atomic_ops.h"
 #include "exception_impl.h"
 #include "future_impl.h"
+#include "log.h"
 #include "request_impl.h"
 #include "session_impl.h"
+#include "trace.h"
 
-#include <boost/log/trivial.hpp>
+#include <stdexcept>
+#include <string.h>
 
 
 namespace msgpack {
 namespace rpc {
 
 
-session_impl::session_impl(const address& addr, loop lo) :
+session_impl::session_impl(const address& addr, loop lo,
+        std::shared_ptr<latency_recorder> stats) :
     m_addr(addr),
     m_loop(lo),
     m_msgid_rr(1),
     m_timeout(30),
-    m_step_timer(m_loop->io_service())
+    m_spin_usec(0),
+    m_yield_usec(0),
+    m_inline_io(false),
+    m_stepping(false),
+    m_stats(stats ? stats : std::make_shared<latency_recorder>())
 {
-    // TODO: We can improve performance here by only arming the
-    //       the step timer when there are actually any requests
-    //       to process. However, it will require some refactoring
-    //       of the request table and session impl code to avoid
-    //       race conditions.
-    arm_step_timer();
 }
 
 session_impl::~session_impl()
 {
-    disarm_step_timer();
 }
 
 void session_impl::build(const builder& b)
 {
     m_tran = b.build(this, m_addr);
     m_timeout = b.get_timeout();
+    m_inline_io = m_tran->is_inline_io();
 }
 
 shared_session
-session_impl::create(const builder& b, const address addr, loop lo)
+session_impl::create(const builder& b, const address addr, loop lo,
+        std::shared_ptr<latency_recorder> stats)
 {
-    shared_session s(new session_impl(addr, lo));
+    shared_session s(new session_impl(addr, lo, stats));
     s->build(b);
     return s;
 }
 
 future session_impl::send_request_impl(msgid_t msgid, std::string method,
-    sbuffer* sbuf)
+    send_buffer* buf, uint64_t trace_id)
 {
-    BOOST_LOG_TRIVIAL(debug) << "sending... msgid=" << msgid;
-    shared_future f(new future_impl(msgid, shared_from_this(), m_loop));
+    MSGPACK_RPC_LOG_SAMPLED(debug) << "sending... msgid=" << msgid;
+    trace_point(trace_id, msgid, TRACE_SEND_REQUEST);
+    shared_future f(new future_impl(msgid, method, shared_from_this(), m_loop, trace_id));
     m_reqtable.insert(msgid, f);
+    watch_timeouts();
 
-    m_tran->send_data(sbuf);
+    if (m_priorities.empty()) {
+        m_tran->send_data(buf);
+    } else {
+        m_tran->send_data(buf, m_priorities.get(method));
+    }
+    trace_point(trace_id, msgid, TRACE_REQUEST_WRITE);
+
+    if (m_inline_io && m_reqtable.size() > 1) {
+        // pipelined: replies go through the loop
+        m_tran->request_async_read();
+    }
     return future(method, f);
 }
 
 future session_impl::send_request_impl(msgid_t msgid, std::string method,
-    std::unique_ptr<with_shared_zone<vrefbuffer> > vbuf)
+    std::unique_ptr<with_shared_zone<vrefbuffer> > vbuf, uint64_t trace_id)
 {
-    BOOST_LOG_TRIVIAL(debug) << "sending... msgid=" <<  msgid;
+    MSGPACK_RPC_LOG_SAMPLED(debug) << "sending... msgid=" <<  msgid;
+    trace_point(trace_id, msgid, TRACE_SEND_REQUEST);
 
-    shared_future f(new future_impl(msgid, shared_from_this(), m_loop));
+    shared_future f(new future_impl(msgid, method, shared_from_this(), m_loop, trace_id));
     m_reqtable.insert(msgid, f);
+    watch_timeouts();
 
-    m_tran->send_data(std::move(vbuf));
+    if (m_priorities.empty()) {
+        m_tran->send_data(std::move(vbuf));
+    } else {
+        m_tran->send_data(std::move(vbuf), m_priorities.get(method));
+    }
+    trace_point(trace_id, msgid, TRACE_REQUEST_WRITE);
+
+    if (m_inline_io && m_reqtable.size() > 1) {
+        // pipelined: replies go through the loop
+        m_tran->request_async_read();
+    }
     return future(method, f);
 }
 
-void session_impl::send_notify_impl(sbuffer* sbuf)
+void session_impl::send_notify_impl(send_buffer* buf)
 {
-    m_tran->send_data(sbuf);
+    m_tran->send_data(buf);
 }
 
 void session_impl::send_notify_impl(auto_vreflife vbuf)
@@ -102,24 +129,26 @@ msgid_t session_impl::next_msgid()
     return atomic_increment(&m_msgid_rr);
 }
 
-void session_impl::arm_step_timer()
+void session_impl::watch_timeouts()
 {
-    m_step_timer.expires_from_now(boost::posix_time::seconds(1));
-    m_step_timer.async_wait(std::bind(
-            &session_impl::step_timer_handler, this, std::placeholders::_1));
+    if (m_stepping.load() || m_stepping.exchange(true)) {
+        return;
+    }
+    m_loop->add_step(std::bind(&session_impl::step,
+            weak_session(shared_from_this())));
 }
 
-void session_impl::disarm_step_timer()
+bool session_impl::step(weak_session ws)
 {
-    m_step_timer.cancel();
+    shared_session s = ws.lock();
+    if (!s) {
+        return false;
+    }
+    return s->step_timeout();
 }
 
-void session_impl::step_timer_handler(const boost::system::error_code& err)
+bool session_impl::step_timeout()
 {
-    if (err == boost::asio::error::operation_aborted) {
-        return;
-    }
-
     std::vector<shared_future> timedout;
     m_reqtable.step_timeout(&timedout);
     if (!timedout.empty()) {
@@ -128,17 +157,22 @@ void session_impl::step_timer_handler(const boost::system::error_code& err)
             shared_future& f = *it;
             f->set_result(object(), TIMEOUT_ERROR, auto_zone());
 #ifndef NDEBUG
-            BOOST_LOG_TRIVIAL(warning) << "timeout " << f->msgid();
+            MSGPACK_RPC_LOG(warning) << "timeout " << f->msgid();
 #endif
         }
     }
 
-    arm_step_timer();
-}
-
-void session_impl::step_timeout(std::vector<shared_future>* timedout)
-{
-    m_reqtable.step_timeout(timedout);
+    if (m_reqtable.size() > 0) {
+        return true;
+    }
+    // Idle: leave the timer. A request inserted before the check below
+    // is seen by it; one inserted after it finds m_stepping false and
+    // registers again.
+    m_stepping.store(false);
+    if (m_reqtable.size() > 0 && !m_stepping.exchange(true)) {
+        return true;
+    }
+    return false;
 }
 
 void session_impl::on_connect_failed()
@@ -165,17 +199,44 @@ void session_impl::on_system_error(const boost::system::error_code& err)
 }
 
 void session_impl::on_response(msgid_t msgid,
-                               object result, object error, auto_zone z)
+                               object result, object error, auto_zone z,
+                               trace_clock::time_point received)
 {
-    BOOST_LOG_TRIVIAL(debug) << "response msgid=" << msgid;
+    MSGPACK_RPC_LOG_SAMPLED(debug) << "response msgid=" << msgid;
     shared_future f = m_reqtable.take(msgid);
     if (!f) {
-        BOOST_LOG_TRIVIAL(error) << "no entry on request table for msgid=" << msgid;
+        MSGPACK_RPC_LOG(error) << "no entry on request table for msgid=" << msgid;
         return;
     }
+    if (f->trace_id()) {
+        trace_point(f->trace_id(), msgid, TRACE_RESPONSE_READ, received);
+        trace_point(f->trace_id(), msgid, TRACE_RESPONSE_MESSAGE);
+    }
     f->set_result(result, error, std::move(z));
 }
 
+void session_impl::on_response_chunk(msgid_t msgid, object chunk, auto_zone z,
+        size_t nbytes, const std::function<void (size_t)>& consumed)
+{
+    shared_future f = m_reqtable.find(msgid);
+    if (!f) {
+        MSGPACK_RPC_LOG(error) << "no entry on request table for msgid=" << msgid;
+        if (nbytes && consumed) {
+            consumed(nbytes);
+        }
+        return;
+    }
+    f->push_chunk(chunk, std::move(z), nbytes, consumed);
+}
+
+void session_impl::keep_alive(msgid_t msgid)
+{
+    shared_future f = m_reqtable.find(msgid);
+    if (f) {
+        f->keep_alive();
+    }
+}
+
 void session_impl::on_notify(object method, object params, auto_zone z)
 {
     // TODO
@@ -201,21 +262,36 @@ unsigned int session::get_timeout() const
     return m_pimpl->get_timeout();
 }
 
+void session::set_method_priority(const std::string& method, priority_t prio)
+{
+    m_pimpl->set_method_priority(method, prio);
+}
+
+void session::set_wait_spin(unsigned int spin_usec, unsigned int yield_usec)
+{
+    m_pimpl->set_wait_spin(spin_usec, yield_usec);
+}
+
+latency_stats session::get_stats() const
+{
+    return m_pimpl->get_stats();
+}
+
 future session::send_request_impl(msgid_t msgid, std::string method,
-    std::unique_ptr<with_shared_zone<vrefbuffer> > vbuf)
+    std::unique_ptr<with_shared_zone<vrefbuffer> > vbuf, uint64_t trace_id)
 {
-    return m_pimpl->send_request_impl(msgid, method, std::move(vbuf));
+    return m_pimpl->send_request_impl(msgid, method, std::move(vbuf), trace_id);
 }
 
 future session::send_request_impl(msgid_t msgid, std::string method,
-    sbuffer* sbuf)
+    send_buffer* buf, uint64_t trace_id)
 {
-    return m_pimpl->send_request_impl(msgid, method, sbuf);
+    return m_pimpl->send_request_impl(msgid, method, buf, trace_id);
 }
 
-void session::send_notify_impl(sbuffer* sbuf)
+void session::send_notify_impl(send_buffer* buf)
 {
-    return m_pimpl->send_notify_impl(sbuf);
+    return m_pimpl->send_notify_impl(buf);
 }
 
 void session::send_notify_impl(std::unique_ptr<with_shared_zone<vrefbuffer> > vbuf)
@@ -223,11 +299,76 @@ void session::send_notify_impl(std::unique_ptr<with_shared_zone<vrefbuffer> > vb
     return m_pimpl->send_notify_impl(std::move(vbuf));
 }
 
+prepared_call::prepared_call(const std::string& method, const char* body, size_t size) :
+    m_method(method),
+    m_life(new msgpack::zone(size)),
+    m_size(size)
+{
+    char* p = (char*)m_life->allocate_no_align(size);
+    memcpy(p, body, size);
+    m_body = p;
+}
+
+future session::call(const prepared_call& pc)
+{
+    if (!pc.m_life) {
+        throw std::invalid_argument("prepared_call is empty");
+    }
+
+    msgid_t msgid = next_msgid();
+    uint64_t trace_id = trace_next_id();
+
+    // [type, msgid, method, params(, trace)] with msgid always written as
+    // a 32 bit integer, so the header is the same 7 bytes on every call
+    uint32_t id = (uint32_t)msgid;
+    char head[7];
+    head[0] = (char)(trace_id ? 0x95 : 0x94);
+    head[1] = (char)REQUEST;
+    head[2] = (char)(msgid < 0 ? 0xd2 : 0xce);
+    head[3] = (char)(id >> 24);
+    head[4] = (char)(id >> 16);
+    head[5] = (char)(id >> 8);
+    head[6] = (char)id;
+
+    // the send is synchronous, so the buffer may reference the packed
+    // bytes of 'pc', which the caller holds, and nothing is allocated
+    send_buffer buf;
+    buf.write(head, sizeof(head));
+    buf.write(pc.m_body, pc.m_size);
+    if (trace_id) {
+        msgpack::pack(buf, trace_context(trace_id));
+    }
+    return send_request_impl(msgid, pc.m_method, &buf, trace_id);
+}
+
 msgid_t session::next_msgid()
 {
     return m_pimpl->next_msgid();
 }
 
+upload::upload(shared_session s, msgid_t msgid, future f) :
+    m_session(s),
+    m_msgid(msgid),
+    m_future(f)
+{
+}
+
+void upload::send_chunk(send_buffer* buf)
+{
+    if (!m_session) {
+        throw std::invalid_argument("upload is empty");
+    }
+    m_session->send_notify_impl(buf);
+    m_session->keep_alive(m_msgid);
+}
+
+future upload::finish()
+{
+    write(msgpack::type::nil());
+    m_session.reset();
+    return m_future;
+}
+
 
 }  // namespace rpc
 }  // namespace msgpack
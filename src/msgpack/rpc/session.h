@@ -21,15 +21,66 @@
 #include "types.h"
 #include "address.h"
 #include "protocol.h"
+#include "send_buffer.h"
 #include "exception.h"
 #include "loop.h"
 #include "caller.h"
 #include "impl_fwd.h"
+#include "priority.h"
+#include "stats.h"
+#include "trace.h"
 
 namespace msgpack {
 namespace rpc {
 
 
+/// A request whose method and params are packed once, by
+/// session::prepare(), and then sent any number of times with
+/// session::call(const prepared_call&). Copies share the packed bytes.
+class prepared_call {
+public:
+    prepared_call() : m_body(NULL), m_size(0) { }
+
+    const std::string& method() const { return m_method; }
+
+private:
+    prepared_call(const std::string& method, const char* body, size_t size);
+
+    std::string m_method;
+    shared_zone m_life;  // holds the packed method and params
+    const char* m_body;
+    size_t m_size;
+
+    friend class session;
+};
+
+
+/// The sending side of a call with streamed arguments, returned by
+/// session::call_upload(). write() sends a part right away; finish() ends
+/// the arguments and returns the call's future. Each write restarts the
+/// call's timeout.
+class upload {
+public:
+    upload() : m_msgid(0) { }
+
+    template <typename T>
+    void write(const T& chunk);
+
+    future finish();
+
+private:
+    upload(shared_session s, msgid_t msgid, future f);
+
+    void send_chunk(send_buffer* buf);
+
+    shared_session m_session;
+    msgid_t m_msgid;
+    future m_future;
+
+    friend class session;
+};
+
+
 class session : public caller<session>
 {
 public:
@@ -43,18 +94,56 @@ public:
     void set_timeout(unsigned int sec);
     unsigned int get_timeout() const;
 
+    /// Requests for 'method' are written ahead of lower priority requests
+    /// waiting on the same connection. Methods default to PRIORITY_NORMAL.
+    void set_method_priority(const std::string& method, priority_t prio);
+
+    /// Before future::get() blocks, busy-wait up to 'spin_usec' and then
+    /// yield the CPU for up to 'yield_usec' more. On fast links a round
+    /// trip can cost less than parking and waking the thread, at the price
+    /// of a busy core. Both default to 0, which blocks right away.
+    void set_wait_spin(unsigned int spin_usec, unsigned int yield_usec = 0);
+
+    /// Latency of each method, from sending the request to its future
+    /// completing, timeouts and errors included. A session of a pool
+    /// shares its recorder with the pool, and reports the whole pool.
+    latency_stats get_stats() const;
+
+    /// Packs 'method' and 'params', a tuple of the arguments, for
+    /// call(const prepared_call&). Each call then writes only the request
+    /// header with its msgid in front of the packed bytes, on the stack;
+    /// bytes of MSGPACK_RPC_SEND_REF_SIZE and up are sent by reference.
+    template <typename Parameter>
+    prepared_call prepare(const std::string& method, const Parameter& params);
+
+    using caller<session>::call;
+    future call(const prepared_call& pc);
+
+    /// Calls 'method' with 'params', a tuple of the arguments, and more
+    /// arguments to follow in parts through the returned upload. The
+    /// server reads them with request::next_chunk() or on_chunk(), and
+    /// may answer before they end. Streamed calls need a stream transport.
+    template <typename Parameter>
+    upload call_upload(const std::string& method, const Parameter& params);
+
 protected:
     template <typename Method, typename Parameter>
     future send_request(Method m, const Parameter& p, shared_zone msglife);
 
-    future send_request_impl(msgid_t msgid, std::string m, sbuffer* sbuf);
+    template <typename Method, typename Message>
+    future send_request_packed(msgid_t msgid, Method m, const Message& msgreq,
+                               shared_zone msglife, uint64_t trace_id);
+
+    future send_request_impl(msgid_t msgid, std::string m, send_buffer* buf,
+                             uint64_t trace_id);
     future send_request_impl(msgid_t msgid, std::string m,
-                             std::unique_ptr<with_shared_zone<vrefbuffer> > vbuf);
+                             std::unique_ptr<with_shared_zone<vrefbuffer> > vbuf,
+                             uint64_t trace_id);
 
     template <typename Method, typename Parameter>
     void send_notify(Method m, const Parameter& p, shared_zone msglife);
 
-    void send_notify_impl(sbuffer* sbuf);
+    void send_notify_impl(send_buffer* buf);
     void send_notify_impl(std::unique_ptr<with_shared_zone<vrefbuffer> > vbuf);
 
     friend class caller<session>;
@@ -74,20 +163,66 @@ template <typename Method, typename Parameter>
 future session::send_request(Method m, const Parameter& p, shared_zone msglife)
 {
     msgid_t msgid = next_msgid();
+
+    uint64_t trace_id = trace_next_id();
+    if (trace_id) {
+        msg_traced_request<Method, Parameter> msgreq(m, p, msgid, trace_id);
+        return send_request_packed(msgid, m, msgreq, msglife, trace_id);
+    }
+
     msg_request<Method, Parameter> msgreq(m, p, msgid);
+    return send_request_packed(msgid, m, msgreq, msglife, 0);
+}
 
+template <typename Method, typename Message>
+future session::send_request_packed(msgid_t msgid, Method m, const Message& msgreq,
+                                    shared_zone msglife, uint64_t trace_id)
+{
     if (msglife) {
         std::unique_ptr<with_shared_zone<vrefbuffer> > vbuf(
             new with_shared_zone<vrefbuffer>(msglife));
         msgpack::pack(*vbuf, msgreq);
-        return send_request_impl(msgid, m, std::move(vbuf));
+        return send_request_impl(msgid, m, std::move(vbuf), trace_id);
     } else {
-        msgpack::sbuffer sbuf;
-        msgpack::pack(sbuf, msgreq);
-        return send_request_impl(msgid, m, &sbuf);
+        send_buffer buf;
+        msgpack::pack(buf, msgreq);
+        return send_request_impl(msgid, m, &buf, trace_id);
     }
 }
 
+template <typename Parameter>
+prepared_call session::prepare(const std::string& method, const Parameter& params)
+{
+    msgpack::sbuffer sbuf;
+    msgpack::packer<msgpack::sbuffer> pk(&sbuf);
+    pk.pack(method);
+    pk.pack(params);
+    return prepared_call(method, sbuf.data(), sbuf.size());
+}
+
+template <typename Parameter>
+upload session::call_upload(const std::string& method, const Parameter& params)
+{
+    msgid_t msgid = next_msgid();
+
+    send_buffer buf;
+    msg_stream_request<const std::string&, const Parameter&> msgreq(
+            method, params, msgid);
+    msgpack::pack(buf, msgreq);
+
+    future f = send_request_impl(msgid, method, &buf, 0);
+    return upload(m_pimpl, msgid, f);
+}
+
+template <typename T>
+void upload::write(const T& chunk)
+{
+    send_buffer buf;
+    msg_request_chunk<const T&> msgchunk(chunk, m_msgid);
+    msgpack::pack(buf, msgchunk);
+    send_chunk(&buf);
+}
+
 template <typename Method, typename Parameter>
 void session::send_notify(Method m, const Parameter& p, shared_zone msglife)
 {
@@ -99,9 +234,9 @@ void session::send_notify(Method m, const Parameter& p, shared_zone msglife)
         msgpack::pack(*vbuf, msgreq);
         return send_notify_impl(std::move(vbuf));
     } else {
-        msgpack::sbuffer sbuf;
-        msgpack::pack(sbuf, msgreq);
-        return send_notify_impl(&sbuf);
+        send_buffer buf;
+        msgpack::pack(buf, msgreq);
+        return send_notify_impl(&buf);
     }
 }
 
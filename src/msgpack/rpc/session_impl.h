@@ -24,7 +24,7 @@
 #include "transport_impl.h"
 #include "impl_fwd.h"
 
-#include <boost/asio/deadline_timer.hpp>
+#include <atomic>
 #include <memory>
 
 namespace msgpack {
@@ -34,12 +34,15 @@ namespace rpc {
 class session_impl : public std::enable_shared_from_this<session_impl>
 {
 public:
-    static shared_session create(const builder& b, const address addr, loop lo);
+    // 'stats' is shared by the sessions of a pool; NULL makes one of its own
+    static shared_session create(const builder& b, const address addr, loop lo,
+            std::shared_ptr<latency_recorder> stats = std::shared_ptr<latency_recorder>());
 
     ~session_impl();
 
 private:
-    session_impl(const address& addr, loop lo);
+    session_impl(const address& addr, loop lo,
+            std::shared_ptr<latency_recorder> stats);
     void build(const builder& b);
 
 public:
@@ -59,27 +62,81 @@ public:
         return m_timeout;
     }
 
+    void set_method_priority(const std::string& method, priority_t prio) {
+        m_priorities.set(method, prio);
+    }
+
+    void set_wait_spin(unsigned int spin_usec, unsigned int yield_usec) {
+        m_spin_usec = spin_usec;
+        m_yield_usec = yield_usec;
+    }
+
+    unsigned int get_spin_usec() const {
+        return m_spin_usec;
+    }
+
+    unsigned int get_yield_usec() const {
+        return m_yield_usec;
+    }
+
+    bool is_inline_io() const {
+        return m_inline_io;
+    }
+
+    bool has_pending_requests() const {
+        return m_reqtable.size() > 0;
+    }
+
+    bool read_inline(std::function<bool ()> done, unsigned int timeout_ms) {
+        return m_tran->read_inline(done, timeout_ms);
+    }
+
+    void request_async_read() {
+        m_tran->request_async_read();
+    }
+
+    void record_latency(const std::string& method, uint64_t usec) {
+        m_stats->record(method, usec);
+    }
+
+    latency_stats get_stats() const {
+        return m_stats->snapshot();
+    }
+
     msgid_t next_msgid();
 
 public:
-    future send_request_impl(msgid_t msgid, std::string m, sbuffer* sbuf);
-    future send_request_impl(msgid_t msgid, std::string m, auto_vreflife vbuf);
+    future send_request_impl(msgid_t msgid, std::string m, send_buffer* buf,
+                             uint64_t trace_id);
+    future send_request_impl(msgid_t msgid, std::string m, auto_vreflife vbuf,
+                             uint64_t trace_id);
 
-    void send_notify_impl(sbuffer* sbuf);
+    void send_notify_impl(send_buffer* buf);
     void send_notify_impl(auto_vreflife vbuf);
 
+    // the request of 'msgid' is still going on, see future_impl::keep_alive()
+    void keep_alive(msgid_t msgid);
+
 public:
     void on_notify(object method, object params, auto_zone z);
-    void on_response(msgid_t msgid, object result, object error, auto_zone z);
+    // 'received' is when the bytes holding the response were read
+    void on_response(msgid_t msgid, object result, object error, auto_zone z,
+                     trace_clock::time_point received = trace_clock::time_point());
+    // 'consumed' is called with 'nbytes' once the chunk is taken or dropped
+    void on_response_chunk(msgid_t msgid, object chunk, auto_zone z,
+                           size_t nbytes = 0,
+                           const std::function<void (size_t)>& consumed =
+                               std::function<void (size_t)>());
 
     void on_connect_failed();
     void on_system_error(const boost::system::error_code& err);
 
 private:
-    void arm_step_timer();
-    void disarm_step_timer();
-    void step_timer_handler(const boost::system::error_code& err);
-    void step_timeout(std::vector<shared_future>* timedout);
+    // Timeouts are counted by the loop's step timer, which the session is
+    // registered with while m_reqtable has requests.
+    void watch_timeouts();
+    static bool step(weak_session ws);
+    bool step_timeout();
 
 private:
     address m_addr;
@@ -92,7 +149,13 @@ private:
     reqtable m_reqtable;
 
     unsigned int m_timeout;
-    boost::asio::deadline_timer m_step_timer;
+    unsigned int m_spin_usec;
+    unsigned int m_yield_usec;
+    bool m_inline_io;
+    std::atomic<bool> m_stepping;  // registered with the step timer
+
+    priority_map m_priorities;
+    std::shared_ptr<latency_recorder> m_stats;  // may be shared by a pool
 
 private:
     session_impl();
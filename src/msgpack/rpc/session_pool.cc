@@ -22,6 +22,7 @@
 #include "exception_impl.h"
 #include "transport/tcp.h"
 
+#include <boost/functional/hash.hpp>
 #include <functional>
 
 namespace msgpack {
@@ -30,35 +31,112 @@ namespace rpc {
 
 static const unsigned int SESSION_POOL_TIME_LIMIT = 60;
 
+static std::atomic<uint64_t> s_pool_id(0);
+
 
 session_pool_impl::session_pool_impl(const builder& b, loop lo) :
     m_loop(lo),
+    m_id(++s_pool_id),
+    m_step(0),
+    m_next_shard(0),
+    m_size(0),
+    m_stepping(false),
+    m_step_guard(new step_guard()),
     m_builder(b.copy()),
-    m_step_timer(m_loop->io_service())
+    m_stats(new latency_recorder())
 {
-    arm_step_timer();
+    m_step_guard->pool = this;
 }
 
 session_pool_impl::~session_pool_impl()
 {
-    disarm_step_timer();
+    // waits for a step that is running
+    boost::mutex::scoped_lock lk(m_step_guard->mutex);
+    m_step_guard->pool = NULL;
+}
+
+size_t session_pool_impl::shard_index(const address& addr)
+{
+    return boost::hash<address>()(addr) % SHARDS;
+}
+
+const session_pool_impl::table_t* session_pool_impl::local_snapshot(size_t index)
+{
+    // (pool id, shard) -> the snapshot this thread read last, kept alive
+    // by the cache itself. Ids are never reused, and entries of destroyed
+    // pools expire and are pruned.
+    struct cached {
+        uint64_t version;
+        std::shared_ptr<const table_t> snapshot;
+        std::weak_ptr<step_guard> alive;
+    };
+    typedef boost::unordered_map<uint64_t, cached> cache_t;
+    static thread_local cache_t cache;
+
+    shard& sh = m_shards[index];
+    uint64_t key = m_id * SHARDS + index;
+    uint64_t version = sh.version.load(std::memory_order_acquire);
+
+    cache_t::iterator it = cache.find(key);
+    if (it != cache.end() && it->second.version == version) {
+        return it->second.snapshot.get();
+    }
+
+    if (it == cache.end()) {
+        for (it = cache.begin(); it != cache.end(); ) {
+            if (it->second.alive.expired()) {
+                it = cache.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    cached& c = cache[key];
+    {
+        boost::mutex::scoped_lock lk(sh.mutex);
+        c.snapshot = sh.snapshot;
+        c.version = sh.version.load(std::memory_order_relaxed);
+    }
+    c.alive = m_step_guard;
+    return c.snapshot.get();
 }
 
 session session_pool_impl::get_session(const address& addr)
 {
-    boost::mutex::scoped_lock lk(m_table_mutex);
+    size_t index = shard_index(addr);
+    unsigned int now = m_step.load(std::memory_order_relaxed);
+
+    const table_t* snapshot = local_snapshot(index);
+    table_t::const_iterator found = snapshot->find(addr);
+    if (found != snapshot->end()) {
+        shared_session s = found->second->session.lock();
+        if (s) {
+            found->second->touch(now);
+            return session(s);
+        }
+    }
 
-    std::map<address, entry_t>::iterator found;
-    found = m_table.find(addr);
-    if (found != m_table.end()) {
-        found->second.ttl = SESSION_POOL_TIME_LIMIT;
-        return session(found->second.session);
+    shard& sh = m_shards[index];
+    boost::mutex::scoped_lock lk(sh.mutex);
+    boost::unordered_map<address, shared_session>::iterator owned =
+        sh.owned.find(addr);
+    if (owned != sh.owned.end()) {
+        // made by another thread since the snapshot was taken
+        sh.snapshot->find(addr)->second->touch(now);
+        return session(owned->second);
     }
 
-    shared_session s = session_impl::create(*m_builder, addr, m_loop);
-    m_table.insert(std::pair<address, entry_t>
-        (addr, entry_t(s, SESSION_POOL_TIME_LIMIT)));
+    shared_session s = session_impl::create(*m_builder, addr, m_loop, m_stats);
+    sh.owned.insert(std::make_pair(addr, s));
+    std::shared_ptr<table_t> next(new table_t(*sh.snapshot));
+    next->insert(table_t::value_type(addr, std::make_shared<entry_t>(s, now)));
+    sh.snapshot = next;
+    sh.version.fetch_add(1, std::memory_order_release);
+    ++m_size;
+    lk.unlock();
 
+    watch_idle();
     return session(s);
 }
 
@@ -67,44 +145,79 @@ void session_pool_impl::set_timeout(unsigned int sec)
     m_builder->set_timeout(sec);
 }
 
-void session_pool_impl::arm_step_timer()
+latency_stats session_pool_impl::get_stats()
 {
-    m_step_timer.expires_from_now(boost::posix_time::seconds(1));
-    m_step_timer.async_wait(std::bind(
-            &session_pool_impl::step_timer_handler, this, std::placeholders::_1));
+    return m_stats->snapshot();
 }
 
-void session_pool_impl::disarm_step_timer()
+void session_pool_impl::watch_idle()
 {
-    m_step_timer.cancel();
+    if (m_stepping.load() || m_stepping.exchange(true)) {
+        return;
+    }
+    m_loop->add_step(std::bind(&session_pool_impl::step, m_step_guard));
 }
 
-void session_pool_impl::step_timer_handler(const boost::system::error_code& err)
+bool session_pool_impl::step(std::shared_ptr<step_guard> guard)
 {
-    if (err == boost::asio::error::operation_aborted) {
-        return;
+    boost::mutex::scoped_lock lk(guard->mutex);
+    if (!guard->pool) {
+        return false;
+    }
+    return guard->pool->step_idle();
+}
+
+bool session_pool_impl::step_idle()
+{
+    unsigned int now = m_step.fetch_add(1, std::memory_order_relaxed) + 1;
+
+    // each shard is looked at every SHARDS steps, well within the limit
+    evict_idle(m_shards[m_next_shard], now);
+    m_next_shard = (m_next_shard + 1) % SHARDS;
+
+    if (m_size.load() > 0) {
+        return true;
     }
+    // empty: leave the timer until the next session is made
+    m_stepping.store(false);
+    return m_size.load() > 0 && !m_stepping.exchange(true);
+}
 
-    boost::mutex::scoped_lock lk(m_table_mutex);
-    std::vector<shared_future> timedout;
-
-    std::map<address, entry_t>::iterator it = m_table.begin();
-    while (it != m_table.end()) {
-        entry_t& e = it->second;
-        if (e.session.unique()) {
-            // There are no contexts that references the session.
-            if (e.ttl <= 0) {
-                // If e.session.unique() is true, m_pimpl->m_reqtable is empty
-                // because it contains futures that references a session.
-                m_table.erase(it++);
-                continue;
+void session_pool_impl::evict_idle(shard& sh, unsigned int now)
+{
+    // Only the shard owns its sessions, so one that is unique() is not in
+    // use: m_reqtable of the session is empty, because the futures in it
+    // reference the session. A reader may still take it from a snapshot
+    // meanwhile; it then keeps using it outside the pool, and the next
+    // lookup makes a new one.
+    std::vector<shared_session> evicted;
+    boost::mutex::scoped_lock lk(sh.mutex);
+    std::shared_ptr<table_t> next;
+    boost::unordered_map<address, shared_session>::iterator it = sh.owned.begin();
+    while (it != sh.owned.end()) {
+        entry_t& e = *sh.snapshot->find(it->first)->second;
+        if (!it->second.unique()) {
+            // still referenced somewhere: idle time starts once it is not
+            e.touch(now);
+            ++it;
+        } else if (now - e.used.load(std::memory_order_relaxed) >= SESSION_POOL_TIME_LIMIT) {
+            if (!next) {
+                next.reset(new table_t(*sh.snapshot));
             }
-            --e.ttl;
+            next->erase(it->first);
+            evicted.push_back(it->second);
+            it = sh.owned.erase(it);
+            --m_size;
+        } else {
+            ++it;
         }
-        ++it;
     }
-
-    arm_step_timer();
+    if (next) {
+        sh.snapshot = next;
+        sh.version.fetch_add(1, std::memory_order_release);
+    }
+    lk.unlock();
+    // the sessions close here, without the lock
 }
 
 // session pool
@@ -187,5 +300,10 @@ void session_pool::set_timeout(unsigned int sec)
     return m_pimpl->set_timeout(sec);
 }
 
+latency_stats session_pool::get_stats()
+{
+    return m_pimpl->get_stats();
+}
+
 }  // namespace rpc
 }  // namespace msgpack
@@ -22,6 +22,7 @@
 #include "address.h"
 #include "transport.h"
 #include "impl_fwd.h"
+#include "stats.h"
 #include "types.h"
 #include <string>
 
@@ -51,6 +52,10 @@ public:
     bool is_running();
     void set_timeout(unsigned int sec);
 
+    /// Client-side latency of each method over the sessions in the pool,
+    /// including those that have been dropped from it.
+    latency_stats get_stats();
+
 protected:
     session_pool(shared_session_pool pimpl);
     shared_session_pool m_pimpl;
@@ -21,8 +21,9 @@
 #include "session_pool.h"
 #include "transport_impl.h"
 
-#include <boost/asio/deadline_timer.hpp>
+#include <atomic>
 #include <boost/thread.hpp>
+#include <boost/unordered_map.hpp>
 #include <memory>
 
 namespace msgpack {
@@ -42,25 +43,68 @@ public:
         { return m_loop; }
 
 public:
-    void arm_step_timer();
-    void disarm_step_timer();
-    void step_timer_handler(const boost::system::error_code& err);
     void set_timeout(unsigned int sec);
+    latency_stats get_stats();
 
 private:
+    // 'used' is the step at which the session was last handed out or seen
+    // in use; readers refresh it without a lock
     struct entry_t {
-        shared_session session;
-        unsigned int ttl;
-        entry_t(const shared_session &s, unsigned int c) :
-            session(s), ttl(c)
+        weak_session session;
+        std::atomic<unsigned int> used;
+        entry_t(const shared_session &s, unsigned int now) :
+            session(s), used(now)
         { }
+        void touch(unsigned int now) {
+            // skip the store, and the cache line it dirties, within a step
+            if (used.load(std::memory_order_relaxed) != now) {
+                used.store(now, std::memory_order_relaxed);
+            }
+        }
     };
+    typedef boost::unordered_map<address, std::shared_ptr<entry_t> > table_t;
+
+    // Sessions are spread over shards by address. A shard owns its
+    // sessions in 'owned', changed under 'mutex'. Lookups read 'snapshot'
+    // instead, an immutable table that holds the sessions weakly and is
+    // replaced, with 'version' bumped, on every change. Each thread keeps
+    // the snapshot it last read and takes the lock only to fetch a newer
+    // one, so hits neither lock nor write anything shared but the
+    // session's reference count. Every step of the timer looks for idle
+    // sessions in one shard only.
+    static const size_t SHARDS = 16;
+    struct shard {
+        boost::mutex mutex;
+        boost::unordered_map<address, shared_session> owned;
+        std::shared_ptr<const table_t> snapshot;
+        std::atomic<uint64_t> version;
+        shard() : snapshot(new table_t()), version(0) { }
+    };
+    static size_t shard_index(const address& addr);
+    const table_t* local_snapshot(size_t index);
+    void evict_idle(shard& sh, unsigned int now);
+
+    // The pool is registered with the loop's step timer while it has
+    // sessions. The step reaches the pool through the guard, which the
+    // destructor clears.
+    struct step_guard {
+        boost::mutex mutex;
+        session_pool_impl* pool;
+    };
+    void watch_idle();
+    static bool step(std::shared_ptr<step_guard> guard);
+    bool step_idle();
 
     loop m_loop;
-    std::map<address, entry_t> m_table;
-    boost::mutex m_table_mutex;
+    uint64_t m_id;  // tells the pool's snapshots apart in thread caches
+    shard m_shards[SHARDS];
+    std::atomic<unsigned int> m_step;  // steps taken while it had sessions
+    size_t m_next_shard;               // the next to look at for idle sessions
+    std::atomic<size_t> m_size;        // sessions in all shards
+    std::atomic<bool> m_stepping;
+    std::shared_ptr<step_guard> m_step_guard;
     std::unique_ptr<builder> m_builder;
-    boost::asio::deadline_timer m_step_timer;
+    std::shared_ptr<latency_recorder> m_stats;  // shared by the sessions
 
 private:
     session_pool_impl(const session_pool_impl&);
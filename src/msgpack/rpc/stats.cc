@@ -0,0 +1,275 @@
+//
+// msgpack::rpc::stats - MessagePack-RPC for C++
+//
+// Copyright (C) 2009-2010 FURUHASHI Sadayuki
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+#include "stats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <string.h>
+
+namespace msgpack {
+namespace rpc {
+
+
+latency_histogram::latency_histogram()
+{
+    clear();
+}
+
+void latency_histogram::clear()
+{
+    memset(m_counts, 0, sizeof(m_counts));
+    m_count = 0;
+    m_sum = 0;
+    m_min = 0;
+    m_max = 0;
+}
+
+size_t latency_histogram::bucket_of(uint64_t usec)
+{
+    if (usec < LATENCY_SUB_BUCKETS) {
+        return usec;
+    }
+
+#if defined(__GNUC__)
+    unsigned int bits = 63 - __builtin_clzll(usec);
+#else
+    unsigned int bits = LATENCY_SUB_BITS;
+    while (bits < 63 && (usec >> (bits + 1)) != 0) {
+        ++bits;
+    }
+#endif
+    if (bits >= LATENCY_MAX_BITS) {
+        return LATENCY_BUCKETS - 1;
+    }
+    unsigned int shift = bits - LATENCY_SUB_BITS;
+    size_t sub = (usec >> shift) & (LATENCY_SUB_BUCKETS - 1);
+    return LATENCY_SUB_BUCKETS + shift * LATENCY_SUB_BUCKETS + sub;
+}
+
+uint64_t latency_histogram::bucket_upper(size_t b)
+{
+    if (b < LATENCY_SUB_BUCKETS) {
+        return b;
+    }
+    size_t shift = (b - LATENCY_SUB_BUCKETS) / LATENCY_SUB_BUCKETS;
+    uint64_t sub = (b - LATENCY_SUB_BUCKETS) % LATENCY_SUB_BUCKETS;
+    return ((LATENCY_SUB_BUCKETS + sub + 1) << shift) - 1;
+}
+
+void latency_histogram::record(uint64_t usec)
+{
+    ++m_counts[bucket_of(usec)];
+    if (m_count == 0 || usec < m_min) {
+        m_min = usec;
+    }
+    if (usec > m_max) {
+        m_max = usec;
+    }
+    ++m_count;
+    m_sum += usec;
+}
+
+void latency_histogram::merge(const latency_histogram& other)
+{
+    if (other.m_count == 0) {
+        return;
+    }
+    for (size_t i = 0; i < LATENCY_BUCKETS; ++i) {
+        m_counts[i] += other.m_counts[i];
+    }
+    if (m_count == 0 || other.m_min < m_min) {
+        m_min = other.m_min;
+    }
+    if (other.m_max > m_max) {
+        m_max = other.m_max;
+    }
+    m_count += other.m_count;
+    m_sum += other.m_sum;
+}
+
+double latency_histogram::mean() const
+{
+    return m_count ? (double)m_sum / m_count : 0.0;
+}
+
+uint64_t latency_histogram::percentile(double p) const
+{
+    if (m_count == 0) {
+        return 0;
+    }
+
+    uint64_t rank = (uint64_t)(p / 100.0 * m_count + 0.5);
+    rank = std::max<uint64_t>(1, std::min(rank, m_count));
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < LATENCY_BUCKETS; ++i) {
+        seen += m_counts[i];
+        if (seen >= rank) {
+            return std::min(bucket_upper(i), m_max);
+        }
+    }
+    return m_max;
+}
+
+
+static std::atomic<uint64_t> s_recorder_id(0);
+
+latency_recorder::latency_recorder() :
+    m_id(++s_recorder_id)
+{
+}
+
+latency_recorder::~latency_recorder()
+{
+}
+
+latency_recorder::shard* latency_recorder::local_shard()
+{
+    // recorder id -> this thread's shard of it. Ids are never reused, and
+    // entries of destroyed recorders expire and are pruned.
+    typedef std::map<uint64_t, std::pair<std::weak_ptr<shard>, shard*> > cache_t;
+    static thread_local cache_t cache;
+
+    cache_t::iterator it = cache.find(m_id);
+    if (it != cache.end()) {
+        // the recorder is alive while it records, and it owns the shard
+        return it->second.second;
+    }
+
+    for (it = cache.begin(); it != cache.end(); ) {
+        if (it->second.first.expired()) {
+            cache.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+
+    std::shared_ptr<shard> s(new shard());
+    {
+        boost::mutex::scoped_lock lk(m_mutex);
+        m_shards.push_back(s);
+    }
+    cache[m_id] = std::make_pair(std::weak_ptr<shard>(s), s.get());
+    return s.get();
+}
+
+// FNV-1a
+static uint64_t hash_method(const char* p, size_t len)
+{
+    uint64_t h = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (unsigned char)p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+void latency_recorder::record(const char* method, size_t len, uint64_t usec)
+{
+    shard* s = local_shard();
+    uint64_t key = hash_method(method, len);
+    boost::mutex::scoped_lock lk(s->mutex);
+    while (true) {
+        method_table::iterator it = s->methods.find(key);
+        if (it == s->methods.end()) {
+            if (!admit(method, len, key)) {
+                s->other.record(usec);
+                return;
+            }
+            method_entry& e = s->methods[key];
+            e.name.assign(method, len);
+            e.hist.record(usec);
+            return;
+        }
+        if (it->second.name.size() == len &&
+                memcmp(it->second.name.data(), method, len) == 0) {
+            it->second.hist.record(usec);
+            return;
+        }
+        ++key;
+    }
+}
+
+// the first time a thread sees a method: whether it gets a histogram of
+// its own. The names are counted over all the shards.
+bool latency_recorder::admit(const char* method, size_t len, uint64_t key)
+{
+    boost::mutex::scoped_lock lk(m_mutex);
+    while (true) {
+        boost::unordered_map<uint64_t, std::string>::iterator it =
+            m_names.find(key);
+        if (it == m_names.end()) {
+            break;
+        }
+        if (it->second.size() == len &&
+                memcmp(it->second.data(), method, len) == 0) {
+            return true;
+        }
+        ++key;
+    }
+    if (m_names.size() + 1 >= MSGPACK_RPC_LATENCY_METHODS) {
+        return false;
+    }
+    m_names[key].assign(method, len);
+    return true;
+}
+
+void latency_recorder::record(const object& method, uint64_t usec)
+{
+    if (method.type == msgpack::type::STR) {
+        record(method.via.str.ptr, method.via.str.size, usec);
+    } else if (method.type == msgpack::type::BIN) {
+        record(method.via.bin.ptr, method.via.bin.size, usec);
+    }
+}
+
+latency_stats latency_recorder::snapshot() const
+{
+    std::vector<std::shared_ptr<shard> > shards;
+    {
+        boost::mutex::scoped_lock lk(m_mutex);
+        shards = m_shards;
+    }
+
+    latency_stats merged;
+    for (size_t i = 0; i < shards.size(); ++i) {
+        boost::mutex::scoped_lock lk(shards[i]->mutex);
+        const method_table& methods = shards[i]->methods;
+        for (method_table::const_iterator it = methods.begin();
+                it != methods.end(); ++it) {
+            merged[it->second.name].merge(it->second.hist);
+        }
+        if (shards[i]->other.count()) {
+            merged["<other>"].merge(shards[i]->other);
+        }
+    }
+    return merged;
+}
+
+
+void merge_stats(latency_stats* to, const latency_stats& from)
+{
+    for (latency_stats::const_iterator it = from.begin();
+            it != from.end(); ++it) {
+        (*to)[it->first].merge(it->second);
+    }
+}
+
+
+}  // namespace rpc
+}  // namespace msgpack
@@ -0,0 +1,143 @@
+//
+// msgpack::rpc::stats - MessagePack-RPC for C++
+//
+// Copyright (C) 2009-2010 FURUHASHI Sadayuki
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+#ifndef MSGPACK_RPC_STATS_H__
+#define MSGPACK_RPC_STATS_H__
+
+#include "types.h"
+
+#include <boost/thread.hpp>
+#include <boost/unordered_map.hpp>
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace msgpack {
+namespace rpc {
+
+
+// methods a recorder keeps apart, "<other>" included
+#ifndef MSGPACK_RPC_LATENCY_METHODS
+#define MSGPACK_RPC_LATENCY_METHODS 256
+#endif
+
+
+// Latency histogram in microseconds, HDR style: values below
+// LATENCY_SUB_BUCKETS are counted exactly, above that every power of two
+// is split into LATENCY_SUB_BUCKETS buckets. Any percentile is off by at
+// most 1/LATENCY_SUB_BUCKETS of its value, at a fixed size.
+class latency_histogram
+{
+public:
+    static const unsigned int LATENCY_SUB_BITS = 4;
+    static const uint64_t LATENCY_SUB_BUCKETS = 1 << LATENCY_SUB_BITS;
+    // values are clamped to 2^40 usec, about 12 days
+    static const unsigned int LATENCY_MAX_BITS = 40;
+    static const size_t LATENCY_BUCKETS = LATENCY_SUB_BUCKETS +
+        (LATENCY_MAX_BITS - LATENCY_SUB_BITS) * LATENCY_SUB_BUCKETS;
+
+    latency_histogram();
+
+public:
+    void record(uint64_t usec);
+    void merge(const latency_histogram& other);
+    void clear();
+
+    uint64_t count() const { return m_count; }
+    uint64_t min() const { return m_count ? m_min : 0; }
+    uint64_t max() const { return m_max; }
+    double mean() const;
+
+    // 'p' in [0, 100]; returns the upper end of the bucket the value is in
+    uint64_t percentile(double p) const;
+
+private:
+    static size_t bucket_of(uint64_t usec);
+    static uint64_t bucket_upper(size_t b);
+
+    uint64_t m_counts[LATENCY_BUCKETS];
+    uint64_t m_count;
+    uint64_t m_sum;
+    uint64_t m_min;
+    uint64_t m_max;
+};
+
+
+// latency histogram of each method, by method name
+typedef std::map<std::string, latency_histogram> latency_stats;
+
+
+// Records latencies by method. Every thread records into its own shard,
+// so recording threads do not contend with each other; snapshot() merges
+// the shards. Methods are looked up by a hash of the name, so recording
+// allocates only the first time a thread sees a method. A histogram is
+// about 4.7 KB per thread and method: share one recorder among the
+// sessions of a pool rather than making one per session. Method names come
+// from the peer, so past MSGPACK_RPC_LATENCY_METHODS - 1 names the rest
+// are recorded together as "<other>".
+class latency_recorder
+{
+public:
+    latency_recorder();
+    ~latency_recorder();
+
+public:
+    void record(const char* method, size_t len, uint64_t usec);
+    void record(const std::string& method, uint64_t usec)
+        { record(method.data(), method.size(), usec); }
+    void record(const object& method, uint64_t usec);
+
+    latency_stats snapshot() const;
+
+private:
+    struct method_entry {
+        std::string name;
+        latency_histogram hist;
+    };
+    // by hash of the name; a colliding name takes the next free key
+    typedef boost::unordered_map<uint64_t, method_entry> method_table;
+
+    struct shard {
+        boost::mutex mutex;  // only contended by snapshot()
+        method_table methods;
+        latency_histogram other;
+    };
+
+    shard* local_shard();
+    bool admit(const char* method, size_t len, uint64_t key);
+
+    uint64_t m_id;
+    std::vector<std::shared_ptr<shard> > m_shards;
+    // names given a histogram, by hash like method_table
+    boost::unordered_map<uint64_t, std::string> m_names;
+    mutable boost::mutex m_mutex;
+
+private:
+    latency_recorder(const latency_recorder&);
+};
+
+
+// adds every histogram of 'from' into 'to'
+void merge_stats(latency_stats* to, const latency_stats& from);
+
+
+}  // namespace rpc
+}  // namespace msgpack
+
+#endif /* msgpack/rpc/stats.h */
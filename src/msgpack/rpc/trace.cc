@@ -0,0 +1,200 @@
+//
+// msgpack::rpc::trace - MessagePack-RPC for C++
+//
+// Copyright (C) 2009-2010 FURUHASHI Sadayuki
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <boost/thread.hpp>
+#include <memory>
+#include <unistd.h>
+
+namespace msgpack {
+namespace rpc {
+
+
+const char* trace_stage_name(trace_stage stage)
+{
+    switch (stage) {
+    case TRACE_SEND_REQUEST:     return "send_request";
+    case TRACE_REQUEST_WRITE:    return "request_write";
+    case TRACE_REQUEST_READ:     return "request_read";
+    case TRACE_REQUEST_MESSAGE:  return "request_message";
+    case TRACE_DISPATCH:         return "dispatch";
+    case TRACE_CALL:             return "call";
+    case TRACE_RESPONSE_WRITE:   return "response_write";
+    case TRACE_RESPONSE_READ:    return "response_read";
+    case TRACE_RESPONSE_MESSAGE: return "response_message";
+    case TRACE_SET_RESULT:       return "set_result";
+    }
+    return "unknown";
+}
+
+
+// Multi-producer ring. A writer claims a position with one fetch_add and
+// guards its slot with a sequence number, odd while it writes, so that
+// trace_dump() can drop slots it caught half written. Nothing blocks.
+class trace_ring
+{
+public:
+    trace_ring(size_t capacity) :
+        m_slots(new slot[capacity]),
+        m_mask(capacity - 1),
+        m_head(0)
+    {
+        for (size_t i = 0; i < capacity; ++i) {
+            m_slots[i].seq.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void push(const trace_event& ev)
+    {
+        uint64_t pos = m_head.fetch_add(1, std::memory_order_relaxed);
+        slot& s = m_slots[pos & m_mask];
+        s.seq.store(2 * pos + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        s.ev = ev;
+        s.seq.store(2 * pos + 2, std::memory_order_release);
+    }
+
+    void dump(std::vector<trace_event>* out) const
+    {
+        for (size_t i = 0; i <= m_mask; ++i) {
+            const slot& s = m_slots[i];
+            uint64_t before = s.seq.load(std::memory_order_acquire);
+            if (before == 0 || (before & 1)) {
+                continue;
+            }
+            trace_event ev = s.ev;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (s.seq.load(std::memory_order_relaxed) == before) {
+                out->push_back(ev);
+            }
+        }
+    }
+
+private:
+    struct slot {
+        std::atomic<uint64_t> seq;
+        trace_event ev;
+    };
+
+    std::unique_ptr<slot[]> m_slots;
+    size_t m_mask;
+    std::atomic<uint64_t> m_head;
+
+private:
+    trace_ring(const trace_ring&);
+};
+
+
+static std::atomic<trace_ring*> s_ring(NULL);
+static std::atomic<bool> s_enabled(false);
+static boost::mutex s_start_mutex;
+
+// ids are unique across processes with high probability: the upper half
+// is fixed per process, the lower half counts
+static std::atomic<uint64_t> s_next_id(0);
+
+void trace_start(size_t capacity)
+{
+    boost::mutex::scoped_lock lk(s_start_mutex);
+    if (!s_ring.load(std::memory_order_acquire)) {
+        size_t n = 1;
+        while (n < capacity) {
+            n <<= 1;
+        }
+        s_ring.store(new trace_ring(n), std::memory_order_release);
+
+        uint64_t seed = (uint64_t)trace_clock::now().time_since_epoch().count()
+            ^ ((uint64_t)getpid() << 16);
+        s_next_id.store(seed << 32, std::memory_order_relaxed);
+    }
+    s_enabled.store(true, std::memory_order_release);
+}
+
+void trace_stop()
+{
+    s_enabled.store(false, std::memory_order_release);
+}
+
+bool trace_enabled()
+{
+    return s_enabled.load(std::memory_order_relaxed);
+}
+
+uint64_t trace_next_id()
+{
+    if (!trace_enabled()) {
+        return 0;
+    }
+    uint64_t id = s_next_id.fetch_add(1, std::memory_order_relaxed) + 1;
+    return id ? id : 1;  // 0 means untraced
+}
+
+void trace_point(uint64_t trace_id, msgid_t msgid, trace_stage stage,
+                 trace_clock::time_point at)
+{
+    if (trace_id == 0 || !trace_enabled()) {
+        return;
+    }
+    trace_event ev;
+    ev.trace_id = trace_id;
+    ev.nsec = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            at.time_since_epoch()).count();
+    ev.msgid = msgid;
+    ev.stage = stage;
+    s_ring.load(std::memory_order_acquire)->push(ev);
+}
+
+void trace_point(uint64_t trace_id, msgid_t msgid, trace_stage stage)
+{
+    if (trace_id == 0 || !trace_enabled()) {
+        return;
+    }
+    trace_point(trace_id, msgid, stage, trace_clock::now());
+}
+
+static bool event_before(const trace_event& a, const trace_event& b)
+{
+    return a.nsec < b.nsec;
+}
+
+std::vector<trace_event> trace_dump()
+{
+    std::vector<trace_event> events;
+    trace_ring* ring = s_ring.load(std::memory_order_acquire);
+    if (ring) {
+        ring->dump(&events);
+        std::sort(events.begin(), events.end(), &event_before);
+    }
+    return events;
+}
+
+uint64_t trace_id_of(const object& msg)
+{
+    if (msg.type != msgpack::type::ARRAY || msg.via.array.size < 5) {
+        return 0;
+    }
+    trace_context ctx;
+    ctx.msgpack_unpack(msg.via.array.ptr[4]);
+    return ctx.id;
+}
+
+
+}  // namespace rpc
+}  // namespace msgpack
@@ -0,0 +1,90 @@
+//
+// msgpack::rpc::trace - MessagePack-RPC for C++
+//
+// Copyright (C) 2009-2010 FURUHASHI Sadayuki
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+#ifndef MSGPACK_RPC_TRACE_H__
+#define MSGPACK_RPC_TRACE_H__
+
+#include "protocol.h"
+
+#include <chrono>
+#include <stdint.h>
+#include <vector>
+
+namespace msgpack {
+namespace rpc {
+
+
+// Stages of a call, in the order a call goes through them. The client
+// records the SEND_REQUEST, REQUEST_WRITE, RESPONSE_* and SET_RESULT
+// stages, the server the rest.
+enum trace_stage {
+    TRACE_SEND_REQUEST,      // session::send_request_impl
+    TRACE_REQUEST_WRITE,     // request written to the transport
+    TRACE_REQUEST_READ,      // bytes holding the request read off the wire
+    TRACE_REQUEST_MESSAGE,   // request parsed, in on_message
+    TRACE_DISPATCH,          // handed to the dispatcher
+    TRACE_CALL,              // handler answered through request::result/error
+    TRACE_RESPONSE_WRITE,    // response written to the transport
+    TRACE_RESPONSE_READ,     // bytes holding the response read off the wire
+    TRACE_RESPONSE_MESSAGE,  // response parsed, in on_message
+    TRACE_SET_RESULT,        // future completed
+};
+
+const char* trace_stage_name(trace_stage stage);
+
+struct trace_event {
+    uint64_t trace_id;
+    uint64_t nsec;  // steady clock
+    msgid_t msgid;
+    trace_stage stage;
+};
+
+typedef std::chrono::steady_clock trace_clock;
+
+
+// Starts recording into a ring buffer of 'capacity' events, rounded up to
+// a power of two. Once full, the oldest events are overwritten. The buffer
+// is allocated by the first call and kept for the life of the process;
+// later calls reuse it whatever 'capacity' is.
+//
+// While tracing, every request carries its trace id as a fifth, ext typed
+// element, so that a server that traces as well records its stages under
+// the same id. Peers that read only four elements ignore it.
+void trace_start(size_t capacity = 65536);
+void trace_stop();
+bool trace_enabled();
+
+// A new trace id, or 0 while tracing is off
+uint64_t trace_next_id();
+
+// Does nothing for a trace id of 0
+void trace_point(uint64_t trace_id, msgid_t msgid, trace_stage stage);
+void trace_point(uint64_t trace_id, msgid_t msgid, trace_stage stage,
+                 trace_clock::time_point at);
+
+// Events still in the ring, oldest first. Recording is not stopped;
+// events overwritten while copying are left out.
+std::vector<trace_event> trace_dump();
+
+// The trace id carried by a request message, 0 if there is none
+uint64_t trace_id_of(const object& msg);
+
+
+}  // namespace rpc
+}  // namespace msgpack
+
+#endif /* msgpack/rpc/trace.h */
@@ -1,6 +1,7 @@
 #include "dgram_handler.h"
+#include "../log.h"
+#include "../trace.h"
 
-#include <boost/log/trivial.hpp>
 #include <functional>
 
 namespace msgpack {
@@ -17,6 +18,9 @@ public:
     void send_data(sbuffer* sbuf) {
         m_handler->send_data(m_remote, sbuf);
     }
+    void send_data(send_buffer* buf) {
+        m_handler->send_data(m_remote, buf);
+    }
     void send_data(std::unique_ptr<vreflife> vbuf) {
         m_handler->send_data(m_remote, std::move(vbuf));
     }
@@ -34,8 +38,10 @@ private:
 
 dgram_handler::dgram_handler(loop lo) :
     m_pac(),
+    m_zones(new zone_pool()),
     m_socket(lo->io_service()),
-    m_strand(lo->io_service())
+    m_strand(lo->io_service()),
+    m_trace_id(0)
 {
 }
 
@@ -60,13 +66,13 @@ void dgram_handler::on_read(const boost::system::error_code& err, size_t nbytes)
 {
     bool failed = false;
     if (!err) {
-        BOOST_LOG_TRIVIAL(debug) << "received from: " << m_remote;
+        MSGPACK_RPC_LOG_SAMPLED(debug) << "received from: " << m_remote;
+        m_read_time = admission_controller::clock::now();
         try {
             m_pac.buffer_consumed(nbytes);
-            msgpack::unpacked result;
-            while (m_pac.next(&result)) {
-                msgpack::object msg = result.get();
-                auto_zone z(result.zone().release());
+            msgpack::object msg;
+            auto_zone z;
+            while (m_zones->next(&m_pac, &msg, &z)) {
                 on_message(msg, std::move(z), m_remote);
             }
 
@@ -81,12 +87,12 @@ void dgram_handler::on_read(const boost::system::error_code& err, size_t nbytes)
         }
         catch(std::exception& e)
         {
-            BOOST_LOG_TRIVIAL(error) << "on_read() exception: " << boost::diagnostic_information(e).c_str();
+            MSGPACK_RPC_LOG(error) << "on_read() exception: " << boost::diagnostic_information(e).c_str();
             failed = true;
         }
     }
     else if (err.value() != 2) {
-        BOOST_LOG_TRIVIAL(error) << "on_read() failed : " << err.value() << ", " <<  err.message();
+        MSGPACK_RPC_LOG(error) << "on_read() failed : " << err.value() << ", " <<  err.message();
     }
 
     if (err || failed) {
@@ -106,10 +112,28 @@ void dgram_handler::send_data(sbuffer* sbuf)
 void dgram_handler::send_data(udp::endpoint& ep, sbuffer* sbuf)
 {
     boost::mutex::scoped_lock lock(mutex);
-    BOOST_LOG_TRIVIAL(debug) << "send sbuf to : " << ep;
+    MSGPACK_RPC_LOG_SAMPLED(debug) << "send sbuf to : " << ep;
     m_socket.send_to(boost::asio::buffer(sbuf->data(), sbuf->size()), ep);
 }
 
+void dgram_handler::send_data(send_buffer* buf)
+{
+    if (m_socket.is_open() == false)
+        return;
+    udp::endpoint remote_ep = m_socket.remote_endpoint();
+    send_data(remote_ep, buf);
+}
+
+void dgram_handler::send_data(udp::endpoint& ep, send_buffer* buf)
+{
+    boost::mutex::scoped_lock lock(mutex);
+
+    static thread_local std::vector<boost::asio::const_buffer> buffers;
+    buf->to_buffers(&buffers);
+    MSGPACK_RPC_LOG_SAMPLED(debug) << "send buf to : " << ep;
+    m_socket.send_to(buffers, ep);
+}
+
 void dgram_handler::send_data(auto_vreflife vbuf)
 {
     if (m_socket.is_open() == false)
@@ -127,7 +151,7 @@ void dgram_handler::send_data(udp::endpoint& ep, auto_vreflife vbuf)
     for (int i = 0; i < (int)vbuf->vector_size(); ++i) {
         buffers.push_back(boost::asio::buffer(vec[i].iov_base, vec[i].iov_len));
     }
-    BOOST_LOG_TRIVIAL(debug) << "send vbuf to : " << ep;
+    MSGPACK_RPC_LOG_SAMPLED(debug) << "send vbuf to : " << ep;
     m_socket.send_to(buffers, ep);
 }
 
@@ -140,6 +164,7 @@ void dgram_handler::on_message(object msg, auto_zone z, udp::endpoint& ep)
     case REQUEST: {
         msg_request<object, object> req;
         msg.convert(&req);
+        m_trace_id = trace_id_of(msg);
         on_request(req.msgid, req.method, req.param, std::move(z), ep);
     }
     break;
@@ -151,6 +176,13 @@ void dgram_handler::on_message(object msg, auto_zone z, udp::endpoint& ep)
     }
     break;
 
+    case RESPONSE_CHUNK: {
+        msg_response_chunk<object> res;
+        msg.convert(&res);
+        on_response_chunk(res.msgid, res.chunk, std::move(z));
+    }
+    break;
+
     case NOTIFY: {
         msg_notify<object, object> req;
         msg.convert(&req);
@@ -6,6 +6,7 @@
 #include "../session_impl.h"
 #include "../transport_impl.h"
 #include "../types.h"
+#include "../zone_pool.h"
 
 #include <boost/asio.hpp>
 #include <memory>
@@ -32,9 +33,11 @@ public:
 
     // message_sendable
     void send_data(sbuffer* sbuf);
+    void send_data(send_buffer* buf);
     void send_data(auto_vreflife vbuf);
 
     void send_data(boost::asio::ip::udp::endpoint& ep, sbuffer* sbuf);
+    void send_data(boost::asio::ip::udp::endpoint& ep, send_buffer* buf);
     void send_data(boost::asio::ip::udp::endpoint& ep, auto_vreflife vbuf);
 
     // process message
@@ -43,13 +46,22 @@ public:
                             boost::asio::ip::udp::endpoint& ep) = 0;
     virtual void on_response(msgid_t msgid, object result, object error, auto_zone z) = 0;
     virtual void on_notify(object method, object params, auto_zone z) = 0;
+    // only clients read streamed responses
+    virtual void on_response_chunk(msgid_t msgid, object chunk, auto_zone z) {
+        throw msgpack::type_error();
+    }
 
 protected:
     unpacker m_pac;
+    std::shared_ptr<zone_pool> m_zones;  // for the messages m_pac holds
     boost::asio::ip::udp::socket m_socket;
     boost::asio::io_service::strand m_strand;
     boost::asio::ip::udp::endpoint m_remote;
     boost::mutex mutex;
+    // when the datagram being parsed was received
+    admission_controller::clock::time_point m_read_time;
+    // trace id of the request being dispatched, 0 if untraced
+    uint64_t m_trace_id;
 };
 
 
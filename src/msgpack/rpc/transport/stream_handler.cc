@@ -1,7 +1,11 @@
 #include "stream_handler.h"
+#include "../log.h"
+#include "../trace.h"
 
-#include <boost/log/trivial.hpp>
+#include <algorithm>
+#include <chrono>
 #include <functional>
+#include <poll.h>
 
 namespace msgpack {
 namespace rpc {
@@ -15,10 +19,100 @@ namespace rpc {
 #define MSGPACK_RPC_STREAM_RESERVE_SIZE (32*1024)
 #endif
 
+// responses held back during one read are flushed once they reach this
+// size, and larger ones are not copied but written on their own.
+// 0 writes every response right away.
+#ifndef MSGPACK_RPC_RESPONSE_BATCH_SIZE
+#define MSGPACK_RPC_RESPONSE_BATCH_SIZE (64*1024)
+#endif
+
+
+// streamed arguments not taken yet by their handlers, per connection; the
+// connection is not read while it has more
+#ifndef MSGPACK_RPC_UPLOAD_QUEUE_SIZE
+#define MSGPACK_RPC_UPLOAD_QUEUE_SIZE (1024*1024)
+#endif
+
+// chunks of streamed responses not taken yet by their callers, per
+// connection; the connection is not read while it has more
+#ifndef MSGPACK_RPC_STREAM_QUEUE_SIZE
+#define MSGPACK_RPC_STREAM_QUEUE_SIZE (1024*1024)
+#endif
+
+
+// the handler whose read this thread is dispatching
+static thread_local stream_handler* t_batching = NULL;
+
+// Holds back the responses of the calling thread while it is alive.
+class response_batch {
+public:
+    response_batch(stream_handler* handler) :
+        m_handler(handler), m_prev(t_batching)
+    {
+        t_batching = handler;
+    }
+    ~response_batch()
+    {
+        t_batching = m_prev;
+        m_handler->flush_responses();
+    }
+
+private:
+    stream_handler* m_handler;
+    stream_handler* m_prev;
+};
+
+
+// Answers a single request. The handler is told when the sender goes away,
+// whether or not a response was ever sent through it.
+class stream_response_sender : public message_sendable {
+public:
+    stream_response_sender(std::shared_ptr<stream_handler> handler) :
+        m_handler(handler) { }
+    ~stream_response_sender() {
+        m_handler->on_request_done();
+    }
+
+    void send_data(sbuffer* sbuf) {
+        m_handler->send_response(sbuf);
+    }
+    void send_data(send_buffer* buf) {
+        m_handler->send_response(buf);
+    }
+    void send_data(auto_vreflife vbuf) {
+        m_handler->send_response(std::move(vbuf));
+    }
+    void send_chunk(send_buffer* buf) {
+        m_handler->send_data(buf);
+    }
+
+private:
+    std::shared_ptr<stream_handler> m_handler;
+
+private:
+    stream_response_sender();
+    stream_response_sender(const stream_response_sender&);
+};
+
 
 stream_handler::stream_handler(loop lo) :
+    m_zones(new zone_pool()),
     m_socket(lo->io_service()),
-    m_strand(lo->io_service())
+    m_strand(lo->io_service()),
+    m_trace_id(0),
+    m_max_inflight(0),
+    m_max_pending_bytes(0),
+    m_inflight(0),
+    m_pending_bytes(0),
+    m_upload_bytes(0),
+    m_chunk_bytes(0),
+    m_paused(false),
+    m_idle_steps(0),
+    m_buffer_bytes(0),
+    m_inline_read(false),
+    m_read_state(READ_IDLE),
+    m_async_wanted(false),
+    m_batch_bytes(0)
 {
     m_pac.reset(new unpacker());
 }
@@ -28,6 +122,8 @@ stream_handler::~stream_handler() { }
 void stream_handler::start()
 {
     m_pac->reserve_buffer(MSGPACK_RPC_STREAM_RESERVE_SIZE);
+    m_buffer_bytes.store(m_pac->nonparsed_size() + m_pac->buffer_capacity(),
+            std::memory_order_relaxed);
     m_socket.async_read_some(
         boost::asio::buffer(m_pac->buffer(), m_pac->buffer_capacity()),
         m_strand.wrap(std::bind(&stream_handler::on_read, shared_from_this(),
@@ -39,72 +135,426 @@ void stream_handler::stop()
     if (!m_socket.is_open())
         return;
     try {
-        BOOST_LOG_TRIVIAL(debug) << "stream_handler::stop : " << m_socket.remote_endpoint();
+        MSGPACK_RPC_LOG(debug) << "stream_handler::stop : " << m_socket.remote_endpoint();
         m_socket.close();
     }
     catch(boost::system::system_error& e) {
         boost::system::error_code ec = e.code();
         if (ec.value() == ENOTCONN)
             return;
-        BOOST_LOG_TRIVIAL(error) << "stream_handler::stop : " << ec.value() << ", " << ec.message();
+        MSGPACK_RPC_LOG(error) << "stream_handler::stop : " << ec.value() << ", " << ec.message();
+    }
+}
+
+std::shared_ptr<message_sendable> stream_handler::get_response_sender()
+{
+    {
+        boost::mutex::scoped_lock lk(m_flow_mutex);
+        ++m_inflight;
+    }
+    return std::shared_ptr<message_sendable>(
+            new stream_response_sender(shared_from_this()));
+}
+
+void stream_handler::set_flow_limits(size_t max_inflight, size_t max_pending_bytes)
+{
+    boost::mutex::scoped_lock lk(m_flow_mutex);
+    m_max_inflight = max_inflight;
+    m_max_pending_bytes = max_pending_bytes;
+}
+
+unsigned int stream_handler::step_idle()
+{
+    {
+        boost::mutex::scoped_lock lk(m_flow_mutex);
+        if (m_inflight > 0 || m_pending_bytes > 0 || m_upload_bytes > 0) {
+            // waiting for a handler or for the peer to read is not idle
+            m_idle_steps.store(0, std::memory_order_relaxed);
+            return 0;
+        }
+    }
+    unsigned int steps = m_idle_steps.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (steps == 1) {
+        // quiet now: give back what the busy time left for reuse
+        m_strand.post(std::bind(&stream_handler::trim, shared_from_this()));
+    }
+    return steps;
+}
+
+void stream_handler::trim()
+{
+    std::vector<char>().swap(m_batch);
+    m_batch_bytes.store(0, std::memory_order_relaxed);
+    m_zones->trim();
+}
+
+void stream_handler::shutdown()
+{
+    m_strand.post(std::bind(&stream_handler::shutdown_socket, shared_from_this()));
+}
+
+void stream_handler::shutdown_socket()
+{
+    // the pending read ends with eof and the connection is closed as if
+    // the peer had done it
+    boost::system::error_code ec;
+    m_socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+}
+
+size_t stream_handler::memory_usage()
+{
+    boost::mutex::scoped_lock lk(m_flow_mutex);
+    return sizeof(*this) + m_buffer_bytes.load(std::memory_order_relaxed) +
+        m_zones->free_bytes() + m_batch_bytes.load(std::memory_order_relaxed) +
+        m_pending_bytes + m_upload_bytes + m_chunk_bytes;
+}
+
+void stream_handler::set_inline_read(bool enable)
+{
+    boost::mutex::scoped_lock lk(m_read_mutex);
+    m_inline_read = enable;
+}
+
+void stream_handler::request_async_read()
+{
+    boost::mutex::scoped_lock lk(m_read_mutex);
+    if (!m_inline_read) {
+        return;  // always reading
+    }
+    if (m_read_state == READ_INLINE) {
+        // the inline reader hands over to the loop when it is done
+        m_async_wanted = true;
+        return;
+    }
+    if (m_read_state == READ_ASYNC || !m_socket.is_open()) {
+        return;
+    }
+    m_read_state = READ_ASYNC;
+    lk.unlock();
+    start();
+}
+
+void stream_handler::restart_read()
+{
+    if (m_inline_read) {
+        boost::mutex::scoped_lock lk(m_read_mutex);
+        if (!needs_async_read()) {
+            // nothing outstanding: leave the next reply to its caller
+            m_read_state = READ_IDLE;
+            return;
+        }
+    }
+    start();
+}
+
+bool stream_handler::read_inline(std::function<bool ()> done, unsigned int timeout_ms)
+{
+    {
+        boost::mutex::scoped_lock lk(m_read_mutex);
+        if (!m_inline_read || m_read_state != READ_IDLE || !m_socket.is_open()) {
+            return false;
+        }
+        m_read_state = READ_INLINE;
+    }
+
+    typedef std::chrono::steady_clock clock;
+    clock::time_point deadline = clock::now() + std::chrono::milliseconds(timeout_ms);
+
+    boost::system::error_code err;
+    bool failed = false;
+    try {
+        while (!done()) {
+            msgpack::object msg;
+            auto_zone z;
+            if (m_zones->next(m_pac.get(), &msg, &z)) {
+                MSGPACK_RPC_LOG_SAMPLED(debug) << "obj received: " << msg;
+                on_message(msg, std::move(z));
+                continue;
+            }
+            if (m_pac->message_size() > 10 * 1024 * 1024) {
+                throw std::runtime_error("message is too large");
+            }
+
+            long left_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    deadline - clock::now()).count();
+            if (left_ms <= 0) {
+                break;
+            }
+
+            // wake up now and then so that a timeout set by the session's
+            // step timer is noticed
+            struct pollfd pfd;
+            pfd.fd = m_socket.native_handle();
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            int ret = ::poll(&pfd, 1, (int)std::min(left_ms, 100L));
+            if (ret < 0 && errno != EINTR) {
+                err.assign(errno, boost::system::system_category());
+                break;
+            }
+            if (ret <= 0) {
+                continue;
+            }
+
+            m_pac->reserve_buffer(MSGPACK_RPC_STREAM_RESERVE_SIZE);
+            size_t nbytes = m_socket.read_some(
+                boost::asio::buffer(m_pac->buffer(), m_pac->buffer_capacity()), err);
+            if (err) {
+                break;
+            }
+            m_read_time = admission_controller::clock::now();
+            m_pac->buffer_consumed(nbytes);
+        }
+    }
+    catch(std::exception& e)
+    {
+        MSGPACK_RPC_LOG(error) << "read_inline() exception: " << boost::diagnostic_information(e).c_str();
+        failed = true;
+    }
+
+    if (err && err.value() != 2) {
+        MSGPACK_RPC_LOG(error) << "read_inline() failed : " << err.value() << ", " <<  err.message();
+    }
+    if (err || failed) {
+        on_system_error(err);
+        m_pac->remove_nonparsed_buffer();
+    }
+
+    bool arm = false;
+    {
+        boost::mutex::scoped_lock lk(m_read_mutex);
+        m_read_state = READ_IDLE;
+        if (!err && !failed && (m_async_wanted || needs_async_read())) {
+            m_read_state = READ_ASYNC;
+            arm = true;
+        }
+        m_async_wanted = false;
+    }
+    if (arm) {
+        start();
+    }
+    return true;
+}
+
+bool stream_handler::is_flow_blocked() const
+{
+    return (m_max_inflight > 0 && m_inflight >= m_max_inflight) ||
+        (m_max_pending_bytes > 0 && m_pending_bytes >= m_max_pending_bytes) ||
+        m_upload_bytes >= MSGPACK_RPC_UPLOAD_QUEUE_SIZE ||
+        m_chunk_bytes >= MSGPACK_RPC_STREAM_QUEUE_SIZE;
+}
+
+bool stream_handler::pause_if_blocked()
+{
+    boost::mutex::scoped_lock lk(m_flow_mutex);
+    if (is_flow_blocked()) {
+        m_paused = true;
+    }
+    return m_paused;
+}
+
+void stream_handler::on_request_done()
+{
+    boost::mutex::scoped_lock lk(m_flow_mutex);
+    --m_inflight;
+    if (m_paused && !is_flow_blocked()) {
+        m_paused = false;
+        lk.unlock();
+        resume();
+    }
+}
+
+void stream_handler::add_pending_bytes(size_t nbytes)
+{
+    boost::mutex::scoped_lock lk(m_flow_mutex);
+    m_pending_bytes += nbytes;
+}
+
+void stream_handler::remove_pending_bytes(size_t nbytes)
+{
+    boost::mutex::scoped_lock lk(m_flow_mutex);
+    m_pending_bytes -= nbytes;
+    if (m_paused && !is_flow_blocked()) {
+        m_paused = false;
+        lk.unlock();
+        resume();
     }
 }
 
+void stream_handler::add_upload_bytes(size_t nbytes)
+{
+    boost::mutex::scoped_lock lk(m_flow_mutex);
+    m_upload_bytes += nbytes;
+}
+
+void stream_handler::remove_upload_bytes(size_t nbytes)
+{
+    boost::mutex::scoped_lock lk(m_flow_mutex);
+    m_upload_bytes -= nbytes;
+    if (m_paused && !is_flow_blocked()) {
+        m_paused = false;
+        lk.unlock();
+        resume();
+    }
+}
+
+const std::function<void (size_t)>& stream_handler::add_chunk_bytes(size_t nbytes)
+{
+    boost::mutex::scoped_lock lk(m_flow_mutex);
+    m_chunk_bytes += nbytes;
+    if (!m_chunk_consumed) {
+        // does not keep the connection alive, as the futures may outlive it
+        m_chunk_consumed = std::bind(&stream_handler::release_chunk_bytes,
+                std::weak_ptr<stream_handler>(shared_from_this()),
+                std::placeholders::_1);
+    }
+    return m_chunk_consumed;
+}
+
+void stream_handler::remove_chunk_bytes(size_t nbytes)
+{
+    boost::mutex::scoped_lock lk(m_flow_mutex);
+    m_chunk_bytes -= nbytes;
+    if (m_paused && !is_flow_blocked()) {
+        m_paused = false;
+        lk.unlock();
+        resume();
+    }
+}
+
+void stream_handler::release_chunk_bytes(std::weak_ptr<stream_handler> handler,
+                                         size_t nbytes)
+{
+    std::shared_ptr<stream_handler> h = handler.lock();
+    if (h) {
+        h->remove_chunk_bytes(nbytes);
+    }
+}
+
+void stream_handler::resume()
+{
+    if (!m_socket.is_open())
+        return;
+
+    // parse whatever is still buffered before reading from the socket again
+    m_strand.post(std::bind(&stream_handler::on_read, shared_from_this(),
+        boost::system::error_code(), 0));
+}
+
 void stream_handler::on_read(const boost::system::error_code& err, size_t nbytes)
 {
     bool failed = false;
     if (!err) {
         try {
+            if (nbytes > 0) {
+                m_read_time = admission_controller::clock::now();
+                m_idle_steps.store(0, std::memory_order_relaxed);
+            }
             m_pac->buffer_consumed(nbytes);
-            msgpack::unpacked result;
-            while (m_pac->next(&result)) {
-                msgpack::object msg = result.get();
-                // std::unique_ptr<msgpack::zone> z(m_pac->release_zone());
-                std::unique_ptr<msgpack::zone> z(result.zone().release());
-                BOOST_LOG_TRIVIAL(debug) << "obj received: " << msg;
+            response_batch batch(this);
+            while (true) {
+                if (pause_if_blocked()) {
+                    // stop reading until outstanding requests drain so that
+                    // TCP flow control pushes back on the peer
+                    return;
+                }
+                msgpack::object msg;
+                auto_zone z;
+                if (!m_zones->next(m_pac.get(), &msg, &z)) {
+                    break;
+                }
+                MSGPACK_RPC_LOG_SAMPLED(debug) << "obj received: " << msg;
                 on_message(msg, std::move(z));
             }
             if (m_pac->message_size() > 10 * 1024 * 1024) {
                 throw std::runtime_error("message is too large");
             }
 
-            start();
+            restart_read();
             return;
         }
         catch(std::exception& e)
         {
-            BOOST_LOG_TRIVIAL(error) << "on_read() exception: " << boost::diagnostic_information(e).c_str();
+            MSGPACK_RPC_LOG(error) << "on_read() exception: " << boost::diagnostic_information(e).c_str();
             failed = true;
         }
     }
     else if (err.value() != 2) {
-        BOOST_LOG_TRIVIAL(error) << "on_read() failed : " << err.value() << ", " <<  err.message();
+        MSGPACK_RPC_LOG(error) << "on_read() failed : " << err.value() << ", " <<  err.message();
     }
 
     if (err || failed) {
         // set exception for orphaned promises
         on_system_error(err);
         m_pac->remove_nonparsed_buffer();
+        close_uploads();
+
+        boost::mutex::scoped_lock lk(m_read_mutex);
+        m_read_state = READ_IDLE;
     }
 }
 
 void stream_handler::send_data(sbuffer* sbuf)
+{
+    send_data(sbuf, PRIORITY_NORMAL);
+}
+
+void stream_handler::send_data(sbuffer* sbuf, priority_t prio)
 {
     if (!m_socket.is_open())
         return;
 
+    size_t nbytes = sbuf->size();
+    add_pending_bytes(nbytes);
+
     try {
-        boost::mutex::scoped_lock lock(mutex);
+        priority_gate::scoped_lock lock(m_write_gate, prio);
         boost::asio::write(m_socket,
             boost::asio::buffer(sbuf->data(), sbuf->size()));
     } catch (boost::system::system_error& e) {
         boost::system::error_code ec = e.code();
         on_system_error(ec);
-        BOOST_LOG_TRIVIAL(error) << "send_data() failed : " << ec.value() << ", " << ec.message();
+        MSGPACK_RPC_LOG(error) << "send_data() failed : " << ec.value() << ", " << ec.message();
     }
+
+    remove_pending_bytes(nbytes);
+}
+
+void stream_handler::send_data(send_buffer* buf)
+{
+    send_data(buf, PRIORITY_NORMAL);
+}
+
+void stream_handler::send_data(send_buffer* buf, priority_t prio)
+{
+    if (!m_socket.is_open())
+        return;
+
+    // reused across calls; the chunks it points to stay with buf
+    static thread_local std::vector<boost::asio::const_buffer> buffers;
+    buf->to_buffers(&buffers);
+
+    size_t nbytes = buf->size();
+    add_pending_bytes(nbytes);
+
+    try {
+        priority_gate::scoped_lock lock(m_write_gate, prio);
+        boost::asio::write(m_socket, buffers);
+    } catch (boost::system::system_error& e) {
+        boost::system::error_code ec = e.code();
+        on_system_error(ec);
+        MSGPACK_RPC_LOG(error) << "send_data() failed : " << ec.value() << ", " << ec.message();
+    }
+
+    remove_pending_bytes(nbytes);
 }
 
 void stream_handler::send_data(auto_vreflife vbuf)
+{
+    send_data(std::move(vbuf), PRIORITY_NORMAL);
+}
+
+void stream_handler::send_data(auto_vreflife vbuf, priority_t prio)
 {
     if (!m_socket.is_open())
         return;
@@ -112,21 +562,102 @@ void stream_handler::send_data(auto_vreflife vbuf)
     std::vector<boost::asio::const_buffer> buffers;
     const struct iovec *vec = vbuf->vector();
     int veclen = (int)vbuf->vector_size();
+    size_t nbytes = 0;
 
     for (int i = 0; i < veclen; ++i) {
         buffers.push_back(boost::asio::buffer(vec[i].iov_base, vec[i].iov_len));
+        nbytes += vec[i].iov_len;
     }
 
+    add_pending_bytes(nbytes);
+
     try {
-        boost::mutex::scoped_lock lock(mutex);
+        priority_gate::scoped_lock lock(m_write_gate, prio);
         boost::asio::write(m_socket, buffers);
     } catch (boost::system::system_error& e) {
         boost::system::error_code ec = e.code();
         on_system_error(ec);
-        BOOST_LOG_TRIVIAL(error) << "send_data() failed : " << ec.value() << ", " << ec.message();
+        MSGPACK_RPC_LOG(error) << "send_data() failed : " << ec.value() << ", " << ec.message();
+    }
+
+    remove_pending_bytes(nbytes);
+}
+
+void stream_handler::send_response(sbuffer* sbuf)
+{
+    struct iovec vec;
+    vec.iov_base = sbuf->data();
+    vec.iov_len = sbuf->size();
+    if (!batch_response(&vec, 1, vec.iov_len)) {
+        send_data(sbuf);
     }
 }
 
+void stream_handler::send_response(send_buffer* buf)
+{
+    if (!batch_response(buf->vector(), buf->vector_size(), buf->size())) {
+        send_data(buf);
+    }
+}
+
+void stream_handler::send_response(auto_vreflife vbuf)
+{
+    const struct iovec* vec = vbuf->vector();
+    size_t veclen = vbuf->vector_size();
+    size_t nbytes = 0;
+    for (size_t i = 0; i < veclen; ++i) {
+        nbytes += vec[i].iov_len;
+    }
+    if (!batch_response(vec, veclen, nbytes)) {
+        send_data(std::move(vbuf));
+    }
+}
+
+bool stream_handler::batch_response(const struct iovec* vec, size_t veclen, size_t nbytes)
+{
+    if (t_batching != this || !m_socket.is_open()) {
+        return false;
+    }
+    if (m_batch.size() + nbytes > MSGPACK_RPC_RESPONSE_BATCH_SIZE) {
+        flush_responses();
+        if (nbytes > MSGPACK_RPC_RESPONSE_BATCH_SIZE) {
+            return false;
+        }
+    }
+
+    for (size_t i = 0; i < veclen; ++i) {
+        const char* p = (const char*)vec[i].iov_base;
+        m_batch.insert(m_batch.end(), p, p + vec[i].iov_len);
+    }
+    m_batch_bytes.store(m_batch.capacity(), std::memory_order_relaxed);
+    // counted as waiting for the socket, like any other response
+    add_pending_bytes(nbytes);
+    return true;
+}
+
+void stream_handler::flush_responses()
+{
+    size_t nbytes = m_batch.size();
+    if (nbytes == 0) {
+        return;
+    }
+
+    if (m_socket.is_open()) {
+        try {
+            priority_gate::scoped_lock lock(m_write_gate, PRIORITY_NORMAL);
+            boost::asio::write(m_socket,
+                boost::asio::buffer(&m_batch[0], nbytes));
+        } catch (boost::system::system_error& e) {
+            boost::system::error_code ec = e.code();
+            on_system_error(ec);
+            MSGPACK_RPC_LOG(error) << "flush_responses() failed : " << ec.value() << ", " << ec.message();
+        }
+    }
+
+    m_batch.clear();
+    remove_pending_bytes(nbytes);
+}
+
 void stream_handler::on_message(object msg, auto_zone z)
 {
     msg_rpc rpc;
@@ -136,6 +667,7 @@ void stream_handler::on_message(object msg, auto_zone z)
     case REQUEST: {
         msg_request<object, object> req;
         msg.convert(&req);
+        m_trace_id = trace_id_of(msg);
         on_request(req.msgid, req.method, req.param, std::move(z));
     }
     break;
@@ -147,6 +679,28 @@ void stream_handler::on_message(object msg, auto_zone z)
     }
     break;
 
+    case RESPONSE_CHUNK: {
+        msg_response_chunk<object> res;
+        msg.convert(&res);
+        on_response_chunk(res.msgid, res.chunk, std::move(z));
+    }
+    break;
+
+    case STREAM_REQUEST: {
+        msg_stream_request<object, object> req;
+        msg.convert(&req);
+        m_trace_id = 0;
+        on_stream_request(req.msgid, req.method, req.param, std::move(z));
+    }
+    break;
+
+    case REQUEST_CHUNK: {
+        msg_request_chunk<object> req;
+        msg.convert(&req);
+        on_request_chunk(req.msgid, req.chunk, std::move(z));
+    }
+    break;
+
     case NOTIFY: {
         msg_notify<object, object> req;
         msg.convert(&req);
@@ -159,6 +713,58 @@ void stream_handler::on_message(object msg, auto_zone z)
     }
 }
 
+void stream_handler::on_stream_request(msgid_t msgid,
+        object method, object params, auto_zone z)
+{
+    using namespace std::placeholders;
+    shared_upload_reader upload(new upload_reader(
+            std::bind(&stream_handler::add_upload_bytes, shared_from_this(), _1),
+            std::bind(&stream_handler::remove_upload_bytes, shared_from_this(), _1),
+            std::bind(&stream_handler::is_reading_thread, shared_from_this())));
+    m_uploads[msgid] = upload;
+
+    m_upload = upload;
+    try {
+        on_request(msgid, method, params, std::move(z));
+    } catch (...) {
+        m_upload.reset();
+        throw;
+    }
+    m_upload.reset();
+}
+
+bool stream_handler::is_reading_thread() const
+{
+    return t_batching == this;
+}
+
+void stream_handler::on_request_chunk(msgid_t msgid, object chunk, auto_zone z)
+{
+    boost::unordered_map<msgid_t, shared_upload_reader>::iterator it =
+        m_uploads.find(msgid);
+    if (it == m_uploads.end()) {
+        MSGPACK_RPC_LOG(error) << "no upload for msgid=" << msgid;
+        return;
+    }
+    if (chunk.is_nil()) {
+        shared_upload_reader upload = it->second;
+        m_uploads.erase(it);
+        upload->end();
+        return;
+    }
+    it->second->push(chunk, std::move(z));
+}
+
+void stream_handler::close_uploads()
+{
+    boost::unordered_map<msgid_t, shared_upload_reader> uploads;
+    uploads.swap(m_uploads);
+    for (boost::unordered_map<msgid_t, shared_upload_reader>::iterator it =
+            uploads.begin(); it != uploads.end(); ++it) {
+        it->second->abort();
+    }
+}
+
 
 }  // namespace rpc
 }  // namespace msgpack
@@ -6,8 +6,14 @@
 #include "../session_impl.h"
 #include "../server_impl.h"
 #include "../transport_impl.h"
+#include "../upload_reader.h"
+#include "../zone_pool.h"
 
+#include <boost/unordered_map.hpp>
+#include <atomic>
+#include <functional>
 #include <memory>
+#include <vector>
 
 namespace msgpack {
 namespace rpc {
@@ -23,32 +29,143 @@ public:
     virtual ~stream_handler();
 
     boost::asio::ip::tcp::socket& socket() { return m_socket; }
-    std::shared_ptr<message_sendable> get_response_sender() {
-        return std::static_pointer_cast<message_sendable>(shared_from_this());
-    }
+    std::shared_ptr<message_sendable> get_response_sender();
 
     void start();
     void stop();
     void on_read(const boost::system::error_code& err, size_t bytes_transferred);
 
+    // Inline reads, for clients. The socket is only read on the loop
+    // while needs_async_read() says so; otherwise a thread waiting for a
+    // reply reads it itself through read_inline().
+    void set_inline_read(bool enable);
+    void request_async_read();
+    bool read_inline(std::function<bool ()> done, unsigned int timeout_ms);
+    virtual bool needs_async_read() { return true; }
+
+    // flow control, 0 means unlimited
+    void set_flow_limits(size_t max_inflight, size_t max_pending_bytes);
+    void on_request_done();
+
+    // For servers. step_idle() is called once a step and returns the steps
+    // the connection has been quiet for: nothing read, no request going on.
+    // After the first quiet step the pooled zones and the response batch
+    // buffer are freed. shutdown() ends it from any thread, through
+    // on_system_error().
+    unsigned int step_idle();
+    void shutdown();
+    // bytes held by the read buffer, the pooled zones, the response batch
+    // buffer and the queued responses and chunks
+    size_t memory_usage();
+
     // message_sendable
     void send_data(sbuffer* sbuf);
+    void send_data(send_buffer* buf);
     void send_data(auto_vreflife vbuf);
 
+    // writers waiting on the socket are served by priority lane
+    void send_data(sbuffer* sbuf, priority_t prio);
+    void send_data(send_buffer* buf, priority_t prio);
+    void send_data(auto_vreflife vbuf, priority_t prio);
+
+    // Responses. Those sent by the thread dispatching a read are held back
+    // and written together once every message of the read is dispatched;
+    // the others are written right away.
+    void send_response(sbuffer* sbuf);
+    void send_response(send_buffer* buf);
+    void send_response(auto_vreflife vbuf);
+    void flush_responses();
+
     // process message
     void on_message(object msg, auto_zone z);
     virtual void on_request(msgid_t msgid, object method, object params, auto_zone z) = 0;
     virtual void on_response(msgid_t msgid, object result, object error, auto_zone z) = 0;
     virtual void on_notify(object method, object params, auto_zone z) = 0;
+    // only clients read streamed responses
+    virtual void on_response_chunk(msgid_t msgid, object chunk, auto_zone z) {
+        throw msgpack::type_error();
+    }
 
     // error handler
     virtual void on_system_error(const boost::system::error_code& err) = 0;
 
+private:
+    void restart_read();
+    void shutdown_socket();
+    void trim();
+    bool batch_response(const struct iovec* vec, size_t veclen, size_t nbytes);
+
+    bool is_flow_blocked() const;
+    bool pause_if_blocked();
+    void add_pending_bytes(size_t nbytes);
+    void remove_pending_bytes(size_t nbytes);
+    void resume();
+    void add_upload_bytes(size_t nbytes);
+    void remove_upload_bytes(size_t nbytes);
+
+    void on_stream_request(msgid_t msgid, object method, object params, auto_zone z);
+    void on_request_chunk(msgid_t msgid, object chunk, auto_zone z);
+    void close_uploads();
+    // dispatching a read of this connection
+    bool is_reading_thread() const;
+
+    void remove_chunk_bytes(size_t nbytes);
+    static void release_chunk_bytes(std::weak_ptr<stream_handler> handler,
+                                    size_t nbytes);
+
+protected:
+    // For clients: 'nbytes' of a streamed response's chunk wait for the
+    // caller. Reading is paused while more than MSGPACK_RPC_STREAM_QUEUE_SIZE
+    // bytes of them wait. Returns the function to call with 'nbytes' once
+    // the chunk is taken or dropped.
+    const std::function<void (size_t)>& add_chunk_bytes(size_t nbytes);
+
 protected:
     std::unique_ptr<unpacker> m_pac;
+    std::shared_ptr<zone_pool> m_zones;  // for the messages m_pac holds
     boost::asio::ip::tcp::socket m_socket;
     boost::asio::io_service::strand m_strand;
-    boost::mutex mutex;
+    priority_gate m_write_gate;
+    // when the data being parsed was read off the socket
+    admission_controller::clock::time_point m_read_time;
+    // trace id of the request being dispatched, 0 if untraced
+    uint64_t m_trace_id;
+    // streamed arguments of the request being dispatched, if any
+    shared_upload_reader m_upload;
+
+private:
+    // requests dispatched but not yet answered, and response bytes waiting
+    // for the socket. reading is paused while either is over its limit.
+    size_t m_max_inflight;
+    size_t m_max_pending_bytes;
+    size_t m_inflight;
+    size_t m_pending_bytes;
+    size_t m_upload_bytes;  // chunks of streamed arguments not taken yet
+    size_t m_chunk_bytes;   // chunks of streamed responses not taken yet
+    std::function<void (size_t)> m_chunk_consumed;
+    bool m_paused;
+    boost::mutex m_flow_mutex;
+
+    std::atomic<unsigned int> m_idle_steps;
+    std::atomic<size_t> m_buffer_bytes;  // size of m_pac's buffer
+
+    // who owns m_pac and the socket's read side in inline mode
+    enum read_state {
+        READ_IDLE,
+        READ_ASYNC,
+        READ_INLINE,
+    };
+    bool m_inline_read;
+    read_state m_read_state;
+    bool m_async_wanted;  // asked for while an inline read was running
+    boost::mutex m_read_mutex;
+
+    // responses held back during on_read(), only touched on the strand
+    std::vector<char> m_batch;
+    std::atomic<size_t> m_batch_bytes;  // its capacity
+
+    // uploads still receiving chunks, by msgid; only touched on the strand
+    boost::unordered_map<msgid_t, shared_upload_reader> m_uploads;
 };
 
 
@@ -19,6 +19,7 @@
 
 #include "stream_handler.h"
 #include "../exception.h"
+#include "../log.h"
 #include "../protocol.h"
 #include "../server_impl.h"
 #include "../session_impl.h"
@@ -27,7 +28,8 @@
 
 #include <boost/asio.hpp>
 #include <boost/asio/deadline_timer.hpp>
-#include <boost/log/trivial.hpp>
+#include <algorithm>
+#include <atomic>
 #include <functional>
 #include <vector>
 
@@ -49,9 +51,12 @@ public:
 
     void on_request(msgid_t msgid, object method, object params, auto_zone z);
     void on_response(msgid_t msgid, object result, object error, auto_zone z);
+    void on_response_chunk(msgid_t msgid, object chunk, auto_zone z);
     void on_notify(object method, object params, auto_zone z);
     void on_system_error(const boost::system::error_code& err);
 
+    bool needs_async_read();
+
 private:
     int m_connecting;
     client_transport* m_tran;
@@ -72,13 +77,23 @@ public:
 public:
     // message_sendable
     void send_data(sbuffer* sbuf);
+    void send_data(send_buffer* buf);
     void send_data(auto_vreflife vbuf);
 
+    void send_data(sbuffer* sbuf, priority_t prio);
+    void send_data(send_buffer* buf, priority_t prio);
+    void send_data(auto_vreflife vbuf, priority_t prio);
+
+    bool is_inline_io() const;
+    bool read_inline(std::function<bool ()> done, unsigned int timeout_ms);
+    void request_async_read();
+
 private:
     session_impl* m_session;
 
     double m_connect_timeout;
     int m_reconnect_limit;
+    bool m_inline_io;
 
     std::shared_ptr<client_socket> m_conn;
     // keep io_service running in case of without run()
@@ -129,7 +144,19 @@ void client_socket::on_response(msgid_t msgid,
     if (!s) {
         throw closed_exception();
     }
-    s->on_response(msgid, result, error, std::move(z));
+    s->on_response(msgid, result, error, std::move(z), m_read_time);
+}
+
+void client_socket::on_response_chunk(msgid_t msgid,
+        object chunk, auto_zone z)
+{
+    shared_session s = m_session.lock();
+    if (!s) {
+        throw closed_exception();
+    }
+    size_t nbytes = upload_reader::size_of(chunk);
+    s->on_response_chunk(msgid, chunk, std::move(z),
+            nbytes, add_chunk_bytes(nbytes));
 }
 
 void client_socket::on_notify(
@@ -142,6 +169,12 @@ void client_socket::on_notify(
     s->on_notify(method, params, std::move(z));
 }
 
+bool client_socket::needs_async_read()
+{
+    shared_session s = m_session.lock();
+    return s && s->has_pending_requests();
+}
+
 void client_socket::on_system_error(const boost::system::error_code& err)
 {
     shared_session s = m_session.lock();
@@ -163,11 +196,13 @@ client_transport::client_transport(session_impl* s,
     m_session(s),
     m_connect_timeout(b.connect_timeout()),
     m_reconnect_limit(b.reconnect_limit()),
+    m_inline_io(b.inline_io()),
     m_conn(new transport::tcp::client_socket(this, m_session)),
     m_work(s->get_loop()->io_service()),
     m_timer(s->get_loop()->io_service())
 {
     assert(false == m_conn->socket().is_open());
+    m_conn->set_inline_read(m_inline_io);
 }
 
 client_transport::~client_transport()
@@ -177,23 +212,26 @@ client_transport::~client_transport()
 
 inline void client_transport::on_connect_success()
 {
-    BOOST_LOG_TRIVIAL(debug) << "connect success to " << m_session->get_address();
+    MSGPACK_RPC_LOG(debug) << "connect success to " << m_session->get_address();
     m_timer.cancel();
     m_conn->socket().set_option(boost::asio::ip::tcp::no_delay(true));
-    m_conn->start();
+    if (!m_inline_io) {
+        m_conn->start();
+    }
+    // in inline mode the first reply is read by whoever waits for it
 }
 
 void client_transport::on_connect_failed(const boost::system::error_code& err)
 {
     if (err.value() != ETIMEDOUT && m_conn->m_connecting < m_reconnect_limit)
     {
-        BOOST_LOG_TRIVIAL(warning) << "connect failed, retrying : " << m_conn->m_connecting;
+        MSGPACK_RPC_LOG(warning) << "connect failed, retrying : " << m_conn->m_connecting;
         boost::this_thread::sleep(boost::posix_time::milliseconds(100));
         try_connect();
         return;
     }
 
-    BOOST_LOG_TRIVIAL(warning) << "connect to " << m_session->get_address() << " failed.";
+    MSGPACK_RPC_LOG(warning) << "connect to " << m_session->get_address() << " failed.";
     m_timer.cancel();
     m_conn->socket().close();
     m_session->on_connect_failed();
@@ -217,7 +255,7 @@ void client_transport::try_connect()
 
     address addr = m_session->get_address();
     boost::asio::ip::tcp::endpoint ep(addr.get_addr(), addr.get_port());
-    BOOST_LOG_TRIVIAL(debug) << "connecting to " << addr;
+    MSGPACK_RPC_LOG(debug) << "connecting to " << addr;
 
     boost::system::error_code ec;
     ++m_conn->m_connecting;
@@ -255,6 +293,21 @@ void client_transport::connect()
 }
 
 void client_transport::send_data(sbuffer* sbuf)
+{
+    send_data(sbuf, PRIORITY_NORMAL);
+}
+
+void client_transport::send_data(send_buffer* buf)
+{
+    send_data(buf, PRIORITY_NORMAL);
+}
+
+void client_transport::send_data(auto_vreflife vbuf)
+{
+    send_data(std::move(vbuf), PRIORITY_NORMAL);
+}
+
+void client_transport::send_data(sbuffer* sbuf, priority_t prio)
 {
     if (!m_session->get_loop()->is_running())
         m_session->get_loop()->flush();
@@ -265,10 +318,10 @@ void client_transport::send_data(sbuffer* sbuf)
             connect();
     }
 
-    m_conn->send_data(sbuf);
+    m_conn->send_data(sbuf, prio);
 }
 
-void client_transport::send_data(auto_vreflife vbuf)
+void client_transport::send_data(send_buffer* buf, priority_t prio)
 {
     if (!m_session->get_loop()->is_running())
         m_session->get_loop()->flush();
@@ -279,7 +332,36 @@ void client_transport::send_data(auto_vreflife vbuf)
             connect();
     }
 
-    m_conn->send_data(std::move(vbuf));
+    m_conn->send_data(buf, prio);
+}
+
+void client_transport::send_data(auto_vreflife vbuf, priority_t prio)
+{
+    if (!m_session->get_loop()->is_running())
+        m_session->get_loop()->flush();
+
+    {
+        boost::mutex::scoped_lock lock(mutex);
+        if (!m_conn->socket().is_open())
+            connect();
+    }
+
+    m_conn->send_data(std::move(vbuf), prio);
+}
+
+bool client_transport::is_inline_io() const
+{
+    return m_inline_io;
+}
+
+bool client_transport::read_inline(std::function<bool ()> done, unsigned int timeout_ms)
+{
+    return m_conn->read_inline(done, timeout_ms);
+}
+
+void client_transport::request_async_read()
+{
+    m_conn->request_async_read();
 }
 
 // SERVER
@@ -298,32 +380,69 @@ public:
 private:
     weak_server m_svr;
     server_transport* m_tran;
+    // index in server_transport::m_connections, guarded by its mutex
+    size_t m_slot;
+
+    friend class server_transport;
 };
 
 
 class server_transport : public rpc::server_transport {
 public:
-    server_transport(server_impl* svr, const address& addr);
+    server_transport(server_impl* svr, const address& addr, const tcp_listener& l);
     ~server_transport();
 
-    void start_accept();
-    void on_accept(const boost::system::error_code& error);
+    void on_accept(std::shared_ptr<server_socket> conn,
+                   const boost::system::error_code& err);
     void on_system_error(std::shared_ptr<server_socket> conn);
 
     virtual void close();
     virtual int get_connection_num() const;
+    virtual size_t get_connection_memory() const;
     virtual const address& get_local_endpoint() const;
 
+private:
+    void start_accepts();
+    void add_connection(const std::shared_ptr<server_socket>& conn);
+    void remove_connection(const std::shared_ptr<server_socket>& conn);
+    bool is_full() const;
+
+    // Idle connections are looked for by the loop's step timer while there
+    // are connections. The step, like every accept that completes, reaches
+    // the transport through the guard, which the destructor clears.
+    struct step_guard {
+        boost::mutex mutex;
+        server_transport* tran;
+    };
+    void watch_idle();
+    static bool step(std::shared_ptr<step_guard> guard);
+    bool step_idle();
+    static void accepted(std::shared_ptr<step_guard> guard,
+            std::shared_ptr<server_socket> conn,
+            const boost::system::error_code& err);
+
 private:
     weak_server m_wsvr;
+    loop m_loop;
     // acceptor used to listen for incoming connections.
     boost::asio::ip::tcp::acceptor m_acceptor;
-    std::shared_ptr<server_socket> m_conn;
     // the local endpoint we are bound to
     address m_local_endpoint;
-    // the managed connections
-    std::set<std::shared_ptr<server_socket> > m_connections;
-    boost::mutex m_mutex;
+    // the managed connections. each one knows its slot, so that it is
+    // removed by moving the last one into it.
+    std::vector<std::shared_ptr<server_socket> > m_connections;
+    std::atomic<int> m_connection_num;
+    mutable boost::mutex m_mutex;
+    size_t m_accepting;  // accepts outstanding
+    bool m_closed;
+    bool m_stepping;   // registered with the step timer
+    std::shared_ptr<step_guard> m_step_guard;
+    // flow control limits applied to each accepted connection
+    size_t m_max_inflight_requests;
+    size_t m_max_pending_bytes;
+    size_t m_max_connections;
+    unsigned int m_idle_timeout;
+    size_t m_pending_accepts;
 
 private:
     server_transport();
@@ -331,12 +450,15 @@ private:
 };
 
 
+static const size_t NOT_REGISTERED = (size_t)-1;
+
 // TCP Server
 
 server_socket::server_socket(server_transport* tran, shared_server svr) :
     stream_handler(svr->get_loop()),
     m_svr(svr),
-    m_tran(tran)
+    m_tran(tran),
+    m_slot(NOT_REGISTERED)
 {
 }
 
@@ -349,7 +471,8 @@ void server_socket::on_request(msgid_t msgid,
     if (!svr) {
         throw closed_exception();
     }
-    svr->on_request(get_response_sender(), msgid, method, params, std::move(z));
+    svr->on_request(get_response_sender(), msgid, method, params, std::move(z),
+            m_read_time, m_trace_id, m_upload);
 }
 
 void server_socket::on_response(msgid_t msgid,
@@ -375,10 +498,22 @@ void server_socket::on_system_error(const boost::system::error_code& err)
 }
 
 
-server_transport::server_transport(server_impl* svr, const address& addr) :
+server_transport::server_transport(server_impl* svr,
+        const address& addr, const tcp_listener& l) :
+    m_loop(svr->get_loop()),
     m_acceptor(svr->get_loop()->io_service()),
-    m_conn()
-{
+    m_connection_num(0),
+    m_accepting(0),
+    m_closed(false),
+    m_stepping(false),
+    m_step_guard(new step_guard()),
+    m_max_inflight_requests(l.max_inflight_requests()),
+    m_max_pending_bytes(l.max_pending_bytes()),
+    m_max_connections(l.max_connections()),
+    m_idle_timeout(l.idle_timeout()),
+    m_pending_accepts(std::max<size_t>(l.pending_accepts(), 1))
+{
+    m_step_guard->tran = this;
     m_wsvr = weak_server(
         std::static_pointer_cast<server_impl>(svr->shared_from_this()));
 
@@ -388,61 +523,192 @@ server_transport::server_transport(server_impl* svr, const address& addr) :
     m_acceptor.open(ep.protocol());
     m_acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
     m_acceptor.bind(ep);
-    m_acceptor.listen();
+    m_acceptor.listen(l.listen_backlog());
 
     // record the local endpoint we are bound to
     auto lep = m_acceptor.local_endpoint();
     m_local_endpoint = address(lep.address(), lep.port());
 
-    start_accept();
+    boost::mutex::scoped_lock lock(m_mutex);
+    start_accepts();
 }
 
 server_transport::~server_transport()
 {
     close();
+    boost::mutex::scoped_lock lk(m_step_guard->mutex);
+    m_step_guard->tran = NULL;
 }
 
 void server_transport::close()
 {
+    boost::mutex::scoped_lock lock(m_mutex);
+    m_closed = true;
+    // the outstanding accepts are cancelled and their sockets go with them
     m_acceptor.close();
-    m_conn.reset();
     // stop all connections
-    boost::mutex::scoped_lock lock(m_mutex);
-    std::for_each(m_connections.begin(), m_connections.end(),
-            std::bind(&server_socket::stop, std::placeholders::_1));
+    for (size_t i = 0; i < m_connections.size(); ++i) {
+        m_connections[i]->m_slot = NOT_REGISTERED;
+        m_connections[i]->stop();
+    }
     m_connections.clear();
+    m_connection_num.store(0);
 }
 
-void server_transport::start_accept()
-{
-    m_conn.reset(new server_socket(this, m_wsvr.lock()));
-    m_acceptor.async_accept(m_conn->socket(),
-        std::bind(&server_transport::on_accept, this, std::placeholders::_1));
+// Called with m_mutex held. Tops up the outstanding accepts, without
+// accepting more connections than the limit allows.
+void server_transport::start_accepts()
+{
+    while (!m_closed && m_accepting < m_pending_accepts &&
+            (m_max_connections == 0 ||
+             m_connections.size() + m_accepting < m_max_connections)) {
+        std::shared_ptr<server_socket> conn(new server_socket(this, m_wsvr.lock()));
+        conn->set_flow_limits(m_max_inflight_requests, m_max_pending_bytes);
+        m_acceptor.async_accept(conn->socket(),
+            std::bind(&server_transport::accepted, m_step_guard, conn,
+                std::placeholders::_1));
+        ++m_accepting;
+    }
 }
 
 void server_transport::on_system_error(std::shared_ptr<server_socket> conn)
 {
     boost::mutex::scoped_lock lock(m_mutex);
-    m_connections.erase(conn);
+    bool was_full = is_full();
+    remove_connection(conn);
     conn->stop();
+
+    if (was_full && !is_full() && !m_closed) {
+        MSGPACK_RPC_LOG(info) << "accepting resumed";
+    }
+    start_accepts();
 }
 
-void server_transport::on_accept(const boost::system::error_code& err)
+void server_transport::accepted(std::shared_ptr<step_guard> guard,
+        std::shared_ptr<server_socket> conn,
+        const boost::system::error_code& err)
 {
+    // an accept cancelled by the destructor completes after it
+    boost::mutex::scoped_lock lk(guard->mutex);
+    if (!guard->tran) {
+        return;
+    }
+    guard->tran->on_accept(conn, err);
+}
+
+void server_transport::on_accept(std::shared_ptr<server_socket> conn,
+        const boost::system::error_code& err)
+{
+    boost::mutex::scoped_lock lock(m_mutex);
+    --m_accepting;
+    if (m_closed) {
+        return;
+    }
+
     if (!err) {
+        // the peer may be gone already, which the first read reports
+        boost::system::error_code ec;
+        add_connection(conn);
+        MSGPACK_RPC_LOG(debug) << "server_socket accepted : " << conn->socket().remote_endpoint(ec);
+        conn->socket().set_option(boost::asio::ip::tcp::no_delay(true), ec);
+        conn->start();
+    }
+
+    if (is_full()) {
+        // the next connections wait in the listen backlog until one closes
+        MSGPACK_RPC_LOG(warning) << "connection limit " << m_max_connections
+            << " reached, accepting paused";
+        return;
+    }
+    start_accepts();
+}
+
+// called with m_mutex held
+void server_transport::add_connection(const std::shared_ptr<server_socket>& conn)
+{
+    conn->m_slot = m_connections.size();
+    m_connections.push_back(conn);
+    ++m_connection_num;
+    watch_idle();
+}
+
+// called with m_mutex held; a connection may be reported more than once
+void server_transport::remove_connection(const std::shared_ptr<server_socket>& conn)
+{
+    size_t slot = conn->m_slot;
+    if (slot == NOT_REGISTERED) {
+        return;
+    }
+    if (slot != m_connections.size() - 1) {
+        m_connections[slot] = m_connections.back();
+        m_connections[slot]->m_slot = slot;
+    }
+    m_connections.pop_back();
+    conn->m_slot = NOT_REGISTERED;
+    --m_connection_num;
+}
+
+bool server_transport::is_full() const
+{
+    return m_max_connections > 0 && m_connections.size() >= m_max_connections;
+}
+
+// called with m_mutex held
+void server_transport::watch_idle()
+{
+    if (m_idle_timeout == 0 || m_stepping) {
+        return;
+    }
+    m_stepping = true;
+    m_loop->add_step(std::bind(&server_transport::step, m_step_guard));
+}
+
+bool server_transport::step(std::shared_ptr<step_guard> guard)
+{
+    boost::mutex::scoped_lock lk(guard->mutex);
+    if (!guard->tran) {
+        return false;
+    }
+    return guard->tran->step_idle();
+}
+
+bool server_transport::step_idle()
+{
+    std::vector<std::shared_ptr<server_socket> > idle;
+    {
         boost::mutex::scoped_lock lock(m_mutex);
-        m_connections.insert(m_conn);
-        BOOST_LOG_TRIVIAL(debug) << "server_socket accepted : " << m_conn->socket().remote_endpoint();
-        m_conn->socket().set_option(boost::asio::ip::tcp::no_delay(true));
-        m_conn->start();
+        for (size_t i = 0; i < m_connections.size(); ++i) {
+            if (m_connections[i]->step_idle() >= m_idle_timeout) {
+                idle.push_back(m_connections[i]);
+            }
+        }
+        if (m_connections.empty()) {
+            // leave the timer until the next connection is accepted
+            m_stepping = false;
+            return false;
+        }
     }
 
-    start_accept();
+    for (size_t i = 0; i < idle.size(); ++i) {
+        MSGPACK_RPC_LOG(debug) << "closing idle connection";
+        idle[i]->shutdown();
+    }
+    return true;
 }
 
 int server_transport::get_connection_num() const
 {
-    return m_connections.size();
+    return m_connection_num.load();
+}
+
+size_t server_transport::get_connection_memory() const
+{
+    boost::mutex::scoped_lock lock(m_mutex);
+    size_t bytes = 0;
+    for (size_t i = 0; i < m_connections.size(); ++i) {
+        bytes += m_connections[i]->memory_usage();
+    }
+    return bytes;
 }
 
 const address& server_transport::get_local_endpoint() const
@@ -456,7 +722,8 @@ const address& server_transport::get_local_endpoint() const
 
 tcp_builder::tcp_builder() :
     m_connect_timeout(10.0),
-    m_reconnect_limit(3)
+    m_reconnect_limit(3),
+    m_inline_io(false)
 { }
 
 tcp_builder::~tcp_builder() { }
@@ -470,17 +737,29 @@ tcp_builder::build(session_impl* s, const address& addr) const
 
 
 tcp_listener::tcp_listener(const std::string& host, uint16_t port) :
-    m_addr(address(host, port)) { }
+    m_addr(address(host, port)),
+    m_max_inflight_requests(1024),
+    m_max_pending_bytes(16 * 1024 * 1024),
+    m_max_connections(0),
+    m_idle_timeout(0),
+    m_pending_accepts(8),
+    m_listen_backlog(boost::asio::socket_base::max_connections) { }
 
 tcp_listener::tcp_listener(const address& addr) :
-    m_addr(addr) { }
+    m_addr(addr),
+    m_max_inflight_requests(1024),
+    m_max_pending_bytes(16 * 1024 * 1024),
+    m_max_connections(0),
+    m_idle_timeout(0),
+    m_pending_accepts(8),
+    m_listen_backlog(boost::asio::socket_base::max_connections) { }
 
 tcp_listener::~tcp_listener() { }
 
 std::unique_ptr<server_transport> tcp_listener::listen(server_impl* svr) const
 {
     return std::unique_ptr<server_transport>(
-            new transport::tcp::server_transport(svr, m_addr));
+            new transport::tcp::server_transport(svr, m_addr, *this));
 }
 
 
@@ -45,9 +45,23 @@ public:
 	unsigned int reconnect_limit() const
 		{ return m_reconnect_limit; }
 
+	// Inline IO, for strict request/response clients with one caller
+	// thread per session: a synchronous call whose request is the only
+	// one outstanding reads and parses its reply on the caller thread,
+	// with no handoff from a loop thread. Replies are read on the loop
+	// while other requests are outstanding or callbacks are attached.
+	// A reply is only read when something waits for it, so polling
+	// future::is_ready() alone does not complete a call.
+	tcp_builder& inline_io(bool enable)
+		{ m_inline_io = enable; return *this; }
+
+	bool inline_io() const
+		{ return m_inline_io; }
+
 public:
 	double m_connect_timeout;
 	unsigned int m_reconnect_limit;
+	bool m_inline_io;
 };
 
 
@@ -60,8 +74,66 @@ public:
 
 	std::unique_ptr<server_transport> listen(server_impl* svr) const;
 
+	// per-connection flow control: reading from a connection is paused
+	// while either limit is reached. 0 means unlimited.
+	// Responses are written synchronously, so the pending bytes are those
+	// held back in a response batch or in a write that blocks on a peer
+	// that does not read. Responses to a peer that reads them never count
+	// for long, and max_inflight_requests is what bounds the work queued.
+	tcp_listener& max_inflight_requests(size_t num)
+		{ m_max_inflight_requests = num; return *this; }
+
+	size_t max_inflight_requests() const
+		{ return m_max_inflight_requests; }
+
+	tcp_listener& max_pending_bytes(size_t bytes)
+		{ m_max_pending_bytes = bytes; return *this; }
+
+	size_t max_pending_bytes() const
+		{ return m_max_pending_bytes; }
+
+	// connections open at a time; accepting is paused while the limit
+	// is reached, leaving new connections in the listen backlog.
+	// 0 means unlimited.
+	tcp_listener& max_connections(size_t num)
+		{ m_max_connections = num; return *this; }
+
+	size_t max_connections() const
+		{ return m_max_connections; }
+
+	// a connection that has not sent anything and has no request in
+	// progress for this many seconds is closed. 0 keeps it open.
+	tcp_listener& idle_timeout(unsigned int sec)
+		{ m_idle_timeout = sec; return *this; }
+
+	unsigned int idle_timeout() const
+		{ return m_idle_timeout; }
+
+	// accepts kept outstanding on the listening socket. A burst of
+	// connections is taken off the backlog this many at a time per
+	// wakeup of the loop, instead of one per round trip through it.
+	tcp_listener& pending_accepts(size_t num)
+		{ m_pending_accepts = num; return *this; }
+
+	size_t pending_accepts() const
+		{ return m_pending_accepts; }
+
+	// length of the listen backlog, SOMAXCONN by default. The kernel
+	// caps it at net.core.somaxconn.
+	tcp_listener& listen_backlog(int num)
+		{ m_listen_backlog = num; return *this; }
+
+	int listen_backlog() const
+		{ return m_listen_backlog; }
+
 private:
 	address m_addr;
+	size_t m_max_inflight_requests;
+	size_t m_max_pending_bytes;
+	size_t m_max_connections;
+	unsigned int m_idle_timeout;
+	size_t m_pending_accepts;
+	int m_listen_backlog;
 
 private:
 	tcp_listener();
@@ -18,9 +18,9 @@
 #include "udp.h"
 
 #include "dgram_handler.h"
+#include "../log.h"
 #include "../types.h"
 
-#include <boost/log/trivial.hpp>
 #include <iostream>
 #include <vector>
 
@@ -43,6 +43,7 @@ public:
     void on_request(msgid_t msgid, object method, object params, auto_zone z,
                     boost::asio::ip::udp::endpoint& ep);
     void on_response(msgid_t msgid, object result, object error, auto_zone z);
+    void on_response_chunk(msgid_t msgid, object chunk, auto_zone z);
     void on_notify(object method, object params, auto_zone z);
 
 private:
@@ -62,6 +63,7 @@ public:
 
 public:
     void send_data(sbuffer* sbuf);
+    void send_data(send_buffer* buf);
     void send_data(auto_vreflife vbuf);
 
 private:
@@ -87,12 +89,12 @@ client_socket::~client_socket() { }
 void client_socket::connect(const address& addr)
 {
     boost::asio::ip::udp::endpoint ep(addr.get_addr(), addr.get_port());
-    BOOST_LOG_TRIVIAL(debug) << "connecting to " << addr;
+    MSGPACK_RPC_LOG(debug) << "connecting to " << addr;
 
     boost::system::error_code ec;
     socket().connect(ep, ec);
     if (ec) {
-        BOOST_LOG_TRIVIAL(warning) << "connect failed : " << ec.message();
+        MSGPACK_RPC_LOG(warning) << "connect failed : " << ec.message();
         socket().close();
         return;
     }
@@ -117,7 +119,17 @@ void client_socket::on_response(msgid_t msgid,
     if(!s) {
         throw closed_exception();
     }
-    s->on_response(msgid, result, error, std::move(z));
+    s->on_response(msgid, result, error, std::move(z), m_read_time);
+}
+
+void client_socket::on_response_chunk(msgid_t msgid,
+        object chunk, auto_zone z)
+{
+    shared_session s = m_session.lock();
+    if (!s) {
+        throw closed_exception();
+    }
+    s->on_response_chunk(msgid, chunk, std::move(z));
 }
 
 void client_socket::on_notify(
@@ -155,6 +167,17 @@ void client_transport::send_data(sbuffer* sbuf)
     m_conn->send_data(sbuf);
 }
 
+void client_transport::send_data(send_buffer* buf)
+{
+    if (!m_session->get_loop()->is_running())
+        m_session->get_loop()->flush();
+
+    if (!m_conn->socket().is_open())
+        m_conn->connect(m_session->get_address());
+
+    m_conn->send_data(buf);
+}
+
 void client_transport::send_data(auto_vreflife vbuf)
 {
     if (!m_session->get_loop()->is_running())
@@ -198,6 +221,7 @@ public:
 
     virtual void close();
     virtual int get_connection_num() const;
+    virtual size_t get_connection_memory() const;
     virtual const address& get_local_endpoint() const;
 
 private:
@@ -240,7 +264,8 @@ void server_socket::on_request(
     if (!svr) {
         throw closed_exception();
     }
-    svr->on_request(get_response_sender(ep), msgid, method, params, std::move(z));
+    svr->on_request(get_response_sender(ep), msgid, method, params, std::move(z),
+            m_read_time, m_trace_id);
 }
 
 void server_socket::on_response(msgid_t msgid,
@@ -284,6 +309,11 @@ int server_transport::get_connection_num() const
     throw std::runtime_error("not supported in udp");
 }
 
+size_t server_transport::get_connection_memory() const
+{
+    throw std::runtime_error("not supported in udp");
+}
+
 const address& server_transport::get_local_endpoint() const
 {
     return m_local_endpoint;
@@ -20,6 +20,7 @@
 
 #include "transport.h"
 #include "message_sendable.h"
+#include "priority.h"
 
 namespace msgpack {
 namespace rpc {
@@ -30,6 +31,35 @@ class client_transport : public message_sendable
 public:
     client_transport() { }
     //virtual void close() = 0;
+
+    using message_sendable::send_data;
+
+    // transports without priority lanes send everything in arrival order
+    virtual void send_data(sbuffer* sbuf, priority_t prio) {
+        send_data(sbuf);
+    }
+    virtual void send_data(send_buffer* buf, priority_t prio) {
+        send_data(buf);
+    }
+    virtual void send_data(auto_vreflife vbuf, priority_t prio) {
+        send_data(std::move(vbuf));
+    }
+
+    // Inline IO: replies may be read on the thread that waits for them.
+    // Transports without it always read on the loop.
+    virtual bool is_inline_io() const {
+        return false;
+    }
+
+    // Reads and dispatches messages on the calling thread until 'done'
+    // returns true or 'timeout_ms' passes. Returns false, without reading,
+    // if the loop is reading or another thread already reads inline.
+    virtual bool read_inline(std::function<bool ()> done, unsigned int timeout_ms) {
+        return false;
+    }
+
+    // Makes the loop read replies, for requests nobody will wait on inline
+    virtual void request_async_read() { }
 };
 
 
@@ -40,6 +70,8 @@ public:
     virtual ~server_transport() { }
     virtual void close() = 0;
     virtual int get_connection_num() const = 0;
+    // bytes held by the accepted connections
+    virtual size_t get_connection_memory() const = 0;
     virtual const address& get_local_endpoint() const = 0;
 };
 
@@ -25,7 +25,23 @@ namespace msgpack {
 namespace rpc {
 
 
-typedef std::unique_ptr<zone> auto_zone;
+class zone_pool;
+
+// Deletes a zone, or hands it back to the pool it came from
+struct zone_deleter {
+    zone_deleter() : generation(0), chunk_size(0) { }
+    zone_deleter(const std::default_delete<zone>&) : generation(0), chunk_size(0) { }
+    zone_deleter(std::shared_ptr<zone_pool> p, unsigned int gen, size_t size) :
+        pool(p), generation(gen), chunk_size(size) { }
+
+    void operator() (zone* z) const;
+
+    std::shared_ptr<zone_pool> pool;
+    unsigned int generation;
+    size_t chunk_size;  // of the zone's first chunk, kept by clear()
+};
+
+typedef std::unique_ptr<zone, zone_deleter> auto_zone;
 typedef std::shared_ptr<zone> shared_zone;
 
 
@@ -0,0 +1,219 @@
+//
+// msgpack::rpc::upload_reader - MessagePack-RPC for C++
+//
+// Copyright (C) 2009-2010 FURUHASHI Sadayuki
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+#include "upload_reader.h"
+#include "log.h"
+
+#include <stdexcept>
+
+namespace msgpack {
+namespace rpc {
+
+
+upload_reader::upload_reader(account_t queued, account_t consumed,
+                             std::function<bool ()> is_reading) :
+    m_delivering(false),
+    m_ended(false),
+    m_aborted(false),
+    m_discarded(false),
+    m_queued(queued),
+    m_consumed(consumed),
+    m_is_reading(is_reading)
+{
+}
+
+upload_reader::~upload_reader()
+{
+    discard();
+}
+
+size_t upload_reader::size_of(const object& chunk)
+{
+    switch (chunk.type) {
+    case msgpack::type::BIN:
+        return chunk.via.bin.size;
+    case msgpack::type::STR:
+        return chunk.via.str.size;
+    default:
+        return sizeof(object);
+    }
+}
+
+void upload_reader::push(object chunk, auto_zone z)
+{
+    entry e;
+    e.obj = chunk;
+    e.z = std::move(z);
+    e.nbytes = size_of(chunk);
+    e.last = false;
+    add(std::move(e));
+}
+
+void upload_reader::end()
+{
+    entry e;
+    e.nbytes = 0;
+    e.last = true;
+    add(std::move(e));
+}
+
+void upload_reader::abort()
+{
+    {
+        boost::mutex::scoped_lock lk(m_mutex);
+        m_aborted = true;
+    }
+    end();
+}
+
+void upload_reader::add(entry e)
+{
+    // counted before it can be taken, so that the count never drops
+    // below what is queued
+    if (e.nbytes && m_queued) {
+        m_queued(e.nbytes);
+    }
+
+    boost::mutex::scoped_lock lk(m_mutex);
+    if (m_ended || m_discarded) {
+        lk.unlock();
+        if (e.nbytes && m_consumed) {
+            m_consumed(e.nbytes);
+        }
+        return;
+    }
+    m_ended = e.last;
+    m_queue.push_back(std::move(e));
+
+    if (!m_func) {
+        m_cond.notify_all();
+    } else if (!m_delivering) {
+        deliver(lk);
+    }
+}
+
+void upload_reader::deliver(boost::mutex::scoped_lock& lk)
+{
+    m_delivering = true;
+    while (!m_queue.empty()) {
+        entry e = std::move(m_queue.front());
+        m_queue.pop_front();
+
+        // the function usually holds the request, which holds this reader
+        chunk_func_t func;
+        if (e.last) {
+            func.swap(m_func);
+        }
+        lk.unlock();
+
+        if (e.nbytes && m_consumed) {
+            m_consumed(e.nbytes);
+        }
+        try {
+            if (e.last) {
+                func(object(), auto_zone());
+            } else {
+                m_func(e.obj, std::move(e.z));
+            }
+        } catch (std::exception& ex) {
+            MSGPACK_RPC_LOG(warning) << "upload chunk handler error: " << ex.what();
+        } catch (...) {
+            MSGPACK_RPC_LOG(warning) << "upload chunk handler error: unknown error";
+        }
+
+        lk.lock();
+    }
+    m_delivering = false;
+}
+
+bool upload_reader::next(object* chunk, auto_zone* z)
+{
+    if (m_is_reading && m_is_reading()) {
+        throw std::logic_error(
+                "next_chunk() on the thread that reads the connection");
+    }
+
+    boost::mutex::scoped_lock lk(m_mutex);
+    while (m_queue.empty()) {
+        if (m_ended || m_discarded) {
+            return false;
+        }
+        m_cond.wait(lk);
+    }
+
+    entry e = std::move(m_queue.front());
+    m_queue.pop_front();
+    lk.unlock();
+
+    if (e.nbytes && m_consumed) {
+        m_consumed(e.nbytes);
+    }
+    if (e.last) {
+        return false;
+    }
+    *chunk = e.obj;
+    *z = std::move(e.z);
+    return true;
+}
+
+void upload_reader::on_chunk(chunk_func_t func)
+{
+    boost::mutex::scoped_lock lk(m_mutex);
+    if (m_discarded) {
+        return;
+    }
+    m_func = func;
+    if (!m_delivering && !m_queue.empty()) {
+        deliver(lk);
+    }
+}
+
+void upload_reader::discard()
+{
+    std::deque<entry> dropped;
+    chunk_func_t func;
+    {
+        boost::mutex::scoped_lock lk(m_mutex);
+        if (m_discarded) {
+            return;
+        }
+        m_discarded = true;
+        dropped.swap(m_queue);
+        if (!m_delivering) {
+            func.swap(m_func);
+        }
+        m_cond.notify_all();
+    }
+
+    size_t nbytes = 0;
+    for (std::deque<entry>::iterator it = dropped.begin(); it != dropped.end(); ++it) {
+        nbytes += it->nbytes;
+    }
+    if (nbytes && m_consumed) {
+        m_consumed(nbytes);
+    }
+}
+
+bool upload_reader::is_aborted() const
+{
+    boost::mutex::scoped_lock lk(m_mutex);
+    return m_aborted;
+}
+
+
+}  // namespace rpc
+}  // namespace msgpack
@@ -0,0 +1,106 @@
+//
+// msgpack::rpc::upload_reader - MessagePack-RPC for C++
+//
+// Copyright (C) 2009-2010 FURUHASHI Sadayuki
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+#ifndef MSGPACK_RPC_UPLOAD_READER_H__
+#define MSGPACK_RPC_UPLOAD_READER_H__
+
+#include "types.h"
+
+#include <boost/thread.hpp>
+#include <deque>
+#include <functional>
+#include <memory>
+
+namespace msgpack {
+namespace rpc {
+
+
+// The receiving end of a request's streamed arguments. The connection
+// pushes the chunks as they are read; the handler takes them through
+// next(), or has them passed to a function set by on_chunk().
+//
+// Chunks waiting in the queue are reported to 'queued' and, once taken or
+// dropped, to 'consumed', so that the connection stops reading while too
+// many of them wait. 'is_reading' tells whether the calling thread is the
+// one reading the connection.
+class upload_reader {
+public:
+    typedef std::function<void (size_t nbytes)> account_t;
+    typedef std::function<void (object chunk, auto_zone z)> chunk_func_t;
+
+    upload_reader(account_t queued, account_t consumed,
+                  std::function<bool ()> is_reading = std::function<bool ()>());
+    ~upload_reader();
+
+    // on the reading thread
+    void push(object chunk, auto_zone z);
+    void end();
+    void abort();
+
+    // Waits for the next chunk; false at the end. Throws std::logic_error
+    // on the thread that reads the connection, which would wait for
+    // chunks only it can push.
+    bool next(object* chunk, auto_zone* z);
+
+    // 'func' gets every chunk not taken yet, in order, and a nil object
+    // at the end. It runs on the thread that calls on_chunk() for the
+    // chunks already queued and then on the reading thread.
+    void on_chunk(chunk_func_t func);
+
+    // the handler is done with the request: the rest is dropped
+    void discard();
+
+    bool is_aborted() const;
+
+    // the bytes a chunk is counted for
+    static size_t size_of(const object& chunk);
+
+private:
+    struct entry {
+        object obj;
+        auto_zone z;
+        size_t nbytes;
+        bool last;
+    };
+
+    void add(entry e);
+    void deliver(boost::mutex::scoped_lock& lk);
+
+    mutable boost::mutex m_mutex;
+    boost::condition_variable m_cond;
+    std::deque<entry> m_queue;
+    chunk_func_t m_func;
+    bool m_delivering;  // a thread is passing the queue to m_func
+    bool m_ended;       // the last entry was pushed
+    bool m_aborted;
+    bool m_discarded;
+
+    account_t m_queued;
+    account_t m_consumed;
+    std::function<bool ()> m_is_reading;
+
+private:
+    upload_reader(const upload_reader&);
+};
+
+typedef std::shared_ptr<upload_reader> shared_upload_reader;
+
+
+}  // namespace rpc
+}  // namespace msgpack
+
+#endif /* msgpack/rpc/upload_reader.h */
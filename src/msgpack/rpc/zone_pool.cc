@@ -0,0 +1,213 @@
+//
+// msgpack::rpc::zone_pool - MessagePack-RPC for C++
+//
+// Copyright (C) 2009-2010 FURUHASHI Sadayuki
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+#include "zone_pool.h"
+
+#include <algorithm>
+
+namespace msgpack {
+namespace rpc {
+
+
+#ifndef MSGPACK_RPC_ZONE_POOL_SIZE
+#define MSGPACK_RPC_ZONE_POOL_SIZE 32
+#endif
+
+// the fast path copies strings out of the read buffer, so it is only taken
+// while little is buffered
+#ifndef MSGPACK_RPC_ZONE_COPY_LIMIT
+#define MSGPACK_RPC_ZONE_COPY_LIMIT (16*1024)
+#endif
+
+// messages looked at before the chunk size may shrink
+static const size_t LEARN_WINDOW = 1024;
+
+
+void zone_deleter::operator() (zone* z) const
+{
+    if (pool) {
+        pool->put(z, generation, chunk_size);
+    } else {
+        delete z;
+    }
+}
+
+
+zone_pool::zone_pool() :
+    m_free_bytes(0),
+    m_chunk_size(8 * 1024),
+    m_generation(0),
+    m_window_peak(0),
+    m_window_count(0),
+    m_created(0),
+    m_reused(0)
+{
+}
+
+zone_pool::~zone_pool()
+{
+    for (size_t i = 0; i < m_free.size(); ++i) {
+        delete m_free[i].z;
+    }
+}
+
+// a pooled zone keeps its first chunk
+static size_t zone_bytes(size_t chunk_size)
+{
+    return sizeof(zone) + chunk_size;
+}
+
+auto_zone zone_pool::get()
+{
+    unsigned int generation = m_generation.load(std::memory_order_relaxed);
+    zone* z = NULL;
+    size_t chunk_size = m_chunk_size;
+    {
+        boost::mutex::scoped_lock lk(m_mutex);
+        while (!m_free.empty()) {
+            free_zone e = m_free.back();
+            m_free.pop_back();
+            m_free_bytes -= zone_bytes(e.chunk_size);
+            if (e.generation == generation) {
+                z = e.z;
+                chunk_size = e.chunk_size;
+                break;
+            }
+            delete e.z;
+        }
+    }
+
+    if (z) {
+        m_reused.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        z = new zone(chunk_size);
+        m_created.fetch_add(1, std::memory_order_relaxed);
+    }
+    return auto_zone(z, zone_deleter(shared_from_this(), generation, chunk_size));
+}
+
+void zone_pool::put(zone* z, unsigned int generation, size_t chunk_size)
+{
+    if (generation == m_generation.load(std::memory_order_relaxed)) {
+        // runs the finalizers and frees every chunk but the first
+        z->clear();
+
+        boost::mutex::scoped_lock lk(m_mutex);
+        if (m_free.size() < MSGPACK_RPC_ZONE_POOL_SIZE) {
+            free_zone e = { z, generation, chunk_size };
+            m_free.push_back(e);
+            m_free_bytes += zone_bytes(chunk_size);
+            return;
+        }
+    }
+    delete z;
+}
+
+size_t zone_pool::free_bytes()
+{
+    boost::mutex::scoped_lock lk(m_mutex);
+    return m_free_bytes;
+}
+
+void zone_pool::trim()
+{
+    std::vector<free_zone> freed;
+    {
+        boost::mutex::scoped_lock lk(m_mutex);
+        freed.swap(m_free);
+        m_free_bytes = 0;
+    }
+    for (size_t i = 0; i < freed.size(); ++i) {
+        delete freed[i].z;
+    }
+}
+
+static bool never_reference(type::object_type type, size_t length, void* user_data)
+{
+    return false;
+}
+
+bool zone_pool::next(unpacker* pac, object* msg, auto_zone* z)
+{
+    size_t avail = pac->nonparsed_size();
+    if (avail == 0) {
+        return false;
+    }
+
+    // parsed_size() is nonzero while the unpacker holds part of a message
+    if (pac->parsed_size() == 0 && avail <= MSGPACK_RPC_ZONE_COPY_LIMIT) {
+        auto_zone pz = get();
+        uintptr_t start = (uintptr_t)pz->allocate_no_align(0);
+        size_t off = 0;
+        bool referenced = false;
+        try {
+            *msg = msgpack::unpack(*pz, pac->nonparsed_buffer(), avail, off,
+                    referenced, &never_reference);
+        } catch (msgpack::insufficient_bytes&) {
+            off = 0;
+        }
+
+        if (off > 0) {
+            // the zone's cursor moved within the first chunk, or on to
+            // another chunk when the message did not fit
+            uintptr_t end = (uintptr_t)pz->allocate_no_align(0);
+            bool spilled = end < start || end - start > m_chunk_size;
+            learn(spilled ? 0 : end - start, spilled);
+
+            pac->skip_nonparsed_buffer(off);
+            *z = std::move(pz);
+            return true;
+        }
+        // cut off by the end of the buffer: the unpacker carries it over
+    }
+
+    msgpack::unpacked result;
+    if (!pac->next(&result)) {
+        return false;
+    }
+    *msg = result.get();
+    *z = auto_zone(result.zone().release());
+    return true;
+}
+
+void zone_pool::learn(size_t used, bool spilled)
+{
+    if (spilled) {
+        if (m_chunk_size < MAX_CHUNK_SIZE) {
+            m_chunk_size *= 2;
+            m_generation.fetch_add(1, std::memory_order_relaxed);
+        }
+        m_window_peak = 0;
+        m_window_count = 0;
+        return;
+    }
+
+    m_window_peak = std::max(m_window_peak, used);
+    if (++m_window_count < LEARN_WINDOW) {
+        return;
+    }
+    if (m_window_peak * 4 <= m_chunk_size && m_chunk_size > MIN_CHUNK_SIZE) {
+        m_chunk_size /= 2;
+        m_generation.fetch_add(1, std::memory_order_relaxed);
+    }
+    m_window_peak = 0;
+    m_window_count = 0;
+}
+
+
+}  // namespace rpc
+}  // namespace msgpack
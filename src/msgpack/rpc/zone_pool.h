@@ -0,0 +1,104 @@
+//
+// msgpack::rpc::zone_pool - MessagePack-RPC for C++
+//
+// Copyright (C) 2009-2010 FURUHASHI Sadayuki
+//
+//    Licensed under the Apache License, Version 2.0 (the "License");
+//    you may not use this file except in compliance with the License.
+//    You may obtain a copy of the License at
+//
+//        http://www.apache.org/licenses/LICENSE-2.0
+//
+//    Unless required by applicable law or agreed to in writing, software
+//    distributed under the License is distributed on an "AS IS" BASIS,
+//    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//    See the License for the specific language governing permissions and
+//    limitations under the License.
+//
+#ifndef MSGPACK_RPC_ZONE_POOL_H__
+#define MSGPACK_RPC_ZONE_POOL_H__
+
+#include "types.h"
+
+#include <atomic>
+#include <boost/thread.hpp>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+namespace msgpack {
+namespace rpc {
+
+
+// Zones for the messages a connection receives. A zone handed out by get()
+// goes back to its pool when its auto_zone is destroyed, on whatever
+// thread that happens, and is cleared and reused: clearing keeps the
+// zone's first chunk, so a message that fits in it costs no allocation.
+//
+// The chunk size is learned from the messages unpacked by next(): it
+// doubles when a message spills out of its chunk and halves after a run of
+// messages that all used less than a quarter of it. Zones of an older size
+// are freed rather than kept.
+class zone_pool : public std::enable_shared_from_this<zone_pool> {
+public:
+    zone_pool();
+    ~zone_pool();
+
+    static const size_t MIN_CHUNK_SIZE = 1024;
+    static const size_t MAX_CHUNK_SIZE = 64 * 1024;
+
+    auto_zone get();
+
+    // Unpacks the next message buffered in 'pac'. A message that lies whole
+    // in a small buffer is unpacked straight into a pooled zone, with its
+    // strings copied out of the buffer. One cut off by the end of the
+    // buffer, or in a buffer larger than the copy limit, is left to the
+    // unpacker and its own zone.
+    bool next(unpacker* pac, object* msg, auto_zone* z);
+
+    size_t chunk_size() const { return m_chunk_size; }
+
+    // bytes held by the zones waiting for reuse, and freeing them, as
+    // when the connection has gone quiet
+    size_t free_bytes();
+    void trim();
+
+    // zones created and zones reused, since the pool was made
+    uint64_t created() const { return m_created.load(std::memory_order_relaxed); }
+    uint64_t reused() const { return m_reused.load(std::memory_order_relaxed); }
+
+private:
+    friend struct zone_deleter;
+    void put(zone* z, unsigned int generation, size_t chunk_size);
+
+    // only called by the reading thread
+    void learn(size_t used, bool spilled);
+
+    struct free_zone {
+        zone* z;
+        unsigned int generation;
+        size_t chunk_size;
+    };
+    boost::mutex m_mutex;
+    std::vector<free_zone> m_free;
+    size_t m_free_bytes;
+
+    // chunk size of new zones and its generation, bumped on every change
+    size_t m_chunk_size;
+    std::atomic<unsigned int> m_generation;
+
+    size_t m_window_peak;
+    size_t m_window_count;
+
+    std::atomic<uint64_t> m_created;
+    std::atomic<uint64_t> m_reused;
+
+private:
+    zone_pool(const zone_pool&);
+};
+
+
+}  // namespace rpc
+}  // namespace msgpack
+
+#endif /* msgpack/rpc/zone_pool.h */
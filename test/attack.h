@@ -2,17 +2,22 @@
 
 #include <boost/log/trivial.hpp>
 #include <boost/thread.hpp>
+#include <chrono>
 #include <functional>
+#include <iomanip>
 #include <iostream>
 #include <memory>
 #include <msgpack/rpc/server.h>
 #include <msgpack/rpc/client.h>
+#include <msgpack/rpc/session_pool.h>
+#include <msgpack/rpc/stats.h>
 #include <msgpack/rpc/transport/tcp.h>
 #include <msgpack/rpc/transport/udp.h>
 #include <numeric>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
+#include <thread>
 #include <unistd.h>
 
 
@@ -38,7 +43,17 @@ public:
 			m_builder.reset(new rpc::udp_builder());
 		} else {
 			m_listen_addr = rpc::address("0.0.0.0", port);
-			m_listener.reset(new rpc::tcp_listener(m_listen_addr));
+			rpc::tcp_listener* l = new rpc::tcp_listener(m_listen_addr);
+			m_listener.reset(l);
+
+			const char* env_accepts = getenv("TEST_ACCEPTS");
+			if(env_accepts && atoi(env_accepts)) {
+				l->pending_accepts(atoi(env_accepts));
+			}
+			const char* env_backlog = getenv("TEST_BACKLOG");
+			if(env_backlog && atoi(env_backlog)) {
+				l->listen_backlog(atoi(env_backlog));
+			}
 
 			m_connect_addr = rpc::address("127.0.0.1", port);
 			m_builder.reset(new rpc::tcp_builder());
@@ -81,6 +96,11 @@ public:
 			m_threads[i]->join();
             delete m_threads[i];
 		}
+		end_server();
+	}
+
+	void end_server()
+	{
 		m_svr->end();
 	}
 
@@ -105,6 +125,16 @@ public:
 		std::cout
 			<< "total time    : " << sum << "\n"
 			<< "variance      : " << var << std::endl;
+
+		rpc::latency_stats stats = m_svr->get_stats();
+		for(rpc::latency_stats::const_iterator it = stats.begin(); it != stats.end(); ++it) {
+			const rpc::latency_histogram& h = it->second;
+			std::cout
+				<< "server " << it->first << " usec : count " << h.count()
+				<< " p50 " << h.percentile(50)
+				<< " p99 " << h.percentile(99)
+				<< " max " << h.max() << std::endl;
+		}
 	}
 
 	void run(size_t nthreads, std::function<void ()> func)
@@ -116,6 +146,148 @@ public:
 		join_server();
 	}
 
+	struct open_loop_report {
+		double target_rate;    // requests per second
+		double achieved_rate;  // completed requests per second
+		size_t sent;
+		size_t completed;
+		size_t errors;
+		rpc::latency_histogram latency;  // usec from the scheduled send time
+	};
+
+	// Open-loop load: 'nsenders' threads together issue 'rate' requests per
+	// second for 'seconds', each at its scheduled time whether or not
+	// earlier replies have come back. Latency is taken from the scheduled
+	// time, not the actual send, so a stall on either side shows up in the
+	// tail instead of quietly slowing the senders (coordinated omission).
+	// The server must be running.
+	open_loop_report run_open_loop(rpc::session_pool& sp, double rate, double seconds,
+			size_t nsenders, std::function<rpc::future (rpc::session&)> call)
+	{
+		typedef std::chrono::steady_clock clock_type;
+
+		std::shared_ptr<open_loop_state> st(new open_loop_state());
+		st->start = clock_type::now() + std::chrono::milliseconds(10);
+		st->interval = std::chrono::duration<double>(1.0 / rate);
+		st->total = (size_t)(rate * seconds);
+
+		std::vector<boost::thread*> senders(nsenders);
+		for(size_t i=0; i < nsenders; ++i) {
+			senders[i] = new boost::thread(std::bind(&attacker::open_loop_sender,
+						st, &sp, m_connect_addr, call, i, nsenders));
+		}
+		for(size_t i=0; i < nsenders; ++i) {
+			senders[i]->join();
+			delete senders[i];
+		}
+
+		// replies still in flight either arrive or time out in the session
+		{
+			boost::mutex::scoped_lock lk(st->mutex);
+			while(st->completed < st->sent) {
+				st->cond.wait(lk);
+			}
+		}
+
+		open_loop_report r;
+		r.target_rate = rate;
+		r.sent = st->sent;
+		r.completed = st->completed;
+		r.errors = st->errors;
+		r.latency = st->latency;
+		double elapsed = std::chrono::duration<double>(st->last - st->start).count();
+		r.achieved_rate = elapsed > 0 ? (r.completed - r.errors) / elapsed : 0;
+		return r;
+	}
+
+	static void show_open_loop_header()
+	{
+		std::cout
+			<< "  target/s  achieved/s      p50      p90      p99    p99.9      max   errors (usec)"
+			<< std::endl;
+	}
+
+	static void show_open_loop(const open_loop_report& r)
+	{
+		const rpc::latency_histogram& h = r.latency;
+		std::cout
+			<< std::setw(10) << (uint64_t)r.target_rate
+			<< std::setw(12) << (uint64_t)r.achieved_rate
+			<< std::setw(9) << h.percentile(50)
+			<< std::setw(9) << h.percentile(90)
+			<< std::setw(9) << h.percentile(99)
+			<< std::setw(9) << h.percentile(99.9)
+			<< std::setw(9) << h.max()
+			<< std::setw(9) << r.errors << std::endl;
+	}
+
+private:
+	struct open_loop_state {
+		std::chrono::steady_clock::time_point start;
+		std::chrono::duration<double> interval;
+		size_t total;
+
+		boost::mutex mutex;
+		boost::condition_variable cond;
+		size_t sent;
+		size_t completed;
+		size_t errors;
+		std::chrono::steady_clock::time_point last;
+		rpc::latency_histogram latency;
+
+		open_loop_state() : total(0), sent(0), completed(0), errors(0) { }
+	};
+
+	// sends requests sender, sender + nsenders, ... of the schedule
+	static void open_loop_sender(std::shared_ptr<open_loop_state> st,
+			rpc::session_pool* sp, rpc::address addr,
+			std::function<rpc::future (rpc::session&)> call,
+			size_t sender, size_t nsenders)
+	{
+		typedef std::chrono::steady_clock clock_type;
+		rpc::session s = sp->get_session(addr);
+
+		for(size_t k = sender; k < st->total; k += nsenders) {
+			clock_type::time_point scheduled = st->start +
+				std::chrono::duration_cast<clock_type::duration>(st->interval * (double)k);
+			std::this_thread::sleep_until(scheduled);
+
+			{
+				boost::mutex::scoped_lock lk(st->mutex);
+				++st->sent;
+			}
+			try {
+				rpc::future f = call(s);
+				f.attach_callback(std::bind(&attacker::open_loop_done,
+							st, scheduled, std::placeholders::_1));
+			} catch (std::exception& e) {
+				BOOST_LOG_TRIVIAL(error) << "error: " << e.what();
+				boost::mutex::scoped_lock lk(st->mutex);
+				++st->completed;
+				++st->errors;
+				st->cond.notify_all();
+			}
+		}
+	}
+
+	static void open_loop_done(std::shared_ptr<open_loop_state> st,
+			std::chrono::steady_clock::time_point scheduled, rpc::future f)
+	{
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		bool failed = f.error().type != msgpack::type::NIL;
+
+		boost::mutex::scoped_lock lk(st->mutex);
+		++st->completed;
+		if(failed) {
+			++st->errors;
+		} else {
+			st->latency.record(std::chrono::duration_cast<std::chrono::microseconds>(
+						now - scheduled).count());
+		}
+		st->last = now;
+		st->cond.notify_all();
+	}
+
 private:
 	rpc::address m_listen_addr;
 	std::unique_ptr<rpc::listener> m_listener;
@@ -1,11 +1,16 @@
 #include "attack.h"
 
+#include <algorithm>
+#include <boost/asio.hpp>
 #include <boost/log/core.hpp>
 #include <boost/log/expressions.hpp>
 #include <boost/log/trivial.hpp>
+#include <boost/thread.hpp>
+#include <chrono>
 #include <functional>
 #include <iostream>
 #include <signal.h>
+#include <string>
 #include <vector>
 
 static size_t ATTACK_DEPTH;
@@ -13,20 +18,83 @@ static size_t ATTACK_THREAD;
 static size_t ATTACK_LOOP;
 static size_t ATTACK_SIZE = 1024;
 
+// where callbacks run: "inline" (io thread), "loop" (posted to the
+// session pool's loop) or "pool" (handed to a separate user thread pool)
+static std::string ATTACK_CALLBACK = "inline";
+
 static std::unique_ptr<attacker> test;
 static std::unique_ptr<rpc::session_pool> sp;
 
+// user supplied executor for CALLBACK=pool
+static boost::asio::io_service pool_service;
+
+static void pool_execute(std::function<void ()> task)
+{
+    pool_service.post(task);
+}
+
+typedef std::chrono::steady_clock clock_type;
+
+// call -> callback latency of every request, in microseconds
+static boost::mutex latency_mutex;
+static std::vector<double> latency;
+static size_t errors;
+
 using msgpack::type::raw_ref;
 
-void callback_func(rpc::future f, raw_ref msg, rpc::shared_zone msglife)
+struct pending_callbacks {
+    pending_callbacks(size_t n) : count(n) { }
+
+    void done()
+    {
+        boost::mutex::scoped_lock lk(mutex);
+        if(--count == 0) {
+            cond.notify_all();
+        }
+    }
+
+    void wait()
+    {
+        boost::mutex::scoped_lock lk(mutex);
+        while(count > 0) {
+            cond.wait(lk);
+        }
+    }
+
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    size_t count;
+};
+
+void callback_func(rpc::future f, raw_ref msg, rpc::shared_zone msglife,
+        clock_type::time_point sent, pending_callbacks* pending)
 {
-    raw_ref result = f.get<raw_ref>();
+    double us = std::chrono::duration<double, std::micro>(
+            clock_type::now() - sent).count();
+
+    // a failed call is counted, not timed, and must not keep
+    // attack_callback() waiting
+    try {
+        raw_ref result = f.get<raw_ref>();
+
+        if(result.size != msg.size) {
+            BOOST_LOG_TRIVIAL(error) << "invalid size: " << result.size;
+        } else if(memcmp(result.ptr, msg.ptr, msg.size) != 0) {
+            BOOST_LOG_TRIVIAL(error) << "received data don't match with sent data.";
+        }
 
-    if(result.size != msg.size) {
-        BOOST_LOG_TRIVIAL(error) << "invalid size: " << result.size;
-    } else if(memcmp(result.ptr, msg.ptr, msg.size) != 0) {
-        BOOST_LOG_TRIVIAL(error) << "received data don't match with sent data.";
+        boost::mutex::scoped_lock lk(latency_mutex);
+        latency.push_back(us);
+    } catch (std::exception& e) {
+        BOOST_LOG_TRIVIAL(error) << "error: " << e.what();
+        boost::mutex::scoped_lock lk(latency_mutex);
+        ++errors;
+    } catch (...) {
+        BOOST_LOG_TRIVIAL(error) << "error: unknown error";
+        boost::mutex::scoped_lock lk(latency_mutex);
+        ++errors;
     }
+    pending->done();
 }
 
 void attack_callback()
@@ -41,16 +109,47 @@ void attack_callback()
         raw_ref msg = raw_ref((char*)msglife->allocate_align(ATTACK_SIZE), ATTACK_SIZE);
         memset((char *)msg.ptr, 0, ATTACK_SIZE);
 
+        pending_callbacks pending(ATTACK_DEPTH);
+
         for(size_t j=0; j < ATTACK_DEPTH; ++j) {
+            clock_type::time_point sent = clock_type::now();
             pipeline[j] = s.call("echo_huge", msglife, msg);
-            pipeline[j].attach_callback(
-                    std::bind(callback_func, std::placeholders::_1, msg, msglife));
-        }
 
-        for(size_t j=0; j < ATTACK_DEPTH; ++j) {
-            pipeline[j].wait(false);
+            std::function<void (rpc::future)> cb = std::bind(callback_func,
+                    std::placeholders::_1, msg, msglife, sent, &pending);
+            if(ATTACK_CALLBACK == "loop") {
+                pipeline[j].attach_callback(cb, sp->get_loop());
+            } else if(ATTACK_CALLBACK == "pool") {
+                pipeline[j].attach_callback(cb, rpc::executor_t(&pool_execute));
+            } else {
+                pipeline[j].attach_callback(cb);
+            }
         }
+
+        pending.wait();
+    }
+}
+
+static void show_latency()
+{
+    if(errors) {
+        std::cout << "errors : " << errors << std::endl;
+    }
+    if(latency.empty()) {
+        return;
     }
+    std::sort(latency.begin(), latency.end());
+
+    double sum = 0;
+    for(size_t i=0; i < latency.size(); ++i) {
+        sum += latency[i];
+    }
+
+    std::cout
+        << "callback usec : avg " << sum / latency.size()
+        << " p50 " << latency[latency.size() * 50 / 100]
+        << " p99 " << latency[latency.size() * 99 / 100]
+        << " max " << latency.back() << std::endl;
 }
 
 int main(int argc, char **argv)
@@ -62,18 +161,37 @@ int main(int argc, char **argv)
     ATTACK_THREAD = attacker::option("THREAD", 25, 100);
     ATTACK_LOOP   = attacker::option("LOOP",   5, 50);
 
+    const char* env_callback = getenv("CALLBACK");
+    if(env_callback) {
+        ATTACK_CALLBACK = env_callback;
+    }
+
     std::cout << "callback attack"
-        << " depth="  << ATTACK_DEPTH
-        << " thread=" << ATTACK_THREAD
-        << " loop="   << ATTACK_LOOP
+        << " depth="    << ATTACK_DEPTH
+        << " thread="   << ATTACK_THREAD
+        << " loop="     << ATTACK_LOOP
+        << " callback=" << ATTACK_CALLBACK
         << std::endl;
 
+    std::unique_ptr<boost::asio::io_service::work> pool_work(
+            new boost::asio::io_service::work(pool_service));
+    boost::thread_group pool_threads;
+    for(size_t i=0; i < 4; ++i) {
+        pool_threads.create_thread(
+                std::bind(static_cast<size_t (boost::asio::io_service::*)()>(
+                        &boost::asio::io_service::run), &pool_service));
+    }
+
     test.reset(new attacker());
 
     sp.reset(new rpc::session_pool(test->builder()));
     sp->start(4);
 
     test->run(ATTACK_THREAD, &attack_callback);
+    show_latency();
+
+    pool_work.reset();
+    pool_threads.join_all();
 
     return 0;
 }
@@ -3,6 +3,7 @@
 #include <boost/log/core.hpp>
 #include <boost/log/expressions.hpp>
 #include <boost/log/trivial.hpp>
+#include <chrono>
 #include <iostream>
 #include <signal.h>
 
@@ -32,13 +33,20 @@ int main(int argc, char **argv)
     ATTACK_THREAD = attacker::option("THREAD", 25, 100);
     ATTACK_LOOP   = attacker::option("LOOP", 5, 50);
 
+    const char* accepts = getenv("TEST_ACCEPTS");
     std::cout << "connect attack"
         << " thread=" << ATTACK_THREAD
         << " loop="   << ATTACK_LOOP
+        << " accepts=" << (accepts ? accepts : "default")
         << std::endl;
 
     test.reset(new attacker());
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
     test->run(ATTACK_THREAD, &attack_connect);
+    double elapsed = std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "connections/s : " << (ATTACK_THREAD * ATTACK_LOOP / elapsed) << std::endl;
 
     return 0;
 }
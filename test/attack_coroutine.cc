@@ -0,0 +1,133 @@
+// boost/asio/awaitable.hpp uses std::exchange without including <utility>
+#include <utility>
+
+#include "attack.h"
+
+#include <boost/log/core.hpp>
+#include <boost/log/expressions.hpp>
+#include <boost/log/trivial.hpp>
+#include <boost/thread.hpp>
+#include <iostream>
+#include <msgpack/rpc/awaitable.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <vector>
+
+static size_t ATTACK_DEPTH;
+static size_t ATTACK_THREAD;
+static size_t ATTACK_LOOP;
+
+static std::unique_ptr<attacker> test;
+static std::unique_ptr<rpc::session_pool> sp;
+
+static boost::mutex done_mutex;
+static boost::condition_variable done_cond;
+static size_t running;
+
+// same workload as attack_pipeline.cc: one OS thread per caller
+void attack_pipeline()
+{
+    std::vector<rpc::future> pipeline(ATTACK_DEPTH);
+
+    for(size_t i=0; i < ATTACK_LOOP; ++i) {
+        rpc::session s = sp->get_session(test->address());
+        s.set_timeout(30.0);
+
+        for(size_t j=0; j < ATTACK_DEPTH; ++j) {
+            pipeline[j] = s.call("add", 1, 2);
+        }
+
+        for(size_t j=0; j < ATTACK_DEPTH; ++j) {
+            int result = pipeline[j].get<int>();
+            if(result != 3) {
+                BOOST_LOG_TRIVIAL(error) << "invalid response: " << result;
+            }
+        }
+    }
+}
+
+// the same caller written as a coroutine; no thread waits on a future
+rpc::detached pipeline_coroutine()
+{
+    std::vector<rpc::future> pipeline(ATTACK_DEPTH);
+
+    try {
+        for(size_t i=0; i < ATTACK_LOOP; ++i) {
+            rpc::session s = sp->get_session(test->address());
+            s.set_timeout(30.0);
+
+            for(size_t j=0; j < ATTACK_DEPTH; ++j) {
+                pipeline[j] = s.call("add", 1, 2);
+            }
+
+            for(size_t j=0; j < ATTACK_DEPTH; ++j) {
+                rpc::future f = co_await pipeline[j];
+                int result = f.get<int>();
+                if(result != 3) {
+                    BOOST_LOG_TRIVIAL(error) << "invalid response: " << result;
+                }
+            }
+        }
+    } catch (std::exception& e) {
+        BOOST_LOG_TRIVIAL(error) << "error: " << e.what();
+    }
+
+    boost::mutex::scoped_lock lk(done_mutex);
+    if(--running == 0) {
+        done_cond.notify_all();
+    }
+}
+
+// runs every caller from a single thread
+void attack_coroutine()
+{
+    running = ATTACK_THREAD;
+    for(size_t i=0; i < ATTACK_THREAD; ++i) {
+        pipeline_coroutine();
+    }
+
+    boost::mutex::scoped_lock lk(done_mutex);
+    while(running > 0) {
+        done_cond.wait(lk);
+    }
+}
+
+static double now()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + (double)tv.tv_usec / 1000 / 1000;
+}
+
+int main(int argc, char **argv)
+{
+    boost::log::core::get()->set_filter(boost::log::trivial::severity >= boost::log::trivial::info);
+    signal(SIGPIPE, SIG_IGN);
+
+    ATTACK_DEPTH  = attacker::option("DEPTH",  25, 100);
+    ATTACK_THREAD = attacker::option("THREAD", 25, 100);
+    ATTACK_LOOP   = attacker::option("LOOP",   5, 50);
+
+    std::cout << "coroutine attack"
+        << " depth="  << ATTACK_DEPTH
+        << " caller=" << ATTACK_THREAD
+        << " loop="   << ATTACK_LOOP
+        << std::endl;
+
+    test.reset(new attacker());
+
+    sp.reset(new rpc::session_pool(test->builder()));
+    sp->start(4);
+
+    std::cout << "* thread per caller" << std::endl;
+    double start = now();
+    test->run(ATTACK_THREAD, &attack_pipeline);
+    std::cout << "wall time     : " << now() - start << std::endl;
+
+    std::cout << "* coroutine per caller, 1 thread" << std::endl;
+    start = now();
+    test->run(1, &attack_coroutine);
+    std::cout << "wall time     : " << now() - start << std::endl;
+
+    return 0;
+}
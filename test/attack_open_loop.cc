@@ -0,0 +1,79 @@
+#include "attack.h"
+
+#include <boost/log/core.hpp>
+#include <boost/log/expressions.hpp>
+#include <boost/log/trivial.hpp>
+#include <iostream>
+#include <signal.h>
+
+static size_t ATTACK_RATE;
+static size_t ATTACK_RATE_MAX;
+static size_t ATTACK_SECONDS;
+static size_t ATTACK_THREAD;
+
+static rpc::future call_add(rpc::session& s)
+{
+    return s.call("add", 1, 2);
+}
+
+// Sweeps the request rate from RATE up to RATE_MAX, doubling each step,
+// and reports where the latency tail or the throughput gives out.
+int main(int argc, char **argv)
+{
+    boost::log::core::get()->set_filter(boost::log::trivial::severity >= boost::log::trivial::info);
+    signal(SIGPIPE, SIG_IGN);
+
+    ATTACK_RATE     = attacker::option("RATE",     1000, 5000);
+    ATTACK_RATE_MAX = attacker::option("RATE_MAX", 16000, 640000);
+    ATTACK_SECONDS  = attacker::option("SECONDS",  2, 5);
+    ATTACK_THREAD   = attacker::option("THREAD",   4, 8);
+
+    const char* proto = getenv("TEST_PROTO");
+    std::cout << "open loop attack"
+        << " proto="    << (proto ? proto : "tcp")
+        << " rate="     << ATTACK_RATE
+        << " rate_max=" << ATTACK_RATE_MAX
+        << " seconds="  << ATTACK_SECONDS
+        << " thread="   << ATTACK_THREAD
+        << std::endl;
+
+    attacker test;
+    test.start_server();
+
+    rpc::session_pool sp(test.builder());
+    sp.start(4);
+
+    attacker::show_open_loop_header();
+
+    uint64_t base_p99 = 0;
+    size_t knee = 0;
+    for(size_t rate = ATTACK_RATE; rate <= ATTACK_RATE_MAX; rate *= 2) {
+        attacker::open_loop_report r = test.run_open_loop(
+                sp, rate, ATTACK_SECONDS, ATTACK_THREAD, &call_add);
+        attacker::show_open_loop(r);
+
+        uint64_t p99 = r.latency.percentile(99);
+        if(base_p99 == 0) {
+            base_p99 = p99;
+        }
+        // past the knee the server falls behind: throughput stops
+        // following the offered load and queueing blows up the tail
+        if(r.achieved_rate < r.target_rate * 0.95 || p99 > base_p99 * 10 || r.errors) {
+            knee = rate;
+            break;
+        }
+    }
+
+    if(knee) {
+        std::cout << "knee          : below " << knee << " req/s" << std::endl;
+    } else {
+        std::cout << "knee          : above " << ATTACK_RATE_MAX << " req/s" << std::endl;
+    }
+
+    sp.end();
+    sp.join();
+    test.end_server();
+    test.join_server();
+
+    return 0;
+}
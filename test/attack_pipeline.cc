@@ -26,6 +26,9 @@ void attack_pipeline()
             pipeline[j] = s.call("add", 1, 2);
         }
 
+        // one wakeup for the whole pipeline; get() below does not block
+        rpc::when_all(pipeline.begin(), pipeline.end()).wait(false);
+
         for(size_t j=0; j < ATTACK_DEPTH; ++j) {
             int result = pipeline[j].get<int>();
             if(result != 3) {
@@ -0,0 +1,123 @@
+#include "attack.h"
+
+#include <algorithm>
+#include <boost/log/core.hpp>
+#include <boost/log/expressions.hpp>
+#include <boost/log/trivial.hpp>
+#include <boost/thread.hpp>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <signal.h>
+#include <vector>
+
+static size_t ATTACK_THREAD;
+static size_t ATTACK_LOOP;
+static size_t ATTACK_SPIN;
+static size_t ATTACK_YIELD;
+static size_t ATTACK_INLINE;
+
+static std::unique_ptr<attacker> test;
+static std::unique_ptr<rpc::session_pool> sp;
+
+typedef std::chrono::steady_clock clock_type;
+
+// round trip of every synchronous call, in microseconds
+static boost::mutex latency_mutex;
+static std::vector<double> latency;
+
+// back-to-back synchronous calls: every get() waits for a round trip, so
+// the cost of parking and waking the caller is not hidden by pipelining
+void attack_spin()
+{
+    rpc::session s = sp->get_session(test->address());
+    s.set_timeout(30.0);
+    s.set_wait_spin(ATTACK_SPIN, ATTACK_YIELD);
+
+    std::vector<double> local;
+    local.reserve(ATTACK_LOOP);
+
+    for(size_t i=0; i < ATTACK_LOOP; ++i) {
+        clock_type::time_point start = clock_type::now();
+        int result = s.call("add", 1, 2).get<int>();
+        local.push_back(std::chrono::duration<double, std::micro>(
+                    clock_type::now() - start).count());
+
+        if(result != 3) {
+            BOOST_LOG_TRIVIAL(error) << "invalid response: " << result;
+        }
+    }
+
+    boost::mutex::scoped_lock lk(latency_mutex);
+    latency.insert(latency.end(), local.begin(), local.end());
+}
+
+static void show_histogram()
+{
+    if(latency.empty()) {
+        return;
+    }
+    std::sort(latency.begin(), latency.end());
+
+    // power of two buckets: [1,2) [2,4) ... usec
+    std::vector<size_t> buckets;
+    for(size_t i=0; i < latency.size(); ++i) {
+        size_t b = 0;
+        for(double v = latency[i]; v >= 2.0; v /= 2.0) {
+            ++b;
+        }
+        if(buckets.size() <= b) {
+            buckets.resize(b + 1);
+        }
+        ++buckets[b];
+    }
+
+    for(size_t b=0; b < buckets.size(); ++b) {
+        std::cout << "  < " << std::setw(8) << (1UL << (b + 1)) << " usec : "
+            << std::setw(8) << buckets[b] << " "
+            << std::string(buckets[b] * 60 / latency.size(), '#') << "\n";
+    }
+    std::cout
+        << "round trip usec : p50 " << latency[latency.size() * 50 / 100]
+        << " p99 " << latency[latency.size() * 99 / 100]
+        << " p999 " << latency[latency.size() * 999 / 1000]
+        << " max " << latency.back() << std::endl;
+}
+
+int main(int argc, char **argv)
+{
+    boost::log::core::get()->set_filter(boost::log::trivial::severity >= boost::log::trivial::info);
+    signal(SIGPIPE, SIG_IGN);
+
+    ATTACK_THREAD = attacker::option("THREAD", 4, 16);
+    ATTACK_LOOP   = attacker::option("LOOP",   5000, 50000);
+    ATTACK_SPIN   = attacker::option("SPIN",   0, 0);
+    ATTACK_YIELD  = attacker::option("YIELD",  0, 0);
+    ATTACK_INLINE = attacker::option("INLINE", 0, 0);
+
+    std::cout << "spin attack"
+        << " thread=" << ATTACK_THREAD
+        << " loop="   << ATTACK_LOOP
+        << " spin="   << ATTACK_SPIN
+        << " yield="  << ATTACK_YIELD
+        << " inline=" << ATTACK_INLINE
+        << std::endl;
+
+    test.reset(new attacker());
+
+    if(ATTACK_INLINE) {
+        // the pool shares one session per address: run with THREAD=1 to
+        // measure replies read on the caller thread
+        rpc::tcp_builder b;
+        b.inline_io(true);
+        sp.reset(new rpc::session_pool(b));
+    } else {
+        sp.reset(new rpc::session_pool(test->builder()));
+    }
+    sp->start(4);
+
+    test->run(ATTACK_THREAD, &attack_spin);
+    show_histogram();
+
+    return 0;
+}
@@ -39,6 +39,14 @@ public:
 			req.params().convert(&params);
 			err(req);
 
+		} else if(method == "count") {
+			std::tuple<int> params;
+			req.params().convert(&params);
+			count(req, std::get<0>(params));
+
+		} else if(method == "upload_size") {
+			upload_size(req);
+
 		} else if(method == "oneway") {
 			std::tuple<std::string> params;
 			req.params().convert(&params);
@@ -77,6 +85,28 @@ public:
 		req.error(std::string("always fail"));
 	}
 
+	// streams 0 .. n-1, one chunk each
+	void count(request req, int n)
+	{
+		for(int i = 0; i < n; ++i) {
+			req.stream_write(i);
+		}
+		req.finish();
+	}
+
+	// answers the total size of the uploaded strings
+	void upload_size(request req)
+	{
+		std::shared_ptr<size_t> total(new size_t(0));
+		req.on_chunk([req, total](msgpack::object chunk, msgpack::rpc::auto_zone z) mutable {
+			if(chunk.is_nil()) {
+				req.result(*total);
+				return;
+			}
+			*total += chunk.as<std::string>().size();
+		});
+	}
+
 	void oneway(request req, const std::string& msg)
 	{
 		std::cout << "notify recieved : " << msg << std::endl;
@@ -8,9 +8,20 @@ cd test 2>/dev/null
 export TEST_PROTO=tcp
 echo "* tcp test" | tee -a "$log_out"
 THREAD=500 LOOP=10 ./attack_connect  2>&1 | tee -a "$log_out"
+TEST_ACCEPTS=1 THREAD=500 LOOP=10 ./attack_connect  2>&1 | tee -a "$log_out"
 THREAD=500 LOOP=10 ./attack_pipeline 2>&1 | tee -a "$log_out"
 THREAD=500 LOOP=10 ./attack_callback 2>&1 | tee -a "$log_out"
+THREAD=500 LOOP=10 CALLBACK=loop ./attack_callback 2>&1 | tee -a "$log_out"
+THREAD=500 LOOP=10 CALLBACK=pool ./attack_callback 2>&1 | tee -a "$log_out"
+THREAD=500 LOOP=10 ./attack_coroutine 2>&1 | tee -a "$log_out"
 THREAD=100 LOOP=4  ./attack_huge     2>&1 | tee -a "$log_out"
+./attack_spin 2>&1 | tee -a "$log_out"
+SPIN=50 ./attack_spin 2>&1 | tee -a "$log_out"
+SPIN=50 YIELD=200 ./attack_spin 2>&1 | tee -a "$log_out"
+THREAD=1 ./attack_spin 2>&1 | tee -a "$log_out"
+THREAD=1 INLINE=1 ./attack_spin 2>&1 | tee -a "$log_out"
+./attack_open_loop 2>&1 | tee -a "$log_out"
+TEST_PROTO=udp ./attack_open_loop 2>&1 | tee -a "$log_out"
 
 #export TEST_PROTO=unix
 #echo "* unix test" | tee -a "$log_out"
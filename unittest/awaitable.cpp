@@ -0,0 +1,119 @@
+// C++20 coroutine tests, built on their own as unittest_awaitable
+// boost/asio/awaitable.hpp uses std::exchange without including <utility>
+#include <utility>
+
+#include <gtest/gtest.h>
+
+#include "echo_server.h"
+
+#include <boost/log/core.hpp>
+#include <boost/log/expressions.hpp>
+#include <boost/log/trivial.hpp>
+#include <boost/thread.hpp>
+#include <future>
+#include <msgpack/rpc/awaitable.h>
+#include <msgpack/rpc/client.h>
+#include <msgpack/rpc/exception.h>
+#include <msgpack/rpc/server.h>
+
+GTEST_API_ int main(int argc, char **argv)
+{
+    boost::log::core::get()->set_filter(boost::log::trivial::severity >= boost::log::trivial::error);
+
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
+
+static msgpack::rpc::detached add_twice(msgpack::rpc::client* cli, std::promise<int>* done)
+{
+    msgpack::rpc::future f = co_await cli->call("add", 1, 2);
+    msgpack::rpc::future g = co_await cli->call("add", f.get<int>(), 3);
+    done->set_value(g.get<int>());
+}
+
+static msgpack::rpc::detached await_error(msgpack::rpc::client* cli, std::promise<bool>* done)
+{
+    msgpack::rpc::future f = co_await cli->call("err");
+    try {
+        f.get<int>();
+        done->set_value(false);
+    } catch (const msgpack::rpc::remote_error&) {
+        done->set_value(true);
+    }
+}
+
+static msgpack::rpc::detached await_ready(msgpack::rpc::future f, std::promise<int>* done)
+{
+    // already complete: not suspended at all
+    msgpack::rpc::future g = co_await f;
+    done->set_value(g.get<int>());
+}
+
+static msgpack::rpc::detached await_on(msgpack::rpc::client* cli, msgpack::rpc::loop lo,
+        std::promise<boost::thread::id>* done)
+{
+    co_await msgpack::rpc::resume_on(cli->call("add", 1, 1), lo);
+    done->set_value(boost::this_thread::get_id());
+}
+
+static msgpack::rpc::detached throw_after_await(msgpack::rpc::client* cli, std::promise<void>* done)
+{
+    co_await cli->call("add", 1, 1);
+    done->set_value();
+    throw std::runtime_error("logged, not propagated");
+}
+
+TEST(Awaitable, CoAwait)
+{
+    using namespace msgpack;
+    using namespace msgpack::rpc;
+
+    try {
+        const int PORT = 18826;
+        msgpack::rpc::server server;
+
+        server.serve(std::make_shared<myecho>());
+        server.listen("0.0.0.0", PORT);
+        server.start(4);
+
+        msgpack::rpc::client cli("127.0.0.1", PORT);
+        cli.get_loop()->start(2);
+
+        std::promise<int> sum;
+        add_twice(&cli, &sum);
+        EXPECT_EQ(6, sum.get_future().get());
+
+        std::promise<bool> failed;
+        await_error(&cli, &failed);
+        EXPECT_TRUE(failed.get_future().get());
+
+        future f = cli.call("add", 2, 2);
+        f.wait();
+        std::promise<int> ready;
+        await_ready(f, &ready);
+        EXPECT_EQ(4, ready.get_future().get());
+
+        // resumed by the loop it was asked for, here its only thread
+        loop other;
+        other->start(1);
+        std::promise<boost::thread::id> other_thread;
+        other->submit([&other_thread]() {
+            other_thread.set_value(boost::this_thread::get_id());
+        });
+        std::promise<boost::thread::id> resumed;
+        await_on(&cli, other, &resumed);
+        EXPECT_EQ(other_thread.get_future().get(), resumed.get_future().get());
+        other->end();
+        other->join();
+
+        // the exception ends the coroutine and nothing else
+        std::promise<void> thrown;
+        throw_after_await(&cli, &thrown);
+        thrown.get_future().get();
+        EXPECT_EQ(3, cli.call("add", 1, 2).get<int>());
+    }
+    catch (const std::exception& e)
+    {
+        ADD_FAILURE() << e.what();
+    }
+}
@@ -1,7 +1,11 @@
 #ifndef H_MYECHO_SERVER_H
 #define H_MYECHO_SERVER_H
 
+#include <chrono>
+#include <memory>
 #include <msgpack/rpc/server.h>
+#include <string>
+#include <thread>
 #include <tuple>
 
 class myecho : public msgpack::rpc::dispatcher {
@@ -34,6 +38,28 @@ public:
                 req.params().convert(&params);
                 err(req);
 
+            } else if (method == "count") {
+                std::tuple<int> params;
+                req.params().convert(&params);
+                count(req, std::get<0>(params));
+
+            } else if (method == "stream_blobs") {
+                std::tuple<int, size_t, int> params;
+                req.params().convert(&params);
+                stream_blobs(req, std::get<0>(params), std::get<1>(params),
+                        std::get<2>(params));
+
+            } else if (method == "upload_size") {
+                upload_size(req);
+
+            } else if (method == "upload_size_slow") {
+                std::tuple<int> params;
+                req.params().convert(&params);
+                upload_size_slow(req, std::get<0>(params));
+
+            } else if (method == "upload_size_inline") {
+                upload_size_inline(req);
+
             } else if (method == "timeout") {
                 ;
             } else {
@@ -70,6 +96,66 @@ public:
 	{
 		req.error(std::string("always fail"));
 	}
+
+	void count(request req, int n)
+	{
+		for(int i = 0; i < n; ++i) {
+			req.stream_write(i);
+		}
+		req.finish();
+	}
+
+	// answers the total size of the uploaded strings
+	void upload_size(request req)
+	{
+		std::shared_ptr<size_t> total(new size_t(0));
+		req.on_chunk([req, total](msgpack::object chunk, msgpack::rpc::auto_zone z) mutable {
+			if(chunk.is_nil()) {
+				req.result(*total);
+				return;
+			}
+			*total += chunk.as<std::string>().size();
+		});
+	}
+
+	// the same, read on a thread of its own that takes 'ms' milliseconds
+	// for every chunk, so that the upload has to wait for it
+	void upload_size_slow(request req, int ms)
+	{
+		std::thread([req, ms]() mutable {
+			size_t total = 0;
+			std::string chunk;
+			while(req.next_chunk(&chunk)) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+				total += chunk.size();
+			}
+			req.result(total);
+		}).detach();
+	}
+
+	// the same, wrongly read on the thread that dispatched the request
+	void upload_size_inline(request req)
+	{
+		size_t total = 0;
+		std::string chunk;
+		while(req.next_chunk(&chunk)) {
+			total += chunk.size();
+		}
+		req.result(total);
+	}
+
+	// streams 'n' strings of 'size' bytes, 'ms' milliseconds apart
+	void stream_blobs(request req, int n, size_t size, int ms)
+	{
+		std::string blob(size, 'x');
+		for(int i = 0; i < n; ++i) {
+			if(i > 0 && ms > 0) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+			}
+			req.stream_write(blob);
+		}
+		req.finish();
+	}
 };
 
 #endif //  H_MYECHO_SERVER_H
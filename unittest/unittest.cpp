@@ -2,15 +2,26 @@
 
 #include "echo_server.h"
 
+#include <algorithm>
+#include <chrono>
+#include <deque>
 #include <boost/asio.hpp>
 #include <boost/log/core.hpp>
 #include <boost/log/expressions.hpp>
 #include <boost/log/trivial.hpp>
+#include <future>
 #include <memory>
+#include <sstream>
+#include <thread>
 #include <msgpack/rpc/client.h>
 #include <msgpack/rpc/server.h>
 #include <msgpack/rpc/exception.h>
+#include <msgpack/rpc/future_impl.h>
+#include <msgpack/rpc/log.h>
+#include <msgpack/rpc/send_buffer.h>
+#include <msgpack/rpc/trace.h>
 #include <msgpack/rpc/transport/tcp.h>
+#include <msgpack/rpc/zone_pool.h>
 
 GTEST_API_ int main(int argc, char **argv)
 {
@@ -230,3 +241,1339 @@ TEST(EchoServer, Notify)
         FAIL() << "Uncaught exception";
     }
 }
+
+// answers the requests it is given only when told to
+class holding_dispatcher : public msgpack::rpc::dispatcher {
+public:
+    holding_dispatcher() : m_max_held(0) { }
+
+    void dispatch(msgpack::rpc::request req)
+    {
+        boost::mutex::scoped_lock lk(m_mutex);
+        m_held.push_back(req);
+        m_max_held = std::max(m_max_held, m_held.size());
+    }
+
+    size_t held()
+    {
+        boost::mutex::scoped_lock lk(m_mutex);
+        return m_held.size();
+    }
+
+    size_t max_held()
+    {
+        boost::mutex::scoped_lock lk(m_mutex);
+        return m_max_held;
+    }
+
+    // answers the oldest request with its first argument
+    bool release()
+    {
+        std::unique_ptr<msgpack::rpc::request> req;
+        {
+            boost::mutex::scoped_lock lk(m_mutex);
+            if (m_held.empty()) {
+                return false;
+            }
+            req.reset(new msgpack::rpc::request(m_held.front()));
+            m_held.pop_front();
+        }
+        std::tuple<int, int> params;
+        req->params().convert(&params);
+        req->result(std::get<0>(params));
+        return true;
+    }
+
+private:
+    boost::mutex m_mutex;
+    std::deque<msgpack::rpc::request> m_held;
+    size_t m_max_held;
+};
+
+static bool wait_until(std::function<bool ()> cond, unsigned int ms = 2000)
+{
+    for (unsigned int i = 0; i < ms / 10; ++i) {
+        if (cond()) {
+            return true;
+        }
+        boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+    }
+    return cond();
+}
+
+TEST(EchoServer, FlowControl)
+{
+    using namespace msgpack;
+    using namespace msgpack::rpc;
+
+    try {
+        const int PORT = 18811;
+        msgpack::rpc::server server;
+
+        server.serve(std::make_shared<myecho>());
+        server.listen(tcp_listener("0.0.0.0", PORT).max_inflight_requests(1));
+        server.start(4);
+
+        msgpack::rpc::client cli("127.0.0.1", PORT);
+
+        std::vector<future> pipeline;
+        for (int i = 0; i < 100; ++i) {
+            pipeline.push_back(cli.call("add", i, 1));
+        }
+        for (int i = 0; i < 100; ++i) {
+            EXPECT_EQ(i + 1, pipeline[i].get<int>());
+        }
+    }
+    catch (const std::exception& e)
+    {
+        ADD_FAILURE() << e.what();
+    }
+}
+
+TEST(EchoServer, FlowControlPausesReads)
+{
+    using namespace msgpack;
+    using namespace msgpack::rpc;
+
+    try {
+        const int PORT = 18822;
+        msgpack::rpc::server server;
+        std::shared_ptr<holding_dispatcher> dp = std::make_shared<holding_dispatcher>();
+
+        server.serve(dp);
+        server.listen(tcp_listener("0.0.0.0", PORT).max_inflight_requests(2));
+        server.start(4);
+
+        msgpack::rpc::client cli("127.0.0.1", PORT);
+        cli.get_loop()->start(2);
+
+        std::vector<future> pipeline;
+        for (int i = 0; i < 10; ++i) {
+            pipeline.push_back(cli.call("hold", i, 0));
+        }
+
+        // the other requests stay unread while two are unanswered
+        EXPECT_TRUE(wait_until([&dp]() { return dp->held() == 2; }));
+        boost::this_thread::sleep(boost::posix_time::milliseconds(200));
+        EXPECT_EQ(2u, dp->held());
+
+        // each answer lets one more in
+        for (int i = 0; i < 10; ++i) {
+            EXPECT_TRUE(wait_until([&dp]() { return dp->held() > 0; }));
+            EXPECT_TRUE(dp->release());
+            EXPECT_EQ(i, pipeline[i].get<int>());
+        }
+        EXPECT_EQ(2u, dp->max_held());
+    }
+    catch (const std::exception& e)
+    {
+        ADD_FAILURE() << e.what();
+    }
+}
+
+// answers "add" after sleeping, on the thread that dispatches it
+class slow_dispatcher : public msgpack::rpc::dispatcher {
+public:
+    slow_dispatcher(unsigned int ms) : m_ms(ms) { }
+
+    void dispatch(msgpack::rpc::request req)
+    {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(m_ms));
+        std::tuple<int, int> params;
+        req.params().convert(&params);
+        req.result(std::get<0>(params) + std::get<1>(params));
+    }
+
+private:
+    unsigned int m_ms;
+};
+
+TEST(EchoServer, AdmissionControl)
+{
+    using namespace msgpack;
+    using namespace msgpack::rpc;
+
+    try {
+        const int PORT = 18823;
+        msgpack::rpc::server server;
+
+        server.serve(std::make_shared<slow_dispatcher>(20));
+        server.set_admission_control(5, 10);
+        server.listen("0.0.0.0", PORT);
+        server.start(4);
+
+        msgpack::rpc::client cli("127.0.0.1", PORT);
+        cli.get_loop()->start(2);
+
+        // pipelined requests queue behind the slow handler
+        std::vector<future> pipeline;
+        for (int i = 0; i < 30; ++i) {
+            pipeline.push_back(cli.call("add", i, 1));
+        }
+
+        uint64_t answered = 0;
+        uint64_t overloaded = 0;
+        for (int i = 0; i < 30; ++i) {
+            try {
+                EXPECT_EQ(i + 1, pipeline[i].get<int>());
+                ++answered;
+            } catch (const overloaded_error&) {
+                EXPECT_EQ(OVERLOADED_ERROR, pipeline[i].error().as<int>());
+                ++overloaded;
+            }
+        }
+        EXPECT_LT(0u, answered);
+        EXPECT_LT(0u, overloaded);
+        EXPECT_EQ(overloaded, server.get_shed_request_num());
+
+        // once the queue drains requests are admitted again
+        EXPECT_EQ(3, cli.call("add", 1, 2).get<int>());
+    }
+    catch (const std::exception& e)
+    {
+        ADD_FAILURE() << e.what();
+    }
+}
+
+TEST(EchoServer, MethodPriority)
+{
+    using namespace msgpack;
+    using namespace msgpack::rpc;
+
+    try {
+        const int PORT = 18811;
+        msgpack::rpc::server server;
+
+        server.serve(std::make_shared<myecho>());
+        server.set_method_priority("add", PRIORITY_HIGH);
+        server.set_method_priority("echo", PRIORITY_LOW);
+        server.listen("0.0.0.0", PORT);
+        server.start(4);
+
+        msgpack::rpc::client cli("127.0.0.1", PORT);
+        cli.set_method_priority("add", PRIORITY_HIGH);
+        cli.set_method_priority("echo", PRIORITY_LOW);
+
+        std::vector<future> adds;
+        std::vector<future> echos;
+        for (int i = 0; i < 50; ++i) {
+            echos.push_back(cli.call("echo", std::string("bulk")));
+            adds.push_back(cli.call("add", i, 1));
+        }
+        for (int i = 0; i < 50; ++i) {
+            EXPECT_EQ(i + 1, adds[i].get<int>());
+            EXPECT_EQ("bulk", echos[i].get<std::string>());
+        }
+    }
+    catch (const std::exception& e)
+    {
+        ADD_FAILURE() << e.what();
+    }
+}
+
+// records the order requests are dispatched in. "block" holds its thread
+// until unblock(), "throw" throws from the dispatcher.
+class ordering_dispatcher : public msgpack::rpc::dispatcher {
+public:
+    ordering_dispatcher() : m_blocked(true), m_entered(false) { }
+
+    void dispatch(msgpack::rpc::request req)
+    {
+        std::string method;
+        req.method().convert(&method);
+        if (method == "throw") {
+            throw std::runtime_error("thrown by the dispatcher");
+        }
+        {
+            boost::mutex::scoped_lock lk(m_mutex);
+            if (method == "block") {
+                m_entered = true;
+                while (m_blocked) {
+                    m_cond.wait(lk);
+                }
+            } else {
+                m_order.push_back(method);
+            }
+        }
+        req.result(true);
+    }
+
+    bool entered()
+    {
+        boost::mutex::scoped_lock lk(m_mutex);
+        return m_entered;
+    }
+
+    void unblock()
+    {
+        boost::mutex::scoped_lock lk(m_mutex);
+        m_blocked = false;
+        m_cond.notify_all();
+    }
+
+    std::vector<std::string> order()
+    {
+        boost::mutex::scoped_lock lk(m_mutex);
+        return m_order;
+    }
+
+private:
+    boost::mutex m_mutex;
+    boost::condition_variable m_cond;
+    bool m_blocked;
+    bool m_entered;
+    std::vector<std::string> m_order;
+};
+
+TEST(EchoServer, MethodPriorityOrder)
+{
+    using namespace msgpack;
+    using namespace msgpack::rpc;
+
+    try {
+        const int PORT = 18824;
+        msgpack::rpc::server server;
+        std::shared_ptr<ordering_dispatcher> dp = std::make_shared<ordering_dispatcher>();
+
+        server.serve(dp);
+        server.set_method_priority("high", PRIORITY_HIGH);
+        server.set_method_priority("low", PRIORITY_LOW);
+        server.listen("0.0.0.0", PORT);
+        // one thread, so that the requests below queue up while it is
+        // held by "block"
+        server.start(1);
+
+        msgpack::rpc::client cli("127.0.0.1", PORT);
+        cli.get_loop()->start(2);
+
+        future blocker = cli.call("block");
+        ASSERT_TRUE(wait_until(std::bind(&ordering_dispatcher::entered, dp)));
+
+        // sent, and read, after the low ones
+        std::vector<future> calls;
+        for (int i = 0; i < 10; ++i) {
+            calls.push_back(cli.call("low"));
+        }
+        calls.push_back(cli.call("high"));
+        boost::this_thread::sleep(boost::posix_time::milliseconds(200));
+
+        dp->unblock();
+        EXPECT_TRUE(blocker.get<bool>());
+        for (size_t i = 0; i < calls.size(); ++i) {
+            EXPECT_TRUE(calls[i].get<bool>());
+        }
+
+        std::vector<std::string> order = dp->order();
+        ASSERT_EQ(11u, order.size());
+        EXPECT_EQ("high", order[0]);
+
+        // a dispatcher that throws fails the request, as it does inline
+        EXPECT_THROW(cli.call("throw").get<bool>(), remote_error);
+        EXPECT_TRUE(cli.call("low").get<bool>());
+    }
+    catch (const std::exception& e)
+    {
+        ADD_FAILURE() << e.what();
+    }
+}
+
+TEST(EchoServer, DispatcherException)
+{
+    using namespace msgpack;
+    using namespace msgpack::rpc;
+
+    try {
+        const int PORT = 18825;
+        msgpack::rpc::server server;
+        std::shared_ptr<ordering_dispatcher> dp = std::make_shared<ordering_dispatcher>();
+        dp->unblock();
+
+        server.serve(dp);
+        server.listen("0.0.0.0", PORT);
+        server.start(4);
+
+        msgpack::rpc::client cli("127.0.0.1", PORT);
+        cli.get_loop()->start(2);
+
+        // dispatched inline; the connection stays up
+        EXPECT_THROW(cli.call("throw").get<bool>(), remote_error);
+        EXPECT_TRUE(cli.call("low").get<bool>());
+        EXPECT_EQ(1, server.get_connection_num());
+    }
+    catch (const std::exception& e)
+    {
+        ADD_FAILURE() << e.what();
+    }
+}
+
+TEST(EchoServer, CallbackExecutor)
+{
+    using namespace msgpack;
+    using namespace msgpack::rpc;
+
+    try {
+        const int PORT = 18812;
+        msgpack::rpc::server server;
+
+        server.serve(std::make_shared<myecho>());
+        server.listen("0.0.0.0", PORT);
+        server.start(4);
+
+        msgpack::rpc::client cli("127.0.0.1", PORT);
+        cli.get_loop()->start(2);
+
+        // user executor: record that it was used, then run inline
+        int executed = 0;
+        executor_t ex = [&executed](std::function<void ()> task) {
+            ++executed;
+            task();
+        };
+
+        std::promise<int> by_executor;
+        cli.call("add", 1, 2).attach_callback([&by_executor](future f) {
+            by_executor.set_value(f.get<int>());
+        }, ex);
+        EXPECT_EQ(3, by_executor.get_future().get());
+        EXPECT_EQ(1, executed);
+
+        std::promise<int> by_loop;
+        cli.call("add", 2, 2).attach_callback([&by_loop](future f) {
+            by_loop.set_value(f.get<int>());
+        }, cli.get_loop());
+        EXPECT_EQ(4, by_loop.get_future().get());
+
+        // an inline callback may attach to its own future again
+        std::promise<int> nested;
+        cli.call("add", 3, 2).attach_callback([&nested](future f) {
+            f.attach_callback([&nested](future g) {
+                nested.set_value(g.get<int>());
+            });
+        });
+        EXPECT_EQ(5, nested.get_future().get());
+    }
+    catch (const std::exception& e)
+    {
+        ADD_FAILURE() << e.what();
+    }
+}
+
+TEST(EchoServer, InlineIO)
+{
+    using namespace msgpack;
+    using namespace msgpack::rpc;
+
+    try {
+        const int PORT = 18813;
+        msgpack::rpc::server server;
+
+        server.serve(std::make_shared<myecho>());
+        server.listen("0.0.0.0", PORT);
+        server.start(4);
+
+        msgpack::rpc::client cli(tcp_builder().inline_io(true),
+                address("127.0.0.1", PORT));
+        cli.get_loop()->start(2);
+
+        // one call at a time: replies are read on this thread
+        for (int i = 0; i < 100; ++i) {
+            EXPECT_EQ(i + 1, cli.call("add", i, 1).get<int>());
+        }
+
+        // pipelined calls fall back to the loop
+        std::vector<future> calls;
+        for (int i = 0; i < 10; ++i) {
+            calls.push_back(cli.call("add", i, i));
+        }
+        for (int i = 0; i < 10; ++i) {
+            EXPECT_EQ(i * 2, calls[i].get<int>());
+        }
+
+        // a callback completes without anybody waiting
+        std::promise<int> by_callback;
+        cli.call("add", 3, 4).attach_callback([&by_callback](future f) {
+            by_callback.set_value(f.get<int>());
+        });
+        EXPECT_EQ(7, by_callback.get_future().get());
+
+        EXPECT_EQ(9, cli.call("add", 4, 5).get<int>());
+
+        // timed_wait() reads a reply that is already in the socket
+        future waited = cli.call("add", 5, 6);
+        boost::this_thread::sleep(boost::posix_time::milliseconds(100));
+        EXPECT_TRUE(waited.timed_wait(1000));
+        EXPECT_EQ(11, waited.get<int>());
+
+        // and gives up on one that does not come
+        future never = cli.call("timeout");
+        EXPECT_FALSE(never.timed_wait(100));
+        EXPECT_THROW(never.get<int>(), timeout_error);
+
+        EXPECT_EQ(13, cli.call("add", 6, 7).get<int>());
+    }
+    catch (const std::exception& e)
+    {
+        ADD_FAILURE() << e.what();
+    }
+}
+
+TEST(EchoServer, WaitSpin)
+{
+    using namespace msgpack;
+    using namespace msgpack::rpc;
+
+    try {
+        const int PORT = 18833;
+        const int SLOW_PORT = 18834;
+        msgpack::rpc::server server;
+        server.serve(std::make_shared<myecho>());
+        server.listen("0.0.0.0", PORT);
+        server.start(2);
+
+        msgpack::rpc::server slow;
+        slow.serve(std::make_shared<slow_dispatcher>(50));
+        slow.listen("0.0.0.0", SLOW_PORT);
+        slow.start(1);
+
+        rpc::session_pool sp;
+        sp.start(2);
+        rpc::session s = sp.get_session("127.0.0.1", PORT);
+        s.set_timeout(1);
+
+        // spinning only
+        s.set_wait_spin(1000);
+        for (int i = 0; i < 20; ++i) {
+            EXPECT_EQ(i + 1, s.call("add", i, 1).get<int>());
+        }
+
+        // spinning, then yielding
+        s.set_wait_spin(100, 1000);
+        for (int i = 0; i < 20; ++i) {
+            EXPECT_EQ(i + 2, s.call("add", i, 2).get<int>());
+        }
+
+        // a reply that outlasts both is waited for parked
+        rpc::session ss = sp.get_session("127.0.0.1", SLOW_PORT);
+        ss.set_timeout(3);
+        ss.set_wait_spin(100, 100);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        EXPECT_EQ(7, ss.call("add", 3, 4).get<int>());
+        EXPECT_LE(50, std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - start).count());
+
+        // and one that does not come still times out
+        EXPECT_THROW(s.call("timeout").get<int>(), timeout_error);
+        EXPECT_EQ(5, s.call("add", 2, 3).get<int>());
+    }
+    catch (const std::exception& e)
+    {
+        ADD_FAILURE() << e.what();
+    }
+}
+
+TEST(EchoServer, LatencyStats)
+{
+    using namespace msgpack;
+    using namespace msgpack::rpc;
+
+    try {
+        const int PORT = 18814;
+        msgpack::rpc::server server;
+
+        server.serve(std::make_shared<myecho>());
+        server.listen("0.0.0.0", PORT);
+        server.start(4);
+
+        msgpack::rpc::client cli("127.0.0.1", PORT);
+        cli.get_loop()->start(2);
+
+        for (int i = 0; i < 20; ++i) {
+            EXPECT_EQ(i * 2, cli.call("add", i, i).get<int>());
+        }
+        EXPECT_EQ("hi", cli.call("echo", std::string("hi")).get<std::string>());
+
+        latency_stats client_stats = cli.get_stats();
+        EXPECT_EQ(20u, client_stats["add"].count());
+        EXPECT_EQ(1u, client_stats["echo"].count());
+        EXPECT_LE(client_stats["add"].min(), client_stats["add"].percentile(50));
+        EXPECT_LE(client_stats["add"].percentile(50), client_stats["add"].max());
+
+        // the server records right after writing the response, which
+        // may be after the client saw it
+        for (int i = 0; i < 100; ++i) {
+            if (server.get_stats()["add"].count() == 20) {
+                break;
+            }
+            boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+        }
+        EXPECT_EQ(20u, server.get_stats()["add"].count());
+    }
+    catch (const std::exception& e)
+    {
+        ADD_FAILURE() << e.what();
+    }
+}
+
+TEST(EchoServer, LatencyStatsUnknownMethods)
+{
+    using namespace msgpack;
+    using namespace msgpack::rpc;
+
+    try {
+        const int PORT = 18832;
+        msgpack::rpc::server server;
+
+        server.serve(std::make_shared<myecho>());
+        server.listen("0.0.0.0", PORT);
+        server.start(4);
+
+        msgpack::rpc::client cli("127.0.0.1", PORT);
+        cli.get_loop()->start(2);
+        EXPECT_EQ(3, cli.call("add", 1, 2).get<int>());
+
+        // every name is a new method to the server, which answers NO_METHOD
+        const size_t N = MSGPACK_RPC_LATENCY_METHODS * 2;
+        for (size_t i = 0; i < N; ++i) {
+            std::ostringstream name;
+            name << "unknown" << i;
+            EXPECT_THROW(cli.call(name.str()).get<int>(), no_method_error);
+        }
+
+        EXPECT_TRUE(wait_until([&server, N]() {
+            latency_stats stats = server.get_stats();
+            uint64_t n = 0;
+            for (latency_stats::const_iterator it = stats.begin();
+                    it != stats.end(); ++it) {
+                n += it->second.count();
+            }
+            return n == N + 1;
+        }));
+        latency_stats stats = server.get_stats();
+        EXPECT_EQ((size_t)MSGPACK_RPC_LATENCY_METHODS, stats.size());
+        EXPECT_EQ(1u, stats["add"].count());
+        EXPECT_EQ(N + 2 - MSGPACK_RPC_LATENCY_METHODS, stats["<other>"].count());
+        EXPECT_EQ((size_t)MSGPACK_RPC_LATENCY_METHODS, cli.get_stats().size());
+    }
+    catch (const std::exception& e)
+    {
+        ADD_FAILURE() << e.what();
+    }
+}
+
+TEST(EchoServer, Trace)
+{
+    using namespace msgpack;
+    using namespace msgpack::rpc;
+
+    try {
+        const int PORT = 18815;
+        msgpack::rpc::server server;
+
+        server.serve(std::make_shared<myecho>());
+        server.listen("0.0.0.0", PORT);
+        server.start(4);
+
+        msgpack::rpc::client cli("127.0.0.1", PORT);
+        cli.get_loop()->start(2);
+
+        trace_start();
+        EXPECT_EQ(3, cli.call("add", 1, 2).get<int>());
+
+        // client and server stages of the call share one trace id; the
+        // server may record its last stage after the client is done
+        std::vector<bool> seen;
+        for (int i = 0; i < 100; ++i) {
+            std::vector<trace_event> events = trace_dump();
+            ASSERT_FALSE(events.empty());
+            uint64_t id = events.back().trace_id;
+
+            seen.assign(TRACE_SET_RESULT + 1, false);
+            for (size_t j = 0; j < events.size(); ++j) {
+                if (events[j].trace_id == id) {
+                    seen[events[j].stage] = true;
+                }
+            }
+            if (std::find(seen.begin(), seen.end(), false) == seen.end()) {
+                break;
+            }
+            boost::this_thread::sleep(boost::posix_time::milliseconds(10));
+        }
+        trace_stop();
+
+        for (size_t i = 0; i < seen.size(); ++i) {
+            EXPECT_TRUE(seen[i]) << trace_stage_name((trace_stage)i);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        trace_stop();
+        ADD_FAILURE() << e.what();
+    }
+}
+
+static msgpack::rpc::future add_one(msgpack::rpc::client* cli, msgpack::rpc::future f)
+{
+    return cli->call("add", f.get<int>(), 1);
+}
+
+TEST(EchoServer, Combinators)
+{
+    using namespace msgpack;
+    using namespace msgpack::rpc;
+
+    try {
+        const int PORT = 18811;
+        msgpack::rpc::server server;
+
+        server.serve(std::make_shared<myecho>());
+        server.listen("0.0.0.0", PORT);
+        server.start(4);
+
+        msgpack::rpc::client cli("127.0.0.1", PORT);
+        cli.get_loop()->start(2);
+
+        std::vector<future> calls;
+        for (int i = 0; i < 10; ++i) {
+            calls.push_back(cli.call("add", i, i));
+        }
+        when_all(calls.begin(), calls.end()).wait();
+        for (int i = 0; i < 10; ++i) {
+            EXPECT_TRUE(calls[i].is_ready());
+            EXPECT_EQ(i * 2, calls[i].get<int>());
+        }
+
+        size_t first = when_any(calls).get<size_t>();
+        EXPECT_LT(first, calls.size());
+
+        future chained = cli.call("add", 1, 2)
+            .then(std::bind(&add_one, &cli, std::placeholders::_1));
+        EXPECT_EQ(4, chained.get<int>());
+    }
+    catch (const std::exception& e)
+    {
+        ADD_FAILURE() << e.what();
+    }
+}
+
+TEST(EchoServer, PreparedCall)
+{
+    using namespace msgpack;
+    using namespace msgpack::rpc;
+
+    try {
+        const int PORT = 18816;
+        msgpack::rpc::server server;
+
+        server.serve(std::make_shared<myecho>());
+        server.listen("0.0.0.0", PORT);
+        server.start(4);
+
+        msgpack::rpc::client cli("127.0.0.1", PORT);
+        cli.get_loop()->start(2);
+
+        prepared_call add = cli.prepare("add", std::make_tuple(1, 2));
+        prepared_call echo = cli.prepare("echo", std::make_tuple(std::string("hello")));
+        EXPECT_EQ("add", add.method());
+
+        std::vector<future> calls;
+        for (int i = 0; i < 10; ++i) {
+            calls.push_back(cli.call(add));
+        }
+        for (int i = 0; i < 10; ++i) {
+            EXPECT_EQ(3, calls[i].get<int>());
+        }
+        EXPECT_EQ("hello", cli.call(echo).get<std::string>());
+
+        // regular calls still go through
+        EXPECT_EQ(5, cli.call("add", 2, 3).get<int>());
+
+        EXPECT_THROW(cli.call(prepared_call()), std::invalid_argument);
+    }
+    catch (const std::exception& e)
+    {
+        ADD_FAILURE() << e.what();
+    }
+}
+
+TEST(EchoServer, PipelinedResponses)
+{
+    using namespace msgpack;
+    using namespace msgpack::rpc;
+
+    try {
+        const int PORT = 18817;
+        msgpack::rpc::server server;
+
+        server.serve(std::make_shared<myecho>());
+        server.listen("0.0.0.0", PORT);
+        server.start(4);
+
+        msgpack::rpc::client cli("127.0.0.1", PORT);
+        cli.get_loop()->start(2);
+
+        // answered while the server dispatches one read, some of them
+        // too large to be held back
+        std::string big(100 * 1024, 'x');
+        std::vector<future> pipeline;
+        for (int i = 0; i < 200; ++i) {
+            if (i % 50 == 0) {
+                pipeline.push_back(cli.call("echo", big));
+            } else {
+                pipeline.push_back(cli.call("add", i, 1));
+            }
+        }
+        for (int i = 0; i < 200; ++i) {
+            if (i % 50 == 0) {
+                EXPECT_EQ(big, pipeline[i].get<std::string>());
+            } else {
+                EXPECT_EQ(i + 1, pipeline[i].get<int>());
+            }
+        }
+    }
+    catch (const std::exception& e)
+    {
+        ADD_FAILURE() << e.what();
+    }
+}
+
+TEST(EchoServer, StreamedResponse)
+{
+    using namespace msgpack;
+    using namespace msgpack::rpc;
+
+    try {
+        const int PORT = 18818;
+        msgpack::rpc::server server;
+
+        server.serve(std::make_shared<myecho>());
+        server.listen("0.0.0.0", PORT);
+        server.start(4);
+
+        msgpack::rpc::client cli("127.0.0.1", PORT);
+        cli.get_loop()->start(2);
+
+        future f = cli.call("count", 1000);
+        int chunk;
+        int n = 0;
+        while (f.next_chunk(&chunk)) {
+            EXPECT_EQ(n, chunk);
+            ++n;
+        }
+        EXPECT_EQ(1000, n);
+        f.get<void>();
+
+        // a plain response is a stream without chunks
+        future add = cli.call("add", 1, 2);
+        EXPECT_FALSE(add.next_chunk(&chunk));
+        EXPECT_EQ(3, add.get<int>());
+    }
+    catch (const std::exception& e)
+    {
+        ADD_FAILURE() << e.what();
+    }
+}
+
+TEST(EchoServer, StreamedResponseTimeout)
+{
+    using namespace msgpack;
+    using namespace msgpack::rpc;
+
+    try {
+        const int PORT = 18827;
+        msgpack::rpc::server server;
+
+        server.serve(std::make_shared<myecho>());
+        server.listen("0.0.0.0", PORT);
+        server.start(4);
+
+        msgpack::rpc::client cli("127.0.0.1", PORT);
+        cli.get_loop()->start(2);
+        cli.set_timeout(1);
+
+        // the stream takes longer than the timeout, but every chunk
+        // restarts it, also for a caller that only waits for the end
+        future f = cli.call("stream_blobs", 6, (size_t)16, 400);
+        f.get<void>();
+
+        std::string blob;
+        int n = 0;
+        while (f.next_chunk(&blob)) {
+            EXPECT_EQ(16u, blob.size());
+            ++n;
+        }
+        EXPECT_EQ(6, n);
+    }
+    catch (const std::exception& e)
+    {
+        ADD_FAILURE() << e.what();
+    }
+}
+
+TEST(EchoServer, StreamedResponseQueueLimit)
+{
+    using namespace msgpack;
+    using namespace msgpack::rpc;
+
+    try {
+        const int PORT = 18828;
+        msgpack::rpc::server server;
+
+        server.serve(std::make_shared<myecho>());
+        server.listen("0.0.0.0", PORT);
+        server.start(4);
+
+        msgpack::rpc::client cli("127.0.0.1", PORT);
+        cli.get_loop()->start(2);
+
+        // far more than MSGPACK_RPC_STREAM_QUEUE_SIZE: the connection is
+        // not read while the queue is full, and is read again as the
+        // reader, which starts late, takes chunks
+        const size_t SIZE = 512 * 1024;
+        future f = cli.call("stream_blobs", 16, SIZE, 0);
+        boost::this_thread::sleep(boost::posix_time::milliseconds(300));
+
+        std::string blob;
+        int n = 0;
+        while (f.next_chunk(&blob)) {
+            EXPECT_EQ(SIZE, blob.size());
+            ++n;
+        }
+        EXPECT_EQ(16, n);
+        f.get<void>();
+
+        EXPECT_EQ(3, cli.call("add", 1, 2).get<int>());
+    }
+    catch (const std::exception& e)
+    {
+        ADD_FAILURE() << e.what();
+    }
+}
+
+TEST(EchoServer, Upload)
+{
+    using namespace msgpack;
+    using namespace msgpack::rpc;
+
+    try {
+        const int PORT = 18819;
+        msgpack::rpc::server server;
+
+        server.serve(std::make_shared<myecho>());
+        server.listen("0.0.0.0", PORT);
+        server.start(4);
+
+        msgpack::rpc::client cli("127.0.0.1", PORT);
+        cli.get_loop()->start(2);
+
+        // more than the server queues for a connection
+        std::string part(64 * 1024, 'x');
+        upload up = cli.call_upload("upload_size", std::make_tuple());
+        for (int i = 0; i < 32; ++i) {
+            up.write(part);
+        }
+        future f = up.finish();
+        EXPECT_EQ(32 * part.size(), f.get<size_t>());
+
+        // the connection still serves plain calls
+        EXPECT_EQ(3, cli.call("add", 1, 2).get<int>());
+    }
+    catch (const std::exception& e)
+    {
+        ADD_FAILURE() << e.what();
+    }
+}
+
+TEST(EchoServer, UploadSlowReader)
+{
+    using namespace msgpack;
+    using namespace msgpack::rpc;
+
+    try {
+        const int PORT = 18829;
+        msgpack::rpc::server server;
+
+        server.serve(std::make_shared<myecho>());
+        server.listen("0.0.0.0", PORT);
+        server.start(4);
+
+        msgpack::rpc::client cli("127.0.0.1", PORT);
+        cli.get_loop()->start(2);
+
+        // the reader falls behind: past MSGPACK_RPC_UPLOAD_QUEUE_SIZE the
+        // server stops reading, and the writes wait for it
+        std::string part(256 * 1024, 'x');
+        upload up = cli.call_upload("upload_size_slow", std::make_tuple(20));
+        for (int i = 0; i < 16; ++i) {
+            up.write(part);
+        }
+        future f = up.finish();
+        EXPECT_EQ(16 * part.size(), f.get<size_t>());
+
+        // reading on the dispatching thread would never end
+        upload bad = cli.call_upload("upload_size_inline", std::make_tuple());
+        bad.write(part);
+        future err = bad.finish();
+        EXPECT_THROW(err.get<size_t>(), remote_error);
+
+        EXPECT_EQ(3, cli.call("add", 1, 2).get<int>());
+    }
+    catch (const std::exception& e)
+    {
+        ADD_FAILURE() << e.what();
+    }
+}
+
+TEST(EchoServer, ConnectionLimit)
+{
+    using namespace msgpack;
+    using namespace msgpack::rpc;
+
+    try {
+        const int PORT = 18820;
+        msgpack::rpc::server server;
+
+        server.serve(std::make_shared<myecho>());
+        server.listen(tcp_listener("0.0.0.0", PORT)
+                .max_connections(1).idle_timeout(2));
+        server.start(4);
+
+        msgpack::rpc::client first("127.0.0.1", PORT);
+        EXPECT_EQ(3, first.call("add", 1, 2).get<int>());
+        EXPECT_EQ(1, server.get_connection_num());
+        EXPECT_LT(0u, server.get_connection_memory());
+
+        // waits in the backlog until the first one is closed for being idle
+        msgpack::rpc::client second("127.0.0.1", PORT);
+        future f = second.call("add", 2, 3);
+        boost::this_thread::sleep(boost::posix_time::milliseconds(200));
+        EXPECT_FALSE(f.is_ready());
+        EXPECT_EQ(1, server.get_connection_num());
+
+        EXPECT_EQ(5, f.get<int>());
+        EXPECT_EQ(1, server.get_connection_num());
+    }
+    catch (const std::exception& e)
+    {
+        ADD_FAILURE() << e.what();
+    }
+}
+
+TEST(EchoServer, AcceptBurst)
+{
+    using namespace msgpack;
+    using namespace msgpack::rpc;
+
+    try {
+        const int PORT = 18821;
+        msgpack::rpc::server server;
+
+        server.serve(std::make_shared<myecho>());
+        server.listen(tcp_listener("0.0.0.0", PORT)
+                .pending_accepts(4).listen_backlog(64));
+        server.start(4);
+
+        std::vector<std::unique_ptr<msgpack::rpc::client> > clients;
+        std::vector<future> calls;
+        for (int i = 0; i < 32; ++i) {
+            clients.emplace_back(new msgpack::rpc::client("127.0.0.1", PORT));
+            calls.push_back(clients.back()->call("add", i, 1));
+        }
+        for (int i = 0; i < 32; ++i) {
+            EXPECT_EQ(i + 1, calls[i].get<int>());
+        }
+        EXPECT_EQ(32, server.get_connection_num());
+    }
+    catch (const std::exception& e)
+    {
+        ADD_FAILURE() << e.what();
+    }
+}
+
+TEST(Future, WhenAllEmpty)
+{
+    using namespace msgpack;
+    using namespace msgpack::rpc;
+
+    future all = when_all(std::vector<future>());
+    EXPECT_TRUE(all.is_ready());
+
+    // nobody runs the loop of this future, so nothing may wait for it
+    int called = 0;
+    all.attach_callback([&called](future) { ++called; });
+    EXPECT_EQ(1, called);
+
+    future next = all.then([&called](future) {
+        ++called;
+        return future();
+    });
+    next.wait();
+    EXPECT_EQ(2, called);
+
+    next.attach_callback([&called](future) { ++called; });
+    EXPECT_EQ(3, called);
+}
+
+TEST(Future, TimeoutRacesResult)
+{
+    using namespace msgpack;
+    using namespace msgpack::rpc;
+
+    loop lo;
+    object one;
+    one.type = msgpack::type::POSITIVE_INTEGER;
+    one.via.u64 = 1;
+
+    // a timeout that loses to a result being set must not return before
+    // the result is complete
+    for (int i = 0; i < 2000; ++i) {
+        shared_future impl(new future_impl(lo));
+        boost::thread completer([impl, one]() {
+            impl->set_result(one, object(), auto_zone());
+        });
+
+        future f(impl);
+        if (f.timed_wait(0)) {
+            EXPECT_TRUE(f.is_ready());
+            EXPECT_EQ(msgpack::type::POSITIVE_INTEGER, f.result().type);
+            EXPECT_TRUE(f.error().is_nil());
+        } else {
+            EXPECT_TRUE(f.result().is_nil());
+            EXPECT_FALSE(f.error().is_nil());
+        }
+        completer.join();
+    }
+}
+
+TEST(SessionPool, ConcurrentLookups)
+{
+    using namespace msgpack;
+    using namespace msgpack::rpc;
+
+    try {
+        const int PORT = 18830;
+        msgpack::rpc::server server;
+
+        server.serve(std::make_shared<myecho>());
+        server.listen("0.0.0.0", PORT);
+        server.start(4);
+
+        session_pool sp;
+        sp.start(2);
+
+        // threads look up the one session from their own snapshots, and
+        // it records into the pool's stats
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.push_back(std::thread([&sp, t] {
+                for (int i = 0; i < 100; ++i) {
+                    session s = sp.get_session("127.0.0.1", PORT);
+                    EXPECT_EQ(t + i, s.call("add", t, i).get<int>());
+                }
+            }));
+        }
+        for (size_t t = 0; t < threads.size(); ++t) {
+            threads[t].join();
+        }
+        EXPECT_EQ(400u, sp.get_stats()["add"].count());
+        EXPECT_EQ(400u, sp.get_session("127.0.0.1", PORT).get_stats()["add"].count());
+    }
+    catch (const std::exception& e)
+    {
+        ADD_FAILURE() << e.what();
+    }
+}
+
+TEST(Loop, StepList)
+{
+    using namespace msgpack;
+    using namespace msgpack::rpc;
+
+    try {
+        const int PORT = 18831;
+        msgpack::rpc::server server;
+
+        server.serve(std::make_shared<myecho>());
+        server.listen("0.0.0.0", PORT);
+        server.start(4);
+
+        msgpack::rpc::client cli("127.0.0.1", PORT);
+        cli.get_loop()->start(2);
+        cli.set_timeout(1);
+        loop lo = cli.get_loop();
+
+        // an idle session arms no timer
+        EXPECT_EQ(0u, lo->get_step_num());
+
+        // a request joins the step list, and the session leaves it once
+        // the request is over
+        future never = cli.call("timeout");
+        EXPECT_EQ(1u, lo->get_step_num());
+        EXPECT_THROW(never.get<int>(), timeout_error);
+        EXPECT_TRUE(wait_until([&lo] { return lo->get_step_num() == 0; }, 5000));
+
+        // and joins it again with the next one
+        future add = cli.call("add", 1, 2);
+        EXPECT_EQ(1u, lo->get_step_num());
+        EXPECT_EQ(3, add.get<int>());
+        EXPECT_TRUE(wait_until([&lo] { return lo->get_step_num() == 0; }, 3000));
+
+        // an empty pool arms no timer; one with sessions steps to evict
+        // them, while its idle sessions do not
+        session_pool sp;
+        EXPECT_EQ(0u, sp.get_loop()->get_step_num());
+        sp.get_session("127.0.0.1", PORT);
+        EXPECT_EQ(1u, sp.get_loop()->get_step_num());
+    }
+    catch (const std::exception& e)
+    {
+        ADD_FAILURE() << e.what();
+    }
+}
+
+TEST(LatencyRecorder, Methods)
+{
+    using namespace msgpack;
+    using namespace msgpack::rpc;
+
+    latency_recorder rec;
+    rec.record(std::string("add"), 10);
+
+    // a method read off the wire is the same method as its name
+    const char name[] = "add";
+    object o;
+    o.type = msgpack::type::STR;
+    o.via.str.ptr = name;
+    o.via.str.size = 3;
+    rec.record(o, 20);
+    rec.record("echo", 4, 30);
+
+    // on another thread, into another shard
+    std::thread([&rec] { rec.record(std::string("add"), 40); }).join();
+
+    latency_stats stats = rec.snapshot();
+    EXPECT_EQ(2u, stats.size());
+    EXPECT_EQ(3u, stats["add"].count());
+    EXPECT_EQ(10u, stats["add"].min());
+    EXPECT_EQ(40u, stats["add"].max());
+    EXPECT_EQ(1u, stats["echo"].count());
+}
+
+TEST(Log, SampleRate)
+{
+    using namespace msgpack::rpc;
+
+    log_limiter unlimited;
+    for (int i = 0; i < 10; ++i) {
+        EXPECT_EQ(1u, unlimited.allow());
+    }
+
+    // start right after a second begins, so the burst fits in it
+    typedef std::chrono::steady_clock clock;
+    std::chrono::seconds begun = std::chrono::duration_cast<std::chrono::seconds>(
+            clock::now().time_since_epoch());
+    while (std::chrono::duration_cast<std::chrono::seconds>(
+                clock::now().time_since_epoch()) == begun) {
+        boost::this_thread::sleep(boost::posix_time::milliseconds(1));
+    }
+
+    set_log_sample_rate(3);
+    log_limiter limiter;
+    std::vector<uint64_t> allowed;
+    for (int i = 0; i < 10; ++i) {
+        allowed.push_back(limiter.allow());
+    }
+    EXPECT_EQ(std::vector<uint64_t>({1, 1, 1, 0, 0, 0, 0, 0, 0, 0}), allowed);
+
+    // the first record of the next second counts the dropped ones
+    boost::this_thread::sleep(boost::posix_time::milliseconds(1100));
+    uint64_t n = limiter.allow();
+    EXPECT_EQ(8u, n);
+    EXPECT_EQ(1u, limiter.allow());
+    set_log_sample_rate(0);
+
+    std::ostringstream os;
+    os << log_dropped(n - 1) << "msg";
+    EXPECT_EQ("(7 dropped) msg", os.str());
+
+    std::ostringstream none;
+    none << log_dropped(0) << "msg";
+    EXPECT_EQ("msg", none.str());
+}
+
+TEST(ZonePool, Recycle)
+{
+    using namespace msgpack;
+    using namespace msgpack::rpc;
+
+    msgpack::sbuffer sbuf;
+    msgpack::pack(sbuf, msg_request<std::string, std::tuple<int, int> >(
+                "add", std::make_tuple(1, 2), 1));
+
+    std::shared_ptr<zone_pool> zones(new zone_pool());
+    msgpack::unpacker pac;
+
+    for (int i = 0; i < 100; ++i) {
+        // two messages per read, the second cut short
+        pac.reserve_buffer(sbuf.size() * 2);
+        memcpy(pac.buffer(), sbuf.data(), sbuf.size());
+        memcpy(pac.buffer() + sbuf.size(), sbuf.data(), sbuf.size() - 1);
+        pac.buffer_consumed(sbuf.size() * 2 - 1);
+
+        object msg;
+        auto_zone z;
+        ASSERT_TRUE(zones->next(&pac, &msg, &z));
+        msg_request<std::string, std::tuple<int, int> > req;
+        msg.convert(&req);
+        EXPECT_EQ("add", req.method);
+        EXPECT_EQ(2, std::get<1>(req.param));
+        EXPECT_FALSE(zones->next(&pac, &msg, &z));
+
+        // the rest of the second one
+        pac.reserve_buffer(1);
+        memcpy(pac.buffer(), sbuf.data() + sbuf.size() - 1, 1);
+        pac.buffer_consumed(1);
+        ASSERT_TRUE(zones->next(&pac, &msg, &z));
+        msg.convert(&req);
+        EXPECT_EQ(1u, req.msgid);
+    }
+
+    // whole messages reuse the same zone once it came back
+    EXPECT_EQ(1u, zones->created());
+    EXPECT_EQ(99u, zones->reused());
+
+    // the zone waiting for reuse is counted until it is trimmed
+    EXPECT_LT(zones->chunk_size(), zones->free_bytes());
+    zones->trim();
+    EXPECT_EQ(0u, zones->free_bytes());
+    zones->get();
+    EXPECT_EQ(2u, zones->created());
+}
+
+TEST(SendBuffer, Pack)
+{
+    using namespace msgpack;
+    using namespace msgpack::rpc;
+
+    std::string body(4096, 'x');
+    msg_request<std::string, std::tuple<std::string, int> > req(
+            "echo", std::make_tuple(body, 7), 3);
+
+    msgpack::sbuffer sbuf;
+    msgpack::pack(sbuf, req);
+
+    for (int i = 0; i < 2; ++i) {
+        send_buffer buf;
+        msgpack::pack(buf, req);
+        EXPECT_EQ(sbuf.size(), buf.size());
+
+        // the body is referenced, not copied
+        bool referenced = false;
+        std::string out;
+        for (size_t j = 0; j < buf.vector_size(); ++j) {
+            const struct iovec& v = buf.vector()[j];
+            referenced |= (v.iov_base == std::get<0>(req.param).data());
+            out.append((const char*)v.iov_base, v.iov_len);
+        }
+        EXPECT_TRUE(referenced);
+        EXPECT_EQ(std::string(sbuf.data(), sbuf.size()), out);
+    }
+}